@@ -0,0 +1,54 @@
+#ifndef CALO_CHANNEL_INDEX_H
+#define CALO_CHANNEL_INDEX_H
+
+// Standard library:
+#include <cstdint>
+
+// This project:
+#include <snfee/data/channel_id.h>
+
+namespace snfee {
+  namespace calo {
+
+    /// Number of crates
+    static const uint16_t NUMBER_OF_CRATES = 3;
+
+    /// Number of board slots per crate (numbers 0-20, slot 10 is the control board)
+    static const uint16_t NUMBER_OF_BOARD_SLOTS = 21;
+
+    /// Number of channels per board
+    static const uint16_t NUMBER_OF_BOARD_CHANNELS = 16;
+
+    /// Number of dense channel indexes
+    static const uint16_t NUMBER_OF_CHANNEL_INDEXES = NUMBER_OF_CRATES * NUMBER_OF_BOARD_SLOTS * NUMBER_OF_BOARD_CHANNELS;
+
+    /// Invalid dense channel index
+    static const uint16_t INVALID_CHANNEL_INDEX = 0xFFFF;
+
+    /// Return the dense index of a readout channel (crate number+board number+channel number)
+    inline uint16_t make_channel_index(const int crate_num_, const int board_num_, const int channel_num_)
+    {
+      if (crate_num_ < 0 or crate_num_ >= NUMBER_OF_CRATES) return INVALID_CHANNEL_INDEX;
+      if (board_num_ < 0 or board_num_ >= NUMBER_OF_BOARD_SLOTS) return INVALID_CHANNEL_INDEX;
+      if (channel_num_ < 0 or channel_num_ >= NUMBER_OF_BOARD_CHANNELS) return INVALID_CHANNEL_INDEX;
+      return (crate_num_ * NUMBER_OF_BOARD_SLOTS + board_num_) * NUMBER_OF_BOARD_CHANNELS + channel_num_;
+    }
+
+    /// Return the readout channel ID associated to a dense channel index
+    inline snfee::data::channel_id channel_index_to_id(const uint16_t index_)
+    {
+      return snfee::data::channel_id(index_ / (NUMBER_OF_BOARD_SLOTS * NUMBER_OF_BOARD_CHANNELS),
+                                     (index_ / NUMBER_OF_BOARD_CHANNELS) % NUMBER_OF_BOARD_SLOTS,
+                                     index_ % NUMBER_OF_BOARD_CHANNELS);
+    }
+
+  } // namespace calo
+} // namespace snfee
+
+#endif // CALO_CHANNEL_INDEX_H
+
+// Local Variables: --
+// mode: c++ --
+// c-file-style: "gnu" --
+// tab-width: 2 --
+// End: --
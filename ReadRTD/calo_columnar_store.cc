@@ -0,0 +1,333 @@
+// Ourselves:
+#include "calo_columnar_store.h"
+
+// Standard library:
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Third party:
+// - Bayeux:
+#include <bayeux/datatools/exception.h>
+#include <bayeux/datatools/utils.h>
+
+// This project:
+#include <snfee/model/feb_constants.h>
+
+// This example:
+#include "calo_channel_index.h"
+#include "calo_waveform_view.h"
+
+namespace snfee {
+  namespace calo {
+
+    const char     columnar_store::MAGIC[8]    = {'S', 'N', 'C', 'A', 'L', 'C', 'O', 'L'};
+    const uint32_t columnar_store::VERSION;
+    const uint32_t columnar_store::BLOCK_MAGIC = 0x4B4C4243; // "CBLK"
+
+    namespace {
+
+      /// \brief File header
+      struct file_header_type
+      {
+        char     magic[8];
+        uint32_t version;
+        uint32_t rows_per_block;
+        uint64_t number_of_records;
+        uint64_t number_of_rows;
+        uint64_t number_of_blocks;
+      };
+
+      /// \brief Block header
+      struct block_header_type
+      {
+        uint32_t magic;
+        uint32_t number_of_rows;
+        uint64_t number_of_samples;
+        uint64_t block_size; ///< Size of the block in bytes, header included
+      };
+
+      const std::size_t ALIGNMENT = 8;
+
+      std::size_t aligned_size(const std::size_t size_)
+      {
+        return (size_ + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+      }
+
+      // Write a column padded to the alignment:
+      template <typename T>
+      void write_column(std::ostream & out_, const std::vector<T> & column_)
+      {
+        static const char padding[ALIGNMENT] = {0};
+        std::size_t size = column_.size() * sizeof(T);
+        out_.write(reinterpret_cast<const char *>(column_.data()), size);
+        out_.write(padding, aligned_size(size) - size);
+        return;
+      }
+
+      // Map a column and move to the next one:
+      template <typename T>
+      const T * map_column(const char *& cursor_, const std::size_t count_)
+      {
+        const T * column = reinterpret_cast<const T *>(cursor_);
+        cursor_ += aligned_size(count_ * sizeof(T));
+        return column;
+      }
+
+    } // namespace
+
+    // ----- Writer -----
+
+    columnar_writer::columnar_writer(const std::string & path_, const uint32_t rows_per_block_)
+    {
+      DT_THROW_IF(rows_per_block_ == 0, std::logic_error, "Invalid number of rows per block!");
+      _path_ = path_;
+      DT_THROW_IF(!datatools::fetch_path_with_env(_path_), std::logic_error,
+                  "Invalid columnar store path '" << path_ << "'!");
+      _rows_per_block_ = rows_per_block_;
+      // Written to a temporary file, renamed at close so that an aborted
+      // conversion never leaves a store that looks complete:
+      _tmp_path_ = _path_ + ".tmp";
+      _fout_.open(_tmp_path_.c_str(), std::ios::binary | std::ios::trunc);
+      DT_THROW_IF(!_fout_, std::runtime_error, "Cannot open columnar store '" << _tmp_path_ << "'!");
+      // Placeholder for the header, rewritten at close:
+      file_header_type header;
+      std::memset(&header, 0, sizeof(header));
+      _fout_.write(reinterpret_cast<const char *>(&header), sizeof(header));
+      return;
+    }
+
+    columnar_writer::~columnar_writer()
+    {
+      if (_fout_.is_open()) {
+        // Not closed: the conversion was aborted, discard the partial store
+        try {
+          _fout_.close();
+          std::remove(_tmp_path_.c_str());
+          std::cerr << "error: " << "Incomplete columnar store '" << _path_ << "' discarded!" << std::endl;
+        } catch (std::exception & x) {
+          std::cerr << "error: " << x.what() << std::endl;
+        }
+      }
+      return;
+    }
+
+    void columnar_writer::add_hit(const int32_t run_id_,
+                                  const int32_t trigger_id_,
+                                  const snfee::data::calo_hit_record & calo_hit_)
+    {
+      uint16_t nsamples = calo_hit_.has_waveforms() ? calo_hit_.get_waveform_number_of_samples() : 0;
+      for (int ichannel = 0; ichannel < snfee::model::feb_constants::SAMLONG_NUMBER_OF_CHANNELS; ichannel++) {
+        const snfee::data::calo_hit_record::channel_data_record & ch_data = calo_hit_.get_channel_data(ichannel);
+        uint8_t flags = 0;
+        if (ch_data.is_lt())        flags |= columnar_store::FLAG_LT;
+        if (ch_data.is_ht())        flags |= columnar_store::FLAG_HT;
+        if (ch_data.is_underflow()) flags |= columnar_store::FLAG_UNDERFLOW;
+        if (ch_data.is_overflow())  flags |= columnar_store::FLAG_OVERFLOW;
+        _tdc_.push_back(calo_hit_.get_tdc());
+        _run_id_.push_back(run_id_);
+        _trigger_id_.push_back(trigger_id_);
+        _baseline_.push_back(ch_data.get_baseline());
+        _peak_.push_back(ch_data.get_peak());
+        _peak_cell_.push_back(ch_data.get_peak_cell());
+        _charge_.push_back(ch_data.get_charge());
+        _rising_cell_.push_back(ch_data.get_rising_cell());
+        _falling_cell_.push_back(ch_data.get_falling_cell());
+        _waveform_offset_.push_back(_samples_.size());
+        _channel_index_.push_back(make_channel_index(calo_hit_.get_crate_num(),
+                                                     calo_hit_.get_board_num(),
+                                                     snfee::model::feb_constants::SAMLONG_NUMBER_OF_CHANNELS * calo_hit_.get_chip_num() + ichannel));
+        _fcr_.push_back(calo_hit_.get_fcr());
+        _waveform_size_.push_back(nsamples);
+        waveform_view ch_samples = make_waveform_view(calo_hit_, ichannel);
+        for (uint16_t isample = 0; isample < ch_samples.size; isample++) {
+          _samples_.push_back(ch_samples[isample]);
+        }
+        _flags_.push_back(flags);
+        _number_of_rows_++;
+      }
+      if (_flags_.size() >= _rows_per_block_) {
+        _flush_block_();
+      }
+      return;
+    }
+
+    void columnar_writer::add_record()
+    {
+      _number_of_records_++;
+      return;
+    }
+
+    void columnar_writer::_flush_block_()
+    {
+      if (_flags_.empty()) return;
+      block_header_type header;
+      header.magic             = columnar_store::BLOCK_MAGIC;
+      header.number_of_rows    = _flags_.size();
+      header.number_of_samples = _samples_.size();
+      header.block_size        = sizeof(header);
+      std::size_t nrows = header.number_of_rows;
+      header.block_size += aligned_size(nrows * sizeof(uint64_t));
+      header.block_size += 9 * aligned_size(nrows * sizeof(int32_t));
+      header.block_size += 3 * aligned_size(nrows * sizeof(uint16_t));
+      header.block_size += aligned_size(_samples_.size() * sizeof(int16_t));
+      header.block_size += aligned_size(nrows * sizeof(uint8_t));
+      _fout_.write(reinterpret_cast<const char *>(&header), sizeof(header));
+      write_column(_fout_, _tdc_);
+      write_column(_fout_, _run_id_);
+      write_column(_fout_, _trigger_id_);
+      write_column(_fout_, _baseline_);
+      write_column(_fout_, _peak_);
+      write_column(_fout_, _peak_cell_);
+      write_column(_fout_, _charge_);
+      write_column(_fout_, _rising_cell_);
+      write_column(_fout_, _falling_cell_);
+      write_column(_fout_, _waveform_offset_);
+      write_column(_fout_, _channel_index_);
+      write_column(_fout_, _fcr_);
+      write_column(_fout_, _waveform_size_);
+      write_column(_fout_, _samples_);
+      write_column(_fout_, _flags_);
+      DT_THROW_IF(!_fout_, std::runtime_error, "Cannot write columnar store '" << _tmp_path_ << "'!");
+      _tdc_.clear();
+      _run_id_.clear();
+      _trigger_id_.clear();
+      _baseline_.clear();
+      _peak_.clear();
+      _peak_cell_.clear();
+      _charge_.clear();
+      _rising_cell_.clear();
+      _falling_cell_.clear();
+      _waveform_offset_.clear();
+      _channel_index_.clear();
+      _fcr_.clear();
+      _waveform_size_.clear();
+      _samples_.clear();
+      _flags_.clear();
+      _number_of_blocks_++;
+      return;
+    }
+
+    void columnar_writer::close()
+    {
+      _flush_block_();
+      file_header_type header;
+      std::memcpy(header.magic, columnar_store::MAGIC, sizeof(header.magic));
+      header.version           = columnar_store::VERSION;
+      header.rows_per_block    = _rows_per_block_;
+      header.number_of_records = _number_of_records_;
+      header.number_of_rows    = _number_of_rows_;
+      header.number_of_blocks  = _number_of_blocks_;
+      _fout_.seekp(0);
+      _fout_.write(reinterpret_cast<const char *>(&header), sizeof(header));
+      DT_THROW_IF(!_fout_, std::runtime_error, "Cannot write columnar store '" << _tmp_path_ << "'!");
+      _fout_.close();
+      DT_THROW_IF(!_fout_, std::runtime_error, "Cannot write columnar store '" << _tmp_path_ << "'!");
+      DT_THROW_IF(std::rename(_tmp_path_.c_str(), _path_.c_str()) != 0,
+                  std::runtime_error,
+                  "Cannot rename columnar store '" << _tmp_path_ << "' to '" << _path_ << "'!");
+      return;
+    }
+
+    // ----- Reader -----
+
+    columnar_reader::columnar_reader(const std::string & path_)
+    {
+      _path_ = path_;
+      DT_THROW_IF(!datatools::fetch_path_with_env(_path_), std::logic_error,
+                  "Invalid columnar store path '" << path_ << "'!");
+      _fd_ = ::open(_path_.c_str(), O_RDONLY);
+      DT_THROW_IF(_fd_ < 0, std::runtime_error, "Cannot open columnar store '" << _path_ << "'!");
+      struct stat st;
+      DT_THROW_IF(::fstat(_fd_, &st) != 0, std::runtime_error, "Cannot stat columnar store '" << _path_ << "'!");
+      _size_ = st.st_size;
+      DT_THROW_IF(_size_ < sizeof(file_header_type), std::logic_error,
+                  "Truncated columnar store '" << _path_ << "'!");
+      void * addr = ::mmap(nullptr, _size_, PROT_READ, MAP_SHARED, _fd_, 0);
+      DT_THROW_IF(addr == MAP_FAILED, std::runtime_error, "Cannot map columnar store '" << _path_ << "'!");
+      _data_ = static_cast<const char *>(addr);
+      ::madvise(addr, _size_, MADV_SEQUENTIAL);
+
+      const file_header_type * header = reinterpret_cast<const file_header_type *>(_data_);
+      DT_THROW_IF(std::memcmp(header->magic, columnar_store::MAGIC, sizeof(header->magic)) != 0,
+                  std::logic_error, "Invalid columnar store '" << _path_ << "'!");
+      DT_THROW_IF(header->version != columnar_store::VERSION, std::logic_error,
+                  "Unsupported version " << header->version << " of columnar store '" << _path_ << "'!");
+      _number_of_records_ = header->number_of_records;
+      _number_of_rows_    = header->number_of_rows;
+
+      // Locate the blocks:
+      std::size_t offset = sizeof(file_header_type);
+      for (uint64_t iblock = 0; iblock < header->number_of_blocks; iblock++) {
+        DT_THROW_IF(offset + sizeof(block_header_type) > _size_, std::logic_error,
+                    "Truncated columnar store '" << _path_ << "'!");
+        const block_header_type * bheader = reinterpret_cast<const block_header_type *>(_data_ + offset);
+        DT_THROW_IF(bheader->magic != columnar_store::BLOCK_MAGIC, std::logic_error,
+                    "Invalid block in columnar store '" << _path_ << "'!");
+        DT_THROW_IF(offset + bheader->block_size > _size_, std::logic_error,
+                    "Truncated columnar store '" << _path_ << "'!");
+        std::size_t nrows = bheader->number_of_rows;
+        columnar_store::block_view block;
+        block.number_of_rows    = bheader->number_of_rows;
+        block.number_of_samples = bheader->number_of_samples;
+        const char * cursor = _data_ + offset + sizeof(block_header_type);
+        block.tdc             = map_column<uint64_t>(cursor, nrows);
+        block.run_id          = map_column<int32_t>(cursor, nrows);
+        block.trigger_id      = map_column<int32_t>(cursor, nrows);
+        block.baseline        = map_column<int32_t>(cursor, nrows);
+        block.peak            = map_column<int32_t>(cursor, nrows);
+        block.peak_cell       = map_column<int32_t>(cursor, nrows);
+        block.charge          = map_column<int32_t>(cursor, nrows);
+        block.rising_cell     = map_column<int32_t>(cursor, nrows);
+        block.falling_cell    = map_column<int32_t>(cursor, nrows);
+        block.waveform_offset = map_column<uint32_t>(cursor, nrows);
+        block.channel_index   = map_column<uint16_t>(cursor, nrows);
+        block.fcr             = map_column<uint16_t>(cursor, nrows);
+        block.waveform_size   = map_column<uint16_t>(cursor, nrows);
+        block.samples         = map_column<int16_t>(cursor, bheader->number_of_samples);
+        block.flags           = map_column<uint8_t>(cursor, nrows);
+        _blocks_.push_back(block);
+        offset += bheader->block_size;
+      }
+      return;
+    }
+
+    columnar_reader::~columnar_reader()
+    {
+      if (_data_ != nullptr) {
+        ::munmap(const_cast<char *>(_data_), _size_);
+      }
+      if (_fd_ >= 0) {
+        ::close(_fd_);
+      }
+      return;
+    }
+
+    uint64_t columnar_reader::get_number_of_records() const
+    {
+      return _number_of_records_;
+    }
+
+    uint64_t columnar_reader::get_number_of_rows() const
+    {
+      return _number_of_rows_;
+    }
+
+    std::size_t columnar_reader::get_number_of_blocks() const
+    {
+      return _blocks_.size();
+    }
+
+    const columnar_store::block_view & columnar_reader::get_block(const std::size_t index_) const
+    {
+      DT_THROW_IF(index_ >= _blocks_.size(), std::range_error,
+                  "Invalid block index " << index_ << " in columnar store '" << _path_ << "'!");
+      return _blocks_[index_];
+    }
+
+  } // namespace calo
+} // namespace snfee
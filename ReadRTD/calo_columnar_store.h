@@ -0,0 +1,160 @@
+#ifndef CALO_COLUMNAR_STORE_H
+#define CALO_COLUMNAR_STORE_H
+
+// Standard library:
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// This project:
+#include <snfee/data/calo_hit_record.h>
+
+namespace snfee {
+  namespace calo {
+
+    /// \brief Columnar store of calo hit channels
+    ///
+    /// The store is a binary file ('.cols' extension) made of a header and
+    /// of blocks of rows. Each row is one SAMLONG channel of a calo hit
+    /// record. Within a block, each column is stored contiguously and
+    /// 8-byte aligned, and the waveforms of all rows are packed in a single
+    /// int16 sample array, so that a memory mapped file can be read without
+    /// any decoding. Numbers are stored in the native byte order.
+    struct columnar_store
+    {
+      static const char        MAGIC[8];        ///< File signature
+      static const uint32_t    VERSION = 1;     ///< Format version
+      static const uint32_t    BLOCK_MAGIC;     ///< Block signature
+
+      /// \brief Bits of the channel flag column
+      enum flag_bit_type {
+        FLAG_LT        = 0x1, ///< Low threshold
+        FLAG_HT        = 0x2, ///< High threshold
+        FLAG_UNDERFLOW = 0x4, ///< Underflow
+        FLAG_OVERFLOW  = 0x8  ///< Charge overflow
+      };
+
+      /// \brief Read-only view on a block of rows
+      struct block_view
+      {
+        uint32_t         number_of_rows    = 0;
+        uint64_t         number_of_samples = 0;
+        const uint64_t * tdc               = nullptr; ///< TDC timestamp (48 bits)
+        const int32_t  * run_id            = nullptr; ///< Run ID
+        const int32_t  * trigger_id        = nullptr; ///< Trigger ID
+        const int32_t  * baseline          = nullptr; ///< Firmware baseline       (LSB: ADC unit/16)
+        const int32_t  * peak              = nullptr; ///< Firmware peak amplitude (LSB: ADC unit/8)
+        const int32_t  * peak_cell         = nullptr; ///< Firmware peak position  (TDC: 0-1023)
+        const int32_t  * charge            = nullptr; ///< Firmware charge
+        const int32_t  * rising_cell       = nullptr; ///< Firmware rising edge crossing  (LSB: TDC unit/256)
+        const int32_t  * falling_cell      = nullptr; ///< Firmware falling edge crossing (LSB: TDC unit/256)
+        const uint32_t * waveform_offset   = nullptr; ///< Offset of the first sample in the sample array
+        const uint16_t * channel_index     = nullptr; ///< Dense channel index (see calo_channel_index.h)
+        const uint16_t * fcr               = nullptr; ///< First cell read (TDC: 0-1023)
+        const uint16_t * waveform_size     = nullptr; ///< Number of samples (0: no waveform)
+        const int16_t  * samples           = nullptr; ///< Waveform samples of all rows (ADC)
+        const uint8_t  * flags             = nullptr; ///< Channel flags (see flag_bit_type)
+      };
+
+    };
+
+    /// \brief Writer of a columnar store
+    struct columnar_writer
+    {
+      /// Constructor
+      columnar_writer(const std::string & path_, const uint32_t rows_per_block_ = 4096);
+
+      /// Destructor
+      ~columnar_writer();
+
+      /// Append the two SAMLONG channels of a calo hit
+      void add_hit(const int32_t run_id_,
+                   const int32_t trigger_id_,
+                   const snfee::data::calo_hit_record & calo_hit_);
+
+      /// Count a RTD record
+      void add_record();
+
+      /// Flush the pending rows, write the header and move the file in place
+      ///
+      /// The store is written to '<path>.tmp' and renamed at close. A writer
+      /// destroyed without close (aborted conversion) removes the
+      /// temporary file.
+      void close();
+
+    private:
+
+      /// Write the pending rows as a block
+      void _flush_block_();
+
+      std::string   _path_;
+      std::string   _tmp_path_;   ///< Temporary path, renamed at close
+      std::ofstream _fout_;
+      uint32_t      _rows_per_block_ = 4096;
+      uint64_t      _number_of_records_ = 0;
+      uint64_t      _number_of_rows_ = 0;
+      uint64_t      _number_of_blocks_ = 0;
+
+      // Pending columns:
+      std::vector<uint64_t> _tdc_;
+      std::vector<int32_t>  _run_id_;
+      std::vector<int32_t>  _trigger_id_;
+      std::vector<int32_t>  _baseline_;
+      std::vector<int32_t>  _peak_;
+      std::vector<int32_t>  _peak_cell_;
+      std::vector<int32_t>  _charge_;
+      std::vector<int32_t>  _rising_cell_;
+      std::vector<int32_t>  _falling_cell_;
+      std::vector<uint32_t> _waveform_offset_;
+      std::vector<uint16_t> _channel_index_;
+      std::vector<uint16_t> _fcr_;
+      std::vector<uint16_t> _waveform_size_;
+      std::vector<int16_t>  _samples_;
+      std::vector<uint8_t>  _flags_;
+
+    };
+
+    /// \brief Memory mapped reader of a columnar store
+    struct columnar_reader
+    {
+      /// Constructor
+      columnar_reader(const std::string & path_);
+
+      /// Destructor
+      ~columnar_reader();
+
+      /// Return the number of RTD records converted in the store
+      uint64_t get_number_of_records() const;
+
+      /// Return the number of rows
+      uint64_t get_number_of_rows() const;
+
+      /// Return the number of blocks
+      std::size_t get_number_of_blocks() const;
+
+      /// Return a view on a block
+      const columnar_store::block_view & get_block(const std::size_t index_) const;
+
+    private:
+
+      std::string  _path_;
+      int          _fd_ = -1;
+      const char * _data_ = nullptr;
+      std::size_t  _size_ = 0;
+      uint64_t     _number_of_records_ = 0;
+      uint64_t     _number_of_rows_ = 0;
+      std::vector<columnar_store::block_view> _blocks_;
+
+    };
+
+  } // namespace calo
+} // namespace snfee
+
+#endif // CALO_COLUMNAR_STORE_H
+
+// Local Variables: --
+// mode: c++ --
+// c-file-style: "gnu" --
+// tab-width: 2 --
+// End: --
@@ -0,0 +1,179 @@
+// Ourselves:
+#include "calo_firmware_emulation.h"
+
+// Standard library:
+#include <algorithm>
+
+// Third party:
+// - Bayeux:
+#include <bayeux/datatools/exception.h>
+
+// This project:
+#include <snfee/model/feb_constants.h>
+
+namespace snfee {
+  namespace calo {
+
+    namespace {
+
+      /// Arithmetic right shift rounding toward minus infinity
+      inline int32_t floor_shift(const int32_t value_, const int shift_)
+      {
+        if (value_ >= 0) return value_ >> shift_;
+        return -((-value_ + (1 << shift_) - 1) >> shift_);
+      }
+
+    }
+
+    void firmware_emulation::config_type::parse(const std::string & path_)
+    {
+      datatools::properties config;
+      datatools::properties::read_config(path_, config);
+      configure(config);
+      return;
+    }
+
+    void firmware_emulation::config_type::configure(const datatools::properties & config_)
+    {
+      if (config_.has_key("firmware_emulation.baseline_samples")) {
+        baseline_samples = config_.fetch_integer("firmware_emulation.baseline_samples");
+      }
+      if (config_.has_key("firmware_emulation.charge_pre_peak_cells")) {
+        charge_pre_peak_cells = config_.fetch_integer("firmware_emulation.charge_pre_peak_cells");
+      }
+      if (config_.has_key("firmware_emulation.charge_post_peak_cells")) {
+        charge_post_peak_cells = config_.fetch_integer("firmware_emulation.charge_post_peak_cells");
+      }
+      if (config_.has_key("firmware_emulation.cfd_fraction")) {
+        cfd_fraction = config_.fetch_integer("firmware_emulation.cfd_fraction");
+      }
+      return;
+    }
+
+    firmware_emulation::firmware_emulation(const config_type & cfg_)
+      : _config_(cfg_)
+    {
+      DT_THROW_IF(_config_.baseline_samples == 0
+                  or (_config_.baseline_samples & (_config_.baseline_samples - 1)) != 0,
+                  std::logic_error,
+                  "Number of baseline samples (" << _config_.baseline_samples << ") is not a power of 2!");
+      DT_THROW_IF(_config_.cfd_fraction == 0 or _config_.cfd_fraction >= 256,
+                  std::logic_error,
+                  "Invalid CFD fraction (" << _config_.cfd_fraction << "/256)!");
+      while ((1 << _baseline_shift_) < _config_.baseline_samples) {
+        _baseline_shift_++;
+      }
+      return;
+    }
+
+    const firmware_emulation::config_type & firmware_emulation::get_config() const
+    {
+      return _config_;
+    }
+
+    void firmware_emulation::emulate(const uint16_t * samples_,
+                                     const std::size_t nsamples_,
+                                     result_type & result_) const
+    {
+      result_ = result_type();
+      if (nsamples_ < _config_.baseline_samples) return;
+      const int32_t adc_zero = snfee::model::feb_constants::SAMLONG_ADC_ZERO;
+
+      // Baseline (ADC unit/16):
+      int32_t baseline_sum = 0;
+      for (std::size_t i = 0; i < _config_.baseline_samples; i++) {
+        baseline_sum += (int32_t) samples_[i] - adc_zero;
+      }
+      int32_t baseline16 = (_baseline_shift_ <= 4)
+        ? baseline_sum * (1 << (4 - _baseline_shift_))
+        : floor_shift(baseline_sum, _baseline_shift_ - 4);
+      result_.baseline = baseline16;
+
+      // Peak (ADC unit/8), first minimum sample:
+      std::size_t ipeak = std::min_element(samples_, samples_ + nsamples_) - samples_;
+      int32_t peak16 = 16 * ((int32_t) samples_[ipeak] - adc_zero) - baseline16;
+      result_.peak = floor_shift(peak16, 1);
+      result_.peak_cell = ipeak;
+
+      // Charge (ADC unit x sample):
+      std::size_t first = (ipeak > _config_.charge_pre_peak_cells) ? ipeak - _config_.charge_pre_peak_cells : 0;
+      std::size_t last = std::min(nsamples_, ipeak + _config_.charge_post_peak_cells);
+      int32_t charge_sum = 0;
+      for (std::size_t i = first; i < last; i++) {
+        charge_sum += (int32_t) samples_[i] - adc_zero;
+      }
+      result_.charge = floor_shift(16 * charge_sum - (int32_t) (last - first) * baseline16, 4);
+
+      // Rising edge crossing (TDC unit/256):
+      int32_t level16 = baseline16 + floor_shift(2 * result_.peak * (int32_t) _config_.cfd_fraction, 8);
+      std::size_t icross = ipeak;
+      while (icross > 0 and 16 * ((int32_t) samples_[icross - 1] - adc_zero) <= level16) {
+        icross--;
+      }
+      if (icross > 0) {
+        int32_t above16 = 16 * ((int32_t) samples_[icross - 1] - adc_zero);
+        int32_t below16 = 16 * ((int32_t) samples_[icross] - adc_zero);
+        int32_t fraction256 = ((above16 - level16) * 256) / (above16 - below16);
+        result_.rising_cell = (int32_t) (icross - 1) * 256 + fraction256;
+      }
+      return;
+    }
+
+    void firmware_comparison::compare(const firmware_emulation::result_type & recorded_,
+                                      const firmware_emulation::result_type & emulated_)
+    {
+      number_of_channels++;
+      bool exact = true;
+      if (recorded_.baseline != emulated_.baseline) {
+        baseline_mismatches++;
+        exact = false;
+      }
+      if (recorded_.peak != emulated_.peak) {
+        peak_mismatches++;
+        exact = false;
+      }
+      if (recorded_.peak_cell != emulated_.peak_cell) {
+        peak_cell_mismatches++;
+        exact = false;
+      }
+      if (recorded_.charge != emulated_.charge) {
+        charge_mismatches++;
+        exact = false;
+      }
+      if (recorded_.rising_cell != emulated_.rising_cell) {
+        rising_cell_mismatches++;
+        exact = false;
+      }
+      if (exact) {
+        number_of_exact_channels++;
+      }
+      return;
+    }
+
+    void firmware_comparison::merge(const firmware_comparison & other_)
+    {
+      number_of_channels       += other_.number_of_channels;
+      number_of_exact_channels += other_.number_of_exact_channels;
+      baseline_mismatches      += other_.baseline_mismatches;
+      peak_mismatches          += other_.peak_mismatches;
+      peak_cell_mismatches     += other_.peak_cell_mismatches;
+      charge_mismatches        += other_.charge_mismatches;
+      rising_cell_mismatches   += other_.rising_cell_mismatches;
+      return;
+    }
+
+    void firmware_comparison::print_report(std::ostream & out_) const
+    {
+      out_ << "Firmware emulation vs recorded firmware measurements :" << std::endl;
+      out_ << "  Compared channels              : " << number_of_channels << std::endl;
+      out_ << "  Identical channels             : " << number_of_exact_channels << std::endl;
+      out_ << "  Baseline mismatches            : " << baseline_mismatches << std::endl;
+      out_ << "  Peak mismatches                : " << peak_mismatches << std::endl;
+      out_ << "  Peak cell mismatches           : " << peak_cell_mismatches << std::endl;
+      out_ << "  Charge mismatches              : " << charge_mismatches << std::endl;
+      out_ << "  Rising cell mismatches         : " << rising_cell_mismatches << std::endl;
+      return;
+    }
+
+  } // namespace calo
+} // namespace snfee
@@ -0,0 +1,112 @@
+#ifndef CALO_FIRMWARE_EMULATION_H
+#define CALO_FIRMWARE_EMULATION_H
+
+// Standard library:
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+// Third party:
+// - Bayeux:
+#include <bayeux/datatools/properties.h>
+
+namespace snfee {
+  namespace calo {
+
+    /// \brief Fixed-point emulation of the SAMLONG firmware measurements
+    ///
+    /// Integer implementation of the baseline, peak, charge and CFD
+    /// measurements of the WaveCatcher firmware, in the firmware LSB units:
+    ///
+    /// - baseline: sum of the first baseline_samples samples, scaled to
+    ///   ADC unit/16 (shift, baseline_samples is a power of 2),
+    /// - peak: minimum sample minus the baseline (ADC unit/8), peak cell is
+    ///   the first minimum sample,
+    /// - charge: baseline subtracted sum of the samples in
+    ///   [peak cell - charge_pre_peak_cells, peak cell + charge_post_peak_cells[
+    ///   (ADC unit x sample),
+    /// - rising cell: crossing of cfd_fraction x peak on the leading edge,
+    ///   linear interpolation (TDC unit/256).
+    ///
+    /// Right shifts round toward minus infinity as in the firmware. The
+    /// parameters must match the firmware settings of the run; they are read
+    /// from the 'firmware_emulation.*' keys of the calo analysis
+    /// configuration file.
+    struct firmware_emulation
+    {
+      /// \brief Configuration parameters
+      struct config_type
+      {
+        uint16_t baseline_samples       = 16;  ///< Number of samples of the baseline (power of 2)
+        uint16_t charge_pre_peak_cells  = 16;  ///< Charge window start before the peak cell
+        uint16_t charge_post_peak_cells = 48;  ///< Charge window end after the peak cell
+        uint16_t cfd_fraction           = 128; ///< CFD fraction (LSB: 1/256)
+
+        /// Parse a calo analysis configuration file
+        void parse(const std::string & path_);
+
+        /// Set the parameters from a calo analysis configuration
+        void configure(const datatools::properties & config_);
+      };
+
+      /// \brief Emulated firmware measurements (firmware LSB units)
+      struct result_type
+      {
+        int32_t baseline     = 0; ///< Baseline       (LSB: ADC unit/16)
+        int32_t peak         = 0; ///< Peak amplitude (LSB: ADC unit/8)
+        int32_t peak_cell    = 0; ///< Peak position  (TDC: 0-1023)
+        int32_t charge       = 0; ///< Charge         (LSB: ADC unit x sample)
+        int32_t rising_cell  = 0; ///< Rising edge crossing (LSB: TDC unit/256)
+      };
+
+      /// Constructor
+      firmware_emulation(const config_type & cfg_);
+
+      /// Emulate the firmware measurements on the ADC samples of a channel
+      void emulate(const uint16_t * samples_,
+                   const std::size_t nsamples_,
+                   result_type & result_) const;
+
+      /// Return the configuration
+      const config_type & get_config() const;
+
+    private:
+
+      config_type _config_;
+      int         _baseline_shift_ = 0; ///< log2(baseline_samples)
+
+    };
+
+    /// \brief Comparison of the emulated and recorded firmware measurements
+    struct firmware_comparison
+    {
+      /// Compare the measurements on a channel, recorded values first
+      void compare(const firmware_emulation::result_type & recorded_,
+                   const firmware_emulation::result_type & emulated_);
+
+      /// Add the counters of another comparison
+      void merge(const firmware_comparison & other_);
+
+      /// Print the comparison report
+      void print_report(std::ostream & out_) const;
+
+      std::size_t number_of_channels       = 0; ///< Number of compared channels
+      std::size_t number_of_exact_channels = 0; ///< Number of channels with identical measurements
+      std::size_t baseline_mismatches      = 0; ///< Number of baseline mismatches
+      std::size_t peak_mismatches          = 0; ///< Number of peak mismatches
+      std::size_t peak_cell_mismatches     = 0; ///< Number of peak cell mismatches
+      std::size_t charge_mismatches        = 0; ///< Number of charge mismatches
+      std::size_t rising_cell_mismatches   = 0; ///< Number of rising cell mismatches
+    };
+
+  } // namespace calo
+} // namespace snfee
+
+#endif // CALO_FIRMWARE_EMULATION_H
+
+// Local Variables: --
+// mode: c++ --
+// c-file-style: "gnu" --
+// tab-width: 2 --
+// End: --
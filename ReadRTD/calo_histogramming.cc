@@ -1,10 +1,26 @@
 // Ourselves:
 #include "calo_histogramming.h"
 
+// Standard library:
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+// Third party:
+// - ROOT:
+#include <TFile.h>
+#include <TH2D.h>
+// - Bayeux:
+#include <bayeux/datatools/exception.h>
+
 // This project:
 #include <snfee/data/calo_waveform_drawer.h>
 #include <snfee/model/feb_constants.h>
 
+// This example:
+#include "calo_channel_index.h"
+
 namespace snfee {
   namespace calo {
 
@@ -17,16 +33,142 @@ namespace snfee {
     
     void histogramming::initialize()
     {
-      hservice.initialize_standalone(hservice_config);
-      hpool = &hservice.grab_pool();
+      if (_shard_) {
+        // No histogram service, the shard only needs a pool:
+        datatools::properties pool_config;
+        _shard_pool_.reset(new mygsl::histogram_pool);
+        _shard_pool_->initialize(pool_config);
+        hpool = _shard_pool_.get();
+      } else {
+        hservice.initialize_standalone(hservice_config);
+        hpool = &hservice.grab_pool();
+      }
       tree_name = "RTD calo histograms";
+      _handles_1d_.assign(NUMBER_OF_CHANNEL_INDEXES * NUMBER_OF_QUANTITIES, nullptr);
+      _handles_2d_.assign(NUMBER_OF_CHANNEL_INDEXES, nullptr);
       return;
     }
 
     void histogramming::terminate()
     {
-      hservice.store_as_root_file(config.root_output_filename);
+      _handles_1d_.clear();
+      _handles_2d_.clear();
+      if (_shard_) {
+        hpool = nullptr;
+        _shard_pool_.reset();
+        _sparse_2d_.clear();
+        return;
+      }
+      // Merge the shards in a fixed order:
+      for (auto & shard : _shards_) {
+        merge(*shard);
+        shard->terminate();
+      }
+      DT_LOG_DEBUG(logging, "Merged histogram shards: " << _shards_.size());
+      _shards_.clear();
+      if (_invalid_channel_fills_ > 0) {
+        std::clog << "Values of channels out of the dense channel map not histogrammed: "
+                  << _invalid_channel_fills_ << std::endl;
+      }
+      _store_root_file_(config.root_output_filename);
+      _sparse_2d_.clear();
       hservice.reset();
+      hpool = nullptr;
+      return;
+    }
+
+    histogramming & histogramming::add_shard()
+    {
+      DT_THROW_IF(_shard_, std::logic_error, "Cannot add a shard to a histogram shard!");
+      DT_THROW_IF(hpool == nullptr, std::logic_error, "Histogramming is not initialized!");
+      std::unique_ptr<histogramming> shard(new histogramming(config));
+      shard->logging = logging;
+      shard->_shard_ = true;
+      shard->initialize();
+      _shards_.push_back(std::move(shard));
+      return *_shards_.back();
+    }
+
+    std::size_t histogramming::get_number_of_shards() const
+    {
+      return _shards_.size();
+    }
+
+    std::unique_ptr<histogramming> histogramming::_make_snapshot_() const
+    {
+      std::unique_ptr<histogramming> snapshot(new histogramming(config));
+      snapshot->logging = logging;
+      snapshot->initialize();
+      snapshot->merge(*this);
+      for (const auto & shard : _shards_) {
+        snapshot->merge(*shard);
+      }
+      return snapshot;
+    }
+
+    void histogramming::flush()
+    {
+      DT_THROW_IF(_shard_, std::logic_error, "A histogram shard cannot be stored!");
+      if (!_shards_.empty()) {
+        _make_snapshot_()->flush();
+        return;
+      }
+      const std::string & path = config.root_output_filename;
+      std::string tmp_path = path + ".tmp.root";
+      if (path.size() > 5 and path.compare(path.size() - 5, 5, ".root") == 0) {
+        tmp_path = path.substr(0, path.size() - 5) + ".tmp.root";
+      }
+      _store_root_file_(tmp_path);
+      DT_THROW_IF(std::rename(tmp_path.c_str(), path.c_str()) != 0,
+                  std::runtime_error,
+                  "Cannot rename histogram file '" << tmp_path << "' to '" << path << "'!");
+      DT_LOG_DEBUG(logging, "Histograms flushed in '" << path << "'.");
+      return;
+    }
+
+    // static
+    const char * histogramming::quantity_label(const quantity_type quantity_)
+    {
+      switch (quantity_) {
+      case QUANTITY_CHARGE              : return "charge";
+      case QUANTITY_PEAK                : return "peak";
+      case QUANTITY_BASELINE            : return "baseline";
+      case QUANTITY_PEAK_CHARGE         : return "peak_charge";
+      case QUANTITY_BASELINE_FW_DIFF    : return "baseline_fw_diff";
+      case QUANTITY_PEAK_FW_DIFF        : return "peak_fw_diff";
+      case QUANTITY_CHARGE_FW_DIFF      : return "charge_fw_diff";
+      case QUANTITY_RISING_CELL_FW_DIFF : return "rising_cell_fw_diff";
+      default: break;
+      }
+      DT_THROW(std::logic_error, "Invalid histogrammed quantity " << (int) quantity_ << "!");
+    }
+
+    void histogramming::fill(const uint16_t      channel_index_,
+                             const int           run_id_,
+                             const quantity_type quantity_,
+                             const double        value_,
+                             const double        value2_)
+    {
+      if (channel_index_ >= NUMBER_OF_CHANNEL_INDEXES) {
+        // Channel out of the dense channel map:
+        _invalid_channel_fills_++;
+        return;
+      }
+      if (quantity_ == QUANTITY_PEAK_CHARGE) {
+        // 2D-histograms:
+        sparse_histogram_2d *& h2 = _handles_2d_[channel_index_];
+        if (h2 == nullptr) {
+          h2 = &_grab_2d_(channel_index_to_id(channel_index_).to_string(), run_id_, quantity_label(quantity_));
+        }
+        h2->fill(value_, value2_);
+      } else {
+        // 1D-histograms:
+        mygsl::histogram_1d *& h = _handles_1d_[channel_index_ * NUMBER_OF_QUANTITIES + quantity_];
+        if (h == nullptr) {
+          h = &_grab_1d_(channel_index_to_id(channel_index_).to_string(), run_id_, quantity_label(quantity_));
+        }
+        h->fill(value_);
+      }
       return;
     }
 
@@ -35,66 +177,284 @@ namespace snfee {
                              const std::string & label_,
                              const double        value_,
                              const double        value2_)
-          {
-      // Histogram name:
-      std::ostringstream h_name_s;
-      h_name_s << "h" << label_ << "_" << ch_id_str_;
-      std::string h_name = h_name_s.str();
+    {
+      if (label_ == "peak_charge") {
+        _grab_2d_(ch_id_str_, run_id_, label_).fill(value_, value2_);
+      } else {
+        _grab_1d_(ch_id_str_, run_id_, label_).fill((double) value_);
+      }
+      return;
+    }
 
-      // Histogram title:
-      std::ostringstream h_title_s;
-      h_title_s << "Calo hit " << label_;
-      if (run_id_ >= 0) {
-        h_title_s << " - Run ID: " << run_id_;
+    namespace {
+
+      std::string make_histogram_title(const std::string & ch_id_str_,
+                                       const int run_id_,
+                                       const std::string & label_)
+      {
+        std::ostringstream h_title_s;
+        h_title_s << "Calo hit " << label_;
+        if (run_id_ >= 0) {
+          h_title_s << " - Run ID: " << run_id_;
+        }
+        if (!ch_id_str_.empty()) {
+          h_title_s << " - Channel: " << ch_id_str_;
+        }
+        return h_title_s.str();
       }
-      if (!ch_id_str_.empty()) {
-        h_title_s << " - Channel: " << ch_id_str_;
+
+    } // namespace
+
+    sparse_histogram_2d & histogramming::_grab_2d_(const std::string & ch_id_str_,
+                                                   const int run_id_,
+                                                   const std::string & label_)
+    {
+      std::string h_name = "h" + label_ + "_" + ch_id_str_;
+      sparse_2d_entry & entry = _sparse_2d_[h_name];
+      if (!entry.histogram.is_initialized()) {
+        entry.title = make_histogram_title(ch_id_str_, run_id_, label_);
+        if (label_ == "peak_charge") {
+          entry.histogram.initialize(this->config.histo_peak_nbins,
+                                     this->config.histo_peak_min,
+                                     this->config.histo_peak_max,
+                                     this->config.histo_charge_nbins,
+                                     this->config.histo_charge_min,
+                                     this->config.histo_charge_max);
+        }
+        DT_THROW_IF(!entry.histogram.is_initialized(), std::logic_error,
+                    "No binning for 2D-histogram '" << h_name << "'!");
       }
+      return entry.histogram;
+    }
 
-      if (label_ == "peak_charge") {
-        // 2D-histograms:
-        if (!this->hpool->has_2d(h_name)) {
-          
-          mygsl::histogram_2d & h2 = this->hpool->add_2d(h_name, h_title_s.str(), this->tree_name);
-          if (label_ == "peak_charge") {
-            h2.initialize(this->config.histo_peak_nbins,
-                          this->config.histo_peak_min,
-                          this->config.histo_peak_max,
-                          this->config.histo_charge_nbins,
-                          this->config.histo_charge_min,
-                          this->config.histo_charge_max);
+    void histogramming::_store_root_file_(const std::string & path_) const
+    {
+      hservice.store_as_root_file(path_);
+      if (_sparse_2d_.empty()) return;
+      // Only one dense 2D-histogram at a time:
+      TFile root_file(path_.c_str(), "UPDATE");
+      DT_THROW_IF(root_file.IsZombie(), std::runtime_error, "Cannot open ROOT file '" << path_ << "'!");
+      for (const auto & name_entry : _sparse_2d_) {
+        std::unique_ptr<TH2D> h2 = name_entry.second.histogram.make_root_histogram(name_entry.first,
+                                                                                   name_entry.second.title);
+        DT_THROW_IF(root_file.WriteTObject(h2.get(), name_entry.first.c_str()) == 0,
+                    std::runtime_error,
+                    "Cannot write histogram '" << name_entry.first << "' in ROOT file '" << path_ << "'!");
+      }
+      root_file.Close();
+      return;
+    }
+
+    mygsl::histogram_1d & histogramming::_grab_1d_(const std::string & ch_id_str_,
+                                                   const int run_id_,
+                                                   const std::string & label_)
+    {
+      std::string h_name = "h" + label_ + "_" + ch_id_str_;
+      if (!this->hpool->has_1d(h_name)) {
+        mygsl::histogram_1d & h = this->hpool->add_1d(h_name,
+                                                      make_histogram_title(ch_id_str_, run_id_, label_),
+                                                      this->tree_name);
+        if (label_ == "charge") {
+          h.initialize(this->config.histo_charge_nbins,
+                       this->config.histo_charge_min,
+                       this->config.histo_charge_max);
+          // h.grab_auxiliaries().store("display.xaxis.unit", "nV.s");
+        }
+        if (label_ == "peak") {
+          h.initialize(this->config.histo_peak_nbins,
+                       this->config.histo_peak_min,
+                       this->config.histo_peak_max);
+        }
+        if (label_ == "baseline") {
+          h.initialize(this->config.histo_baseline_nbins,
+                       this->config.histo_baseline_min,
+                       this->config.histo_baseline_max);
+        }
+        if (label_.size() > 8 and label_.compare(label_.size() - 8, 8, "_fw_diff") == 0) {
+          // Emulated minus recorded firmware measurements (firmware LSB):
+          h.initialize(this->config.histo_fw_diff_nbins,
+                       this->config.histo_fw_diff_min,
+                       this->config.histo_fw_diff_max);
+        }
+      }
+      return hpool->grab_1d(h_name);
+    }
+
+    void histogramming::store_spectrum(const std::string & ch_id_str_,
+                                       const std::string & label_,
+                                       const double frequency_step_GHz_,
+                                       const std::vector<double> & values_)
+    {
+      std::string h_name = "h" + label_ + "_" + ch_id_str_;
+      DT_THROW_IF(this->hpool->has_1d(h_name), std::logic_error,
+                  "Spectrum histogram '" << h_name << "' is already stored!");
+      std::ostringstream h_title_s;
+      h_title_s << "Calo " << label_ << " - Channel: " << ch_id_str_;
+      mygsl::histogram_1d & h = this->hpool->add_1d(h_name, h_title_s.str(), this->tree_name);
+      // Bins centered on the frequencies (GHz):
+      h.initialize(values_.size(),
+                   -0.5 * frequency_step_GHz_,
+                   (values_.size() - 0.5) * frequency_step_GHz_);
+      for (std::size_t k = 0; k < values_.size(); k++) {
+        h.fill(k * frequency_step_GHz_, values_[k]);
+      }
+      return;
+    }
+
+    std::size_t histogramming::get_number_of_invalid_channel_fills() const
+    {
+      return _invalid_channel_fills_;
+    }
+
+    void histogramming::merge(const histogramming & other_)
+    {
+      DT_THROW_IF(this->hpool == nullptr, std::logic_error, "Histogramming is not initialized!");
+      DT_THROW_IF(other_.hpool == nullptr, std::logic_error, "Merged histogramming is not initialized!");
+      // Histogram names are sorted, so the merge order does not depend on the filling order:
+      std::vector<std::string> h_names;
+      other_.hpool->names(h_names);
+      for (const std::string & h_name : h_names) {
+        if (other_.hpool->has_2d(h_name)) {
+          // 2D-histograms:
+          const mygsl::histogram_2d & h2_other = other_.hpool->get_2d(h_name);
+          if (!this->hpool->has_2d(h_name)) {
+            mygsl::histogram_2d & h2 = this->hpool->add_2d(h_name, other_.hpool->get_title(h_name), this->tree_name);
+            h2 = h2_other;
+          } else {
+            this->hpool->grab_2d(h_name) += h2_other;
+          }
+        } else if (other_.hpool->has_1d(h_name)) {
+          // 1D-histograms:
+          const mygsl::histogram_1d & h_other = other_.hpool->get_1d(h_name);
+          if (!this->hpool->has_1d(h_name)) {
+            mygsl::histogram_1d & h = this->hpool->add_1d(h_name, other_.hpool->get_title(h_name), this->tree_name);
+            h = h_other;
+          } else {
+            this->hpool->grab_1d(h_name) += h_other;
           }
         }
-        mygsl::histogram_2d & h2 = hpool->grab_2d(h_name);
-        h2.fill((double) value_, (double) value2_);
-       
-      } else {
-        // 1D-histograms:
-      
-        if (!this->hpool->has_1d(h_name)) {
-          mygsl::histogram_1d & h = this->hpool->add_1d(h_name, h_title_s.str(), this->tree_name);
-          if (label_ == "charge") {
-            h.initialize(this->config.histo_charge_nbins,
-                         this->config.histo_charge_min,
-                         this->config.histo_charge_max);
-            // h.grab_auxiliaries().store("display.xaxis.unit", "nV.s");
+      }
+      // Sparse 2D-histograms (sorted by name too):
+      for (const auto & name_entry : other_._sparse_2d_) {
+        sparse_2d_entry & entry = _sparse_2d_[name_entry.first];
+        if (!entry.histogram.is_initialized()) {
+          entry = name_entry.second;
+        } else {
+          entry.histogram.add(name_entry.second.histogram);
+        }
+      }
+      _invalid_channel_fills_ += other_._invalid_channel_fills_;
+      return;
+    }
+
+    void histogramming::store_checkpoint(const std::string & path_,
+                                         const std::map<std::string, uint64_t> & counters_) const
+    {
+      DT_THROW_IF(_shard_, std::logic_error, "A histogram shard cannot be stored!");
+      if (!_shards_.empty()) {
+        _make_snapshot_()->store_checkpoint(path_, counters_);
+        return;
+      }
+      const std::string tmp_path = path_ + ".tmp";
+      {
+        std::ofstream fout(tmp_path);
+        DT_THROW_IF(!fout, std::runtime_error, "Cannot open checkpoint file '" << tmp_path << "'!");
+        fout << "#@snfee.rtd_calo_checkpoint" << '\n';
+        fout << std::setprecision(17);
+        for (const auto & counter : counters_) {
+          fout << "counter " << counter.first << ' ' << counter.second << '\n';
+        }
+        std::vector<std::string> h_names;
+        hpool->names(h_names);
+        for (const std::string & h_name : h_names) {
+          if (!hpool->has_1d(h_name)) continue;
+          // Contents of the non empty bins:
+          const mygsl::histogram_1d & h = hpool->get_1d(h_name);
+          std::size_t nfilled = 0;
+          for (std::size_t i = 0; i < h.bins(); i++) {
+            if (h.get(i) != 0.0) nfilled++;
           }
-          if (label_ == "peak") {
-            h.initialize(this->config.histo_peak_nbins,
-                         this->config.histo_peak_min,
-                         this->config.histo_peak_max);
+          fout << "histogram_1d " << h_name << '\n' << hpool->get_title(h_name) << '\n';
+          fout << h.bins() << ' ' << h.min() << ' ' << h.max() << ' '
+               << h.underflow() << ' ' << h.overflow() << ' ' << nfilled << '\n';
+          for (std::size_t i = 0; i < h.bins(); i++) {
+            if (h.get(i) != 0.0) {
+              fout << i << ' ' << h.get(i) << '\n';
+            }
           }
-          if (label_ == "baseline") {
-            h.initialize(this->config.histo_baseline_nbins,
-                         this->config.histo_baseline_min,
-                         this->config.histo_baseline_max);
+        }
+        for (const auto & name_entry : _sparse_2d_) {
+          fout << "sparse_histogram_2d " << name_entry.first << '\n' << name_entry.second.title << '\n';
+          name_entry.second.histogram.store(fout);
+        }
+        fout << "end" << '\n';
+        fout.close();
+        DT_THROW_IF(!fout, std::runtime_error, "Cannot write checkpoint file '" << tmp_path << "'!");
+      }
+      DT_THROW_IF(std::rename(tmp_path.c_str(), path_.c_str()) != 0,
+                  std::runtime_error,
+                  "Cannot rename checkpoint file '" << tmp_path << "' to '" << path_ << "'!");
+      DT_LOG_DEBUG(logging, "Checkpoint stored in '" << path_ << "'.");
+      return;
+    }
+
+    void histogramming::load_checkpoint(const std::string & path_,
+                                        std::map<std::string, uint64_t> & counters_)
+    {
+      DT_THROW_IF(this->hpool == nullptr, std::logic_error, "Histogramming is not initialized!");
+      std::vector<std::string> h_names;
+      hpool->names(h_names);
+      DT_THROW_IF(!h_names.empty() or !_sparse_2d_.empty(), std::logic_error,
+                  "Cannot load a checkpoint in filled histograms!");
+      std::ifstream fin(path_);
+      DT_THROW_IF(!fin, std::runtime_error, "Cannot open checkpoint file '" << path_ << "'!");
+      std::string line;
+      std::getline(fin, line);
+      DT_THROW_IF(line != "#@snfee.rtd_calo_checkpoint", std::runtime_error,
+                  "File '" << path_ << "' is not a calo analysis checkpoint!");
+      counters_.clear();
+      std::string kind;
+      while (fin >> kind and kind != "end") {
+        std::string name;
+        fin >> name;
+        if (kind == "counter") {
+          fin >> counters_[name];
+          continue;
+        }
+        std::string title;
+        fin >> std::ws;
+        std::getline(fin, title);
+        if (kind == "histogram_1d") {
+          std::size_t nbins = 0;
+          double min, max, underflow, overflow;
+          std::size_t nfilled = 0;
+          fin >> nbins >> min >> max >> underflow >> overflow >> nfilled;
+          DT_THROW_IF(!fin, std::runtime_error, "Cannot read histogram '" << name << "' from '" << path_ << "'!");
+          mygsl::histogram_1d & h = hpool->add_1d(name, title, this->tree_name);
+          h.initialize(nbins, min, max);
+          // Refill the bins at their centers with their contents as weights:
+          const double width = (max - min) / nbins;
+          for (std::size_t ifilled = 0; ifilled < nfilled and fin; ifilled++) {
+            std::size_t i = 0;
+            double content = 0.0;
+            fin >> i >> content;
+            h.fill(min + (i + 0.5) * width, content);
           }
+          if (underflow != 0.0) h.fill(min - width, underflow);
+          if (overflow != 0.0) h.fill(max, overflow);
+        } else if (kind == "sparse_histogram_2d") {
+          sparse_2d_entry & entry = _sparse_2d_[name];
+          entry.title = title;
+          entry.histogram.load(fin);
+        } else {
+          DT_THROW(std::runtime_error, "Invalid entry '" << kind << "' in checkpoint file '" << path_ << "'!");
         }
-        mygsl::histogram_1d & h = hpool->grab_1d(h_name);
-        h.fill((double) value_);
+        DT_THROW_IF(!fin, std::runtime_error, "Cannot read histogram '" << name << "' from '" << path_ << "'!");
       }
+      DT_THROW_IF(kind != "end", std::runtime_error, "Truncated checkpoint file '" << path_ << "'!");
+      DT_LOG_DEBUG(logging, "Checkpoint loaded from '" << path_ << "'.");
       return;
     }
-  
+
   } // namespace calo
 } // namespace snfee
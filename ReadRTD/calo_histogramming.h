@@ -5,6 +5,8 @@
 #include <cstdint>
 #include <vector>
 #include <limits>
+#include <map>
+#include <memory>
 
 // Third party:
 // - Bayeux:
@@ -18,13 +20,50 @@
 #include <snfee/data/calo_hit_record.h>
 #include <snfee/algo/calo_waveform_tools.h>
 
+// This example:
+#include "calo_sparse_histogram.h"
+
 namespace snfee {
   namespace calo {
 
     /// \brief Calo waveform histogramming
+    ///
+    /// The histograms of a channel are created on first fill. The fills
+    /// keyed by dense channel index and quantity use cached histogram
+    /// handles, so that names are only formatted and looked up once.
+    ///
+    /// A histogramming object is not thread safe. In sharded mode, each
+    /// worker thread fills its own shard (a private histogram pool) and
+    /// the shards are merged in their creation order at termination,
+    /// before the output file is stored. The bin contents are sums of
+    /// unit weights, so the result does not depend on the distribution
+    /// of the data among the shards. Flushes and checkpoints store a
+    /// merged snapshot of the shards, which must not be filled meanwhile.
+    ///
+    /// The peak versus charge 2D-histograms are filled as sparse integer
+    /// histograms (see calo_sparse_histogram.h). They are not part of the
+    /// pool: when the output file is stored, they are appended to it one
+    /// at a time, each dense histogram being released once written.
     struct histogramming
     {
 
+      /// \brief Histogrammed quantities
+      enum quantity_type
+      {
+        QUANTITY_CHARGE              = 0, ///< Charge (nV.s)
+        QUANTITY_PEAK                = 1, ///< Peak amplitude (mV)
+        QUANTITY_BASELINE            = 2, ///< Baseline (mV)
+        QUANTITY_PEAK_CHARGE         = 3, ///< Peak amplitude versus charge (2D)
+        QUANTITY_BASELINE_FW_DIFF    = 4, ///< Emulated minus recorded firmware baseline
+        QUANTITY_PEAK_FW_DIFF        = 5, ///< Emulated minus recorded firmware peak
+        QUANTITY_CHARGE_FW_DIFF      = 6, ///< Emulated minus recorded firmware charge
+        QUANTITY_RISING_CELL_FW_DIFF = 7, ///< Emulated minus recorded firmware rising cell
+        NUMBER_OF_QUANTITIES         = 8
+      };
+
+      /// Return the label of a quantity (histogram names are 'h<label>_<channel>')
+      static const char * quantity_label(const quantity_type quantity_);
+
       /// \brief Configuration parameters
       struct config_type
       {
@@ -39,6 +78,7 @@ namespace snfee {
         bool     histo_charge         = true;
         bool     histo_peak_charge    = true;
         bool     histo_baseline       = true;
+        bool     histo_firmware_check = false; ///< Emulated minus recorded firmware measurements
 
         // Histograms setup:
         uint16_t histo_charge_nbins   =  500;
@@ -53,6 +93,10 @@ namespace snfee {
         double   histo_baseline_min   = -10.0;   // mV
         double   histo_baseline_max   = +10.0;   // mV
 
+        uint16_t histo_fw_diff_nbins  =  201;
+        double   histo_fw_diff_min    = -100.5;  // firmware LSB
+        double   histo_fw_diff_max    = +100.5;  // firmware LSB
+
       };
 
       /// Constructor
@@ -61,15 +105,62 @@ namespace snfee {
       /// Initialize
       void initialize();
 
-      /// Terminate
+      /// Terminate (the shards are merged first)
       void terminate();
 
+      /// Add a shard filled by one worker thread (not thread safe, add all shards first)
+      histogramming & add_shard();
+
+      /// Return the number of shards
+      std::size_t get_number_of_shards() const;
+
+      /// Store the current histograms in the output file, histograms are kept
+      ///
+      /// The file is written under a temporary name then renamed, so that
+      /// the output file is always complete. With shards, a merged snapshot
+      /// is stored (the shards must not be filled meanwhile).
+      void flush();
+
+      /// Fill a value for a given dense channel index (see calo_channel_index.h)
+      ///
+      /// Values of channels without a valid dense index are counted and skipped.
+      void fill(const uint16_t      channel_index_,
+                const int           run_id_,
+                const quantity_type quantity_,
+                const double        value_,
+                const double        value2_ = std::numeric_limits<double>::quiet_NaN());
+
       /// Fill a value for a given channel ID
       void fill(const std::string & ch_id_str_,
                 const int           run_id_,
                 const std::string & label_,
                 const double        value_,
                 const double        value2_ = std::numeric_limits<double>::quiet_NaN());
+
+      /// Store a spectrum for a given channel ID, one bin per frequency (from 0)
+      void store_spectrum(const std::string & ch_id_str_,
+                          const std::string & label_,
+                          const double frequency_step_GHz_,
+                          const std::vector<double> & values_);
+
+      /// Return the number of values skipped because of an invalid channel index
+      std::size_t get_number_of_invalid_channel_fills() const;
+
+      /// Add the histograms of another histogramming object (same configuration)
+      void merge(const histogramming & other_);
+
+      /// Store the histograms and processing counters in a checkpoint file
+      ///
+      /// The file is written under a temporary name then renamed, so that
+      /// the checkpoint file is always complete. The bin contents are
+      /// stored exactly; the spectra are not stored. With shards, a merged
+      /// snapshot is stored (the shards must not be filled meanwhile).
+      void store_checkpoint(const std::string & path_,
+                            const std::map<std::string, uint64_t> & counters_) const;
+
+      /// Load the histograms and processing counters of a checkpoint file (no histograms yet)
+      void load_checkpoint(const std::string & path_,
+                           std::map<std::string, uint64_t> & counters_);
       
       datatools::logger::priority logging = datatools::logger::PRIO_FATAL; ///< Logging priority threshold:
       config_type             config;          ///< Configuration
@@ -77,6 +168,41 @@ namespace snfee {
       dpp::histogram_service  hservice;        ///< Histogram service
       mygsl::histogram_pool * hpool = nullptr; ///< Histogram pool handle
       std::string             tree_name;       ///< Root tree name
+
+    private:
+
+      /// Return a copy of the histograms merged with the contents of the shards
+      std::unique_ptr<histogramming> _make_snapshot_() const;
+
+      /// Return the 1D-histogram of a channel, created if needed
+      mygsl::histogram_1d & _grab_1d_(const std::string & ch_id_str_,
+                                      const int           run_id_,
+                                      const std::string & label_);
+
+      /// Return the sparse 2D-histogram of a channel, created if needed
+      sparse_histogram_2d & _grab_2d_(const std::string & ch_id_str_,
+                                      const int           run_id_,
+                                      const std::string & label_);
+
+      std::vector<mygsl::histogram_1d *> _handles_1d_; ///< 1D-histograms per channel index and quantity
+      /// Store the histograms of the pool, then the sparse 2D-histograms one at a time, in a ROOT file
+      void _store_root_file_(const std::string & path_) const;
+
+      /// \brief Sparse 2D-histogram with its title
+      struct sparse_2d_entry
+      {
+        std::string         title;
+        sparse_histogram_2d histogram;
+      };
+
+      std::vector<sparse_histogram_2d *> _handles_2d_; ///< 2D-histograms per channel index
+      std::map<std::string, sparse_2d_entry> _sparse_2d_; ///< Sparse 2D-histograms by name
+      std::size_t _invalid_channel_fills_ = 0; ///< Values skipped because of an invalid channel index
+
+      // Sharded mode:
+      bool _shard_ = false; ///< Shard of another histogramming object (no output file)
+      std::unique_ptr<mygsl::histogram_pool> _shard_pool_; ///< Histogram pool of a shard
+      std::vector<std::unique_ptr<histogramming>> _shards_; ///< Shards in creation order
       
     };
     
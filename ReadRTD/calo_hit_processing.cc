@@ -0,0 +1,503 @@
+// Ourselves:
+#include "calo_hit_processing.h"
+
+// Standard library:
+#include <cmath>
+
+// This project:
+#include <snfee/data/calo_hit_record.h>
+#include <snfee/data/channel_id.h>
+#include <snfee/data/calo_waveform_data.h>
+#include <snfee/model/feb_constants.h>
+
+// This example:
+#include "calo_channel_index.h"
+#include "calo_waveform_view.h"
+#include "calo_waveform_codec.h"
+
+namespace snfee {
+  namespace calo {
+
+    hit_processing::hit_processing(const config_type & cfg_,
+                                   const datatools::logger::priority logging_)
+      : _config_(cfg_)
+      , _selection_(cfg_.selection)
+    {
+      logging = logging_;
+      _conversion_.tdc_to_ns = snfee::model::feb_constants::SAMLONG_DEFAULT_TDC_LSB_NS;
+      _conversion_.adc_zero  = snfee::model::feb_constants::SAMLONG_ADC_ZERO;
+      _conversion_.adc_to_mV = snfee::model::feb_constants::SAMLONG_ADC_VOLTAGE_LSB_MV;
+      _simd_level_ = detect_simd_level();
+      return;
+    }
+
+    void hit_processing::plan_type::print(std::ostream & out_, const std::string & indent_) const
+    {
+      auto stage = [&out_, &indent_](const std::string & label_, const bool run_)
+      {
+        out_ << indent_ << "  " << label_ << " : " << (run_ ? "yes" : "no") << std::endl;
+      };
+      out_ << indent_ << "Processing plan :" << std::endl;
+      stage("Waveform extraction  ", waveforms);
+      stage("Waveform measurements", measurements);
+      stage("Waveform FFT         ", fft);
+      stage("Firmware emulation   ", fw_emulation);
+      stage("Mean waveforms       ", mean_waveforms);
+      stage("Waveform display     ", display);
+      stage("Waveform export      ", waveform_export);
+      stage("Noise spectra        ", noise_spectra);
+      stage("Histograms           ", histograms);
+      return;
+    }
+
+    void hit_processing::prepare()
+    {
+      _plan_.measurements   = (analysis != nullptr);
+      // The spectrum is only consumed by the display:
+      _plan_.fft            = (fft != nullptr) and (display != nullptr);
+      _plan_.fw_emulation   = (fw_emulation != nullptr);
+      _plan_.mean_waveforms = (mean_waveform != nullptr);
+      _plan_.display        = (display != nullptr);
+      _plan_.waveform_export = (exporter != nullptr);
+      _plan_.noise_spectra  = (noise != nullptr);
+      _plan_.histograms     = (histos != nullptr);
+      // Firmware metadata histograms do not need the samples:
+      _plan_.waveforms      = _plan_.measurements or _plan_.fft or _plan_.fw_emulation
+        or _plan_.mean_waveforms or _plan_.display or _plan_.waveform_export or _plan_.noise_spectra;
+      if (fft and !_plan_.fft) {
+        DT_LOG_WARNING(logging, "Waveform FFT requested without waveform display: no spectrum is computed!");
+      }
+      if (datatools::logger::is_debug(logging)) {
+        _plan_.print(std::clog, "[debug] ");
+      }
+      return;
+    }
+
+    const hit_processing::plan_type & hit_processing::get_plan() const
+    {
+      return _plan_;
+    }
+
+    std::size_t hit_processing::process(const snfee::data::raw_trigger_data & rtd_)
+    {
+      std::size_t selection_counter = 0;
+
+      // General informations:
+      int32_t run_id = rtd_.get_run_id();
+      int32_t trigger_id = rtd_.get_trigger_id();
+
+      // Loop on calo hit records in the RTD data object:
+      for (const auto & p_calo_hit : rtd_.get_calo_hits()) {
+
+        // Dereference the stored shared pointer oin the calo hit record:
+        const snfee::data::calo_hit_record & calo_hit = *p_calo_hit;
+
+        if (datatools::logger::is_debug(logging)) {
+          boost::property_tree::ptree options;
+          options.put("title", "Loaded calorimeter raw hit data record: ");
+          options.put("with_waveform_samples", true);
+          calo_hit.print_tree(std::clog, options);
+        }
+
+        if (timing) {
+          timing->number_of_hits++;
+        }
+
+        // Selected SAMLONG channels, from the hit header and channel flags only:
+        uint32_t selected_channels = _selection_.select_hit(calo_hit);
+        if (selected_channels == 0) continue;
+
+        // Waveform recording (samples only extracted if some stage needs them):
+        bool has_waveforms = _plan_.waveforms and calo_hit.has_waveforms(); // Default: true
+        if (has_waveforms) {
+          stage_timing::scope timed(timing, stage_timing::STAGE_EXTRACT);
+          // Extract ADC samples of the selected SAMLONG channels from the interleaved SAMLONG data:
+          if (selected_channels == 0x3) {
+            deinterleave_waveforms(calo_hit, _ch_waveforms_[0], _ch_waveforms_[1]);
+          } else {
+            int ichannel = (selected_channels == 0x1) ? 0 : 1;
+            make_waveform_view(calo_hit, ichannel).copy_to(_ch_waveforms_[ichannel]);
+          }
+        }
+
+        // Extract SAMLONG channels' data:
+        for (int ichannel = 0; ichannel < snfee::model::feb_constants::SAMLONG_NUMBER_OF_CHANNELS; ichannel++) {
+
+          // Process selected channels:
+          if ((selected_channels & (0x1 << ichannel)) == 0) continue;
+
+          const snfee::data::calo_hit_record::channel_data_record & ch_data = calo_hit.get_channel_data(ichannel);
+          channel_input_type input;
+          input.run_id      = run_id;
+          input.trigger_id  = trigger_id;
+          input.ch_id       = hit_selection::make_channel_id(calo_hit, ichannel);
+          input.channel_index = make_channel_index(input.ch_id.get_crate(), input.ch_id.get_board(), input.ch_id.get_channel());
+          input.fw_baseline = ch_data.get_baseline(); // Computed baseline       (LSB: ADC unit/16)
+          input.fw_peak     = ch_data.get_peak();     // Computed peak amplitude (LSB: ADC unit/8)
+          input.fw_charge   = ch_data.get_charge();   // Computed charge
+          input.fw_peak_cell   = ch_data.get_peak_cell();
+          input.fw_rising_cell = ch_data.get_rising_cell();
+          input.ch_data     = &ch_data;
+
+          if (has_waveforms) {
+            input.waveform = &_ch_waveforms_[ichannel];
+          }
+
+          process_channel(input);
+          selection_counter++;
+
+        } // end of channel loop in the current RTD record
+
+      } // end of loop on calo hit records in the RTD data object
+
+      return selection_counter;
+    }
+
+    std::size_t hit_processing::process(const columnar_store::block_view & block_)
+    {
+      std::size_t selection_counter = 0;
+      if (timing) {
+        // Two rows per calo hit:
+        timing->number_of_hits += block_.number_of_rows / 2;
+      }
+      for (uint32_t irow = 0; irow < block_.number_of_rows; irow++) {
+        uint16_t ch_index = block_.channel_index[irow];
+        if (ch_index == INVALID_CHANNEL_INDEX) continue;
+        uint8_t flags = block_.flags[irow];
+        channel_input_type input;
+        input.ch_id = channel_index_to_id(ch_index);
+        input.channel_index = ch_index;
+        if (!_selection_.select(input.ch_id,
+                                flags & columnar_store::FLAG_LT,
+                                flags & columnar_store::FLAG_HT)) continue;
+        input.run_id      = block_.run_id[irow];
+        input.trigger_id  = block_.trigger_id[irow];
+        input.fw_baseline = block_.baseline[irow];
+        input.fw_peak     = block_.peak[irow];
+        input.fw_charge   = block_.charge[irow];
+        input.fw_peak_cell   = block_.peak_cell[irow];
+        input.fw_rising_cell = block_.rising_cell[irow];
+        uint16_t nsamples = block_.waveform_size[irow];
+        if (nsamples > 0 and _plan_.waveforms) {
+          stage_timing::scope timed(timing, stage_timing::STAGE_EXTRACT);
+          const int16_t * samples = block_.samples + block_.waveform_offset[irow];
+          _ch_waveforms_[0].assign(samples, samples + nsamples);
+          input.waveform = &_ch_waveforms_[0];
+        }
+        process_channel(input);
+        selection_counter++;
+      }
+      return selection_counter;
+    }
+
+    void hit_processing::process_channel(const channel_input_type & input_)
+    {
+      if (timing) {
+        timing->number_of_channels++;
+      }
+      channel_input_type input = input_;
+      if (input.channel_index == INVALID_CHANNEL_INDEX) {
+        input.channel_index = make_channel_index(input.ch_id.get_crate(), input.ch_id.get_board(), input.ch_id.get_channel());
+      }
+      if (fw_emulation and input.waveform and _check_firmware_(input)) {
+        input.flagged = true;
+      }
+      if (noise and input.waveform) {
+        stage_timing::scope timed(timing, stage_timing::STAGE_FFT);
+        noise->accumulate(input.channel_index,
+                          input.waveform->data(),
+                          input.waveform->size(),
+                          _conversion_);
+      }
+      if (!input.waveform or !analysis or !engine) {
+        _process_measured_channel_(input, nullptr);
+        return;
+      }
+
+      if (_config_.waveform_batch_size > 0) {
+        // Gather the waveform, the whole batch is measured at once:
+        if (!_batch_) {
+          _batch_.reset(new waveform_batch(_config_.waveform_batch_size));
+        }
+        {
+          stage_timing::scope timed(timing, stage_timing::STAGE_EXTRACT);
+          _batch_->add(input.run_id,
+                       input.trigger_id,
+                       input.ch_id,
+                       input.fw_baseline,
+                       input.fw_peak,
+                       input.fw_charge,
+                       input.fw_peak_cell,
+                       input.fw_rising_cell,
+                       input.flagged,
+                       input.ch_data,
+                       *input.waveform);
+        }
+        if (_batch_->is_full()) {
+          flush();
+        }
+        return;
+      }
+
+      // Waveform measurements from the SIMD engine:
+      const std::vector<uint16_t> & ch_waveform = *input.waveform;
+      measurement_engine::result_type engine_result;
+      {
+        stage_timing::scope timed(timing, stage_timing::STAGE_INIT);
+        _amplitudes_mV_.resize(ch_waveform.size());
+        convert_channel_waveform(reinterpret_cast<const int16_t *>(ch_waveform.data()),
+                                 ch_waveform.size(),
+                                 _conversion_,
+                                 _amplitudes_mV_.data(),
+                                 _simd_level_);
+      }
+      {
+        stage_timing::scope timed(timing, stage_timing::STAGE_MEASURE);
+        engine->measure(_amplitudes_mV_.data(), _amplitudes_mV_.size(), _conversion_.tdc_to_ns, engine_result);
+      }
+      _process_measured_channel_(input, &engine_result);
+      return;
+    }
+
+    void hit_processing::flush()
+    {
+      if (noise) {
+        stage_timing::scope timed(timing, stage_timing::STAGE_FFT);
+        noise->flush();
+      }
+      if (!_batch_ or _batch_->size() == 0) return;
+      _batch_->measure(*engine, _conversion_, _simd_level_, timing);
+
+      // Scatter the measurements back to the rest of the processing:
+      for (std::size_t row = 0; row < _batch_->size(); row++) {
+        channel_input_type input;
+        input.run_id      = _batch_->run_id[row];
+        input.trigger_id  = _batch_->trigger_id[row];
+        input.ch_id       = _batch_->ch_id[row];
+        input.channel_index = make_channel_index(input.ch_id.get_crate(), input.ch_id.get_board(), input.ch_id.get_channel());
+        input.fw_baseline = _batch_->fw_baseline[row];
+        input.fw_peak     = _batch_->fw_peak[row];
+        input.fw_charge   = _batch_->fw_charge[row];
+        input.fw_peak_cell   = _batch_->fw_peak_cell[row];
+        input.fw_rising_cell = _batch_->fw_rising_cell[row];
+        input.flagged     = _batch_->flagged[row];
+        input.ch_data     = _batch_->get_ch_data(row);
+        _batch_->copy_samples(row, _batch_waveform_);
+        input.waveform    = &_batch_waveform_;
+        _process_measured_channel_(input, &_batch_->results[row]);
+      }
+      _batch_->clear();
+      return;
+    }
+
+    bool hit_processing::_check_firmware_(const channel_input_type & input_)
+    {
+      firmware_emulation::result_type emulated;
+      {
+        stage_timing::scope timed(timing, stage_timing::STAGE_MEASURE);
+        fw_emulation->emulate(input_.waveform->data(), input_.waveform->size(), emulated);
+      }
+      firmware_emulation::result_type recorded;
+      recorded.baseline    = input_.fw_baseline;
+      recorded.peak        = input_.fw_peak;
+      recorded.peak_cell   = input_.fw_peak_cell;
+      recorded.charge      = input_.fw_charge;
+      recorded.rising_cell = input_.fw_rising_cell;
+      if (fw_comparison) {
+        fw_comparison->compare(recorded, emulated);
+      }
+      if (histos and histos->config.histo_firmware_check) {
+        stage_timing::scope timed(timing, stage_timing::STAGE_FILL);
+        const uint16_t ch_index = input_.channel_index;
+        histos->fill(ch_index, input_.run_id, histogramming::QUANTITY_BASELINE_FW_DIFF, emulated.baseline - recorded.baseline);
+        histos->fill(ch_index, input_.run_id, histogramming::QUANTITY_PEAK_FW_DIFF, emulated.peak - recorded.peak);
+        histos->fill(ch_index, input_.run_id, histogramming::QUANTITY_CHARGE_FW_DIFF, emulated.charge - recorded.charge);
+        histos->fill(ch_index, input_.run_id, histogramming::QUANTITY_RISING_CELL_FW_DIFF, emulated.rising_cell - recorded.rising_cell);
+      }
+      return emulated.baseline != recorded.baseline
+        or emulated.peak != recorded.peak
+        or emulated.peak_cell != recorded.peak_cell
+        or emulated.charge != recorded.charge
+        or emulated.rising_cell != recorded.rising_cell;
+    }
+
+    void hit_processing::_export_waveform_(const channel_input_type & input_,
+                                           const float baseline_mV_,
+                                           const float peak_mV_,
+                                           const float charge_nVs_)
+    {
+      double adc_to_mV = snfee::model::feb_constants::SAMLONG_ADC_VOLTAGE_LSB_MV;
+      double peak_mV = std::isnan(peak_mV_) ? input_.fw_peak * adc_to_mV / 8 : peak_mV_;
+      // Pulses are negative (baseline subtracted), the limit applies to their magnitude:
+      if (std::abs(peak_mV) > _config_.export_max_peak_mV) return;
+      const std::vector<uint16_t> & ch_waveform = *input_.waveform;
+      waveform_export::entry_type entry;
+      entry.run_id            = input_.run_id;
+      entry.trigger_id        = input_.trigger_id;
+      entry.channel_index     = input_.channel_index;
+      entry.number_of_samples = ch_waveform.size();
+      entry.fw_baseline       = input_.fw_baseline;
+      entry.fw_peak           = input_.fw_peak;
+      entry.fw_charge         = input_.fw_charge;
+      entry.baseline_mV       = baseline_mV_;
+      entry.peak_mV           = peak_mV_;
+      entry.charge_nVs        = charge_nVs_;
+      waveform_codec::encode(ch_waveform.data(), ch_waveform.size(), _encoded_);
+      std::unique_lock<std::mutex> lock;
+      if (exporter_mutex) {
+        lock = std::unique_lock<std::mutex>(*exporter_mutex);
+      }
+      exporter->write(entry, _encoded_);
+      return;
+    }
+
+    void hit_processing::_process_measured_channel_(const channel_input_type & input_,
+                                                    const measurement_engine::result_type * engine_result_)
+    {
+      const snfee::data::channel_id & ch_id = input_.ch_id;
+
+      // Constants:
+      double tdc_to_ns = snfee::model::feb_constants::SAMLONG_DEFAULT_TDC_LSB_NS;
+      double adc_to_mV = snfee::model::feb_constants::SAMLONG_ADC_VOLTAGE_LSB_MV;
+      int16_t adc_zero = snfee::model::feb_constants::SAMLONG_ADC_ZERO;
+
+      // Firmware metadata:
+      double charge_nVs  = input_.fw_charge * 1e-3 * adc_to_mV * tdc_to_ns;
+      double peak_mV     = input_.fw_peak * adc_to_mV / 8;
+      double baseline_mV = input_.fw_baseline * adc_to_mV / 16;
+      // The SIMD engine does not measure the peak and charge without a validated peak:
+      bool has_pulse = true;
+
+      // Waveform processing:
+      if (input_.waveform) {
+        const std::vector<uint16_t> & ch_waveform = *input_.waveform;
+
+        // Working waveform data structure (for dedicated measurements):
+        snfee::data::calo_waveform_info waveform_info;
+
+        // Waveform analysis and measurements (also needed by the mean waveforms and the engine comparison):
+        bool measured = false;
+        if (analysis and (!engine_result_ or mean_waveform or comparison)) {
+          measured = true;
+          DT_LOG_DEBUG(logging, "Do calo waveform analysis...");
+          // Processing waveforms:
+          {
+            stage_timing::scope timed(timing, stage_timing::STAGE_INIT);
+            if (input_.ch_data) {
+              analysis->init_from_raw_data(ch_id, *input_.ch_data, ch_waveform, waveform_info);
+            } else {
+              snfee::algo::calo_waveform_analysis::populate_waveform(ch_waveform,
+                                                                     waveform_info.waveform,
+                                                                     tdc_to_ns,
+                                                                     adc_zero,
+                                                                     adc_to_mV);
+            }
+          }
+          {
+            stage_timing::scope timed(timing, stage_timing::STAGE_MEASURE);
+            analysis->do_measurements(ch_id, waveform_info);
+          }
+          if (datatools::logger::is_debug(logging)) {
+            waveform_info.print(std::cerr, "Waveform info : ", "[debug] ");
+          }
+          if (engine_result_ and comparison) {
+            comparison->compare(*engine_result_, waveform_info);
+          }
+        }
+
+        if ((_plan_.fft or display) and waveform_info.waveform.size() == 0) {
+          // Waveform shape for the FFT and display:
+          snfee::algo::calo_waveform_analysis::populate_waveform(ch_waveform,
+                                                                 waveform_info.waveform,
+                                                                 tdc_to_ns,
+                                                                 adc_zero,
+                                                                 adc_to_mV);
+        }
+
+        double frequency_step = 0.0;
+        if (_plan_.fft) {
+          DT_LOG_DEBUG(logging, "Do calo waveform FFT...");
+          stage_timing::scope timed(timing, stage_timing::STAGE_FFT);
+          fft->transform(waveform_info.waveform, _ft_, frequency_step);
+        }
+
+        // Mean waveform processing:
+        if (mean_waveform) {
+          {
+            stage_timing::scope timed(timing, stage_timing::STAGE_MEAN_WAVEFORM);
+            std::unique_lock<std::mutex> lock;
+            if (mean_waveform_mutex) {
+              lock = std::unique_lock<std::mutex>(*mean_waveform_mutex);
+            }
+            mean_waveform->process_waveform(ch_id, waveform_info);
+          }
+          if (histos and histos->config.histo_from_firmware) {
+            // Using measurements from waveform analysis:
+            if (engine_result_) {
+              baseline_mV = engine_result_->baseline_mV;
+              peak_mV     = engine_result_->peak_amplitude_mV;
+              charge_nVs  = engine_result_->charge_nVs;
+              has_pulse   = engine_result_->has_peak;
+            } else {
+              baseline_mV = waveform_info.baseline.baseline_mV;
+              peak_mV     = waveform_info.peak.amplitude_mV;
+              charge_nVs  = waveform_info.charge.charge_nVs;
+            }
+          }
+        }
+
+        // Visualization of waveforms (queued, the display policy is applied by the display):
+        if (display) {
+          display->submit("Calo channel [" + ch_id.to_string() + "]",
+                          waveform_info.waveform,
+                          _plan_.fft ? &_ft_ : nullptr,
+                          frequency_step,
+                          input_.flagged);
+        }
+
+        // Export of the waveform with its measurements:
+        if (exporter) {
+          if (engine_result_) {
+            _export_waveform_(input_,
+                              engine_result_->baseline_mV,
+                              engine_result_->has_peak ? engine_result_->peak_amplitude_mV : NAN,
+                              engine_result_->charge_nVs);
+          } else if (measured) {
+            _export_waveform_(input_,
+                              waveform_info.baseline.baseline_mV,
+                              waveform_info.peak.amplitude_mV,
+                              waveform_info.charge.charge_nVs);
+          } else {
+            _export_waveform_(input_, NAN, NAN, NAN);
+          }
+        }
+
+      } // has_waveforms
+
+      // Histogramming:
+      if (histos) {
+        stage_timing::scope timed(timing, stage_timing::STAGE_FILL);
+
+        if (histos->config.histo_charge and has_pulse) {
+          histos->fill(input_.channel_index, input_.run_id, histogramming::QUANTITY_CHARGE, charge_nVs);
+        }
+
+        if (histos->config.histo_peak and has_pulse) {
+          histos->fill(input_.channel_index, input_.run_id, histogramming::QUANTITY_PEAK, peak_mV);
+        }
+
+        if (histos->config.histo_baseline) {
+          histos->fill(input_.channel_index, input_.run_id, histogramming::QUANTITY_BASELINE, baseline_mV);
+        }
+
+        if (histos->config.histo_peak_charge and has_pulse) {
+          histos->fill(input_.channel_index, input_.run_id, histogramming::QUANTITY_PEAK_CHARGE, peak_mV, charge_nVs);
+        }
+
+      }
+
+      return;
+    }
+
+  } // namespace calo
+} // namespace snfee
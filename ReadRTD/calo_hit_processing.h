@@ -0,0 +1,192 @@
+#ifndef CALO_HIT_PROCESSING_H
+#define CALO_HIT_PROCESSING_H
+
+// Standard library:
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+
+// Third party:
+// - Bayeux:
+#include <bayeux/datatools/logger.h>
+
+// This project:
+#include <snfee/data/raw_trigger_data.h>
+#include <snfee/algo/calo_waveform_analysis.h>
+#include <snfee/algo/calo_mean_waveform.h>
+
+// This example:
+#include "calo_channel_index.h"
+#include "calo_hit_selection.h"
+#include "calo_columnar_store.h"
+#include "calo_stage_timing.h"
+#include "calo_measurement_engine.h"
+#include "calo_waveform_batch.h"
+#include "calo_firmware_emulation.h"
+#include "calo_waveform_export.h"
+#include "calo_noise_spectrum.h"
+#include "calo_waveform_display.h"
+#include "calo_histogramming.h"
+#include "calo_waveform_fft.h"
+
+namespace snfee {
+  namespace calo {
+
+    /// \brief Processing of the calo hits stored in a RTD record
+    ///
+    /// The processing resources are not owned by this object. Several
+    /// instances can be run concurrently provided each one uses its own
+    /// analysis, FFT and histogramming objects. The mean waveform processor
+    /// may be shared if a mutex is provided.
+    struct hit_processing
+    {
+
+      /// \brief Configuration parameters
+      struct config_type
+      {
+        /// Selection of the processed channels
+        hit_selection::config_type selection;
+
+        /// Number of waveforms gathered before a SIMD engine measurement pass (0: no batching)
+        std::size_t waveform_batch_size = 0;
+
+        /// Export only the waveforms with a peak amplitude magnitude below this value (mV, positive)
+        double export_max_peak_mV = std::numeric_limits<double>::infinity();
+      };
+
+      /// Constructor
+      hit_processing(const config_type & cfg_,
+                     const datatools::logger::priority logging_ = datatools::logger::PRIO_FATAL);
+
+      /// \brief Processing stages needed by the requested outputs
+      ///
+      /// Without a plan, all stages are run. With firmware metadata
+      /// histograms only, the waveform samples are neither extracted nor
+      /// converted.
+      struct plan_type
+      {
+        bool waveforms      = true; ///< Extract the waveform samples
+        bool measurements   = true; ///< Waveform measurements
+        bool fft            = true; ///< Waveform Fourier spectrum (only for the display)
+        bool fw_emulation   = true; ///< Firmware emulation
+        bool mean_waveforms = true; ///< Mean waveforms
+        bool display        = true; ///< Waveform display
+        bool waveform_export = true; ///< Waveform export
+        bool noise_spectra  = true; ///< Noise spectral densities
+        bool histograms     = true; ///< Histogram filling
+
+        /// Print the plan
+        void print(std::ostream & out_, const std::string & indent_ = "") const;
+      };
+
+      /// Build the processing plan from the attached processing resources
+      ///
+      /// Must be called once the resources are set and before processing.
+      void prepare();
+
+      /// Return the processing plan
+      const plan_type & get_plan() const;
+
+      /// \brief Data of a SAMLONG channel handed to the processing
+      struct channel_input_type
+      {
+        int32_t                 run_id      = -1; ///< Run ID
+        int32_t                 trigger_id  = -1; ///< Trigger ID
+        snfee::data::channel_id ch_id;            ///< Readout channel ID
+        uint16_t                channel_index = INVALID_CHANNEL_INDEX; ///< Dense channel index (computed from ch_id if invalid)
+        int32_t                 fw_baseline = 0;  ///< Firmware baseline       (LSB: ADC unit/16)
+        int32_t                 fw_peak     = 0;  ///< Firmware peak amplitude (LSB: ADC unit/8)
+        int32_t                 fw_charge   = 0;  ///< Firmware charge
+        int32_t                 fw_peak_cell   = 0; ///< Firmware peak position        (TDC: 0-1023)
+        int32_t                 fw_rising_cell = 0; ///< Firmware rising edge crossing (LSB: TDC unit/256)
+        bool                    flagged     = false; ///< Flagged for display (firmware emulation mismatch)
+
+        /// Raw channel data (null if the channel does not come from a RTD record)
+        const snfee::data::calo_hit_record::channel_data_record * ch_data = nullptr;
+
+        /// ADC samples of the channel (null if the waveform is not recorded)
+        const std::vector<uint16_t> * waveform = nullptr;
+      };
+
+      /// Process the calo hits of a RTD record, returns the number of selected channels
+      std::size_t process(const snfee::data::raw_trigger_data & rtd_);
+
+      /// Process the rows of a columnar store block, returns the number of selected channels
+      ///
+      /// The rows are selected from their flag and channel index columns
+      /// before their samples are read.
+      std::size_t process(const columnar_store::block_view & block_);
+
+      /// Process a selected channel
+      ///
+      /// With the SIMD engine and batching, the channel is only gathered in
+      /// the waveform batch: its processing completes when the batch is full
+      /// or at the next flush.
+      void process_channel(const channel_input_type & input_);
+
+      /// Measure and process the channels pending in the waveform batch,
+      /// transform the pending noise segments
+      void flush();
+
+      datatools::logger::priority logging = datatools::logger::PRIO_FATAL; ///< Logging priority threshold
+
+      // Processing resources (not owned):
+      snfee::algo::calo_waveform_analysis       * analysis            = nullptr; ///< Waveform measurements
+      snfee::algo::calo_waveform_fft            * fft                 = nullptr; ///< Waveform FFT
+      snfee::algo::calo_mean_waveform_processor * mean_waveform       = nullptr; ///< Mean waveform processor
+      std::mutex                                * mean_waveform_mutex = nullptr; ///< Lock for a shared mean waveform processor
+      histogramming                             * histos              = nullptr; ///< Histogramming
+      waveform_display                          * display             = nullptr; ///< Waveform display (may be shared)
+      stage_timing                              * timing              = nullptr; ///< Stage timing
+      const measurement_engine                  * engine              = nullptr; ///< SIMD measurement engine (replaces the snfee measurements)
+      measurement_comparison                    * comparison          = nullptr; ///< Comparison of the SIMD engine with the snfee measurements
+      const firmware_emulation                  * fw_emulation        = nullptr; ///< Firmware emulation
+      firmware_comparison                       * fw_comparison       = nullptr; ///< Comparison of the emulated and recorded firmware measurements
+      waveform_export_writer                    * exporter            = nullptr; ///< Waveform export
+      std::mutex                                * exporter_mutex      = nullptr; ///< Lock for a shared waveform export
+      noise_spectrum                            * noise               = nullptr; ///< Noise spectral densities
+
+    private:
+
+      /// Emulate the firmware measurements of a channel and compare them with the recorded ones,
+      /// returns true on a mismatch
+      bool _check_firmware_(const channel_input_type & input_);
+
+      /// Export the waveform of a channel with its measurements
+      void _export_waveform_(const channel_input_type & input_,
+                             const float baseline_mV_,
+                             const float peak_mV_,
+                             const float charge_nVs_);
+
+      /// Process a channel after the SIMD engine measurements (null without engine)
+      void _process_measured_channel_(const channel_input_type & input_,
+                                      const measurement_engine::result_type * engine_result_);
+
+    private:
+
+      config_type _config_;
+      plan_type _plan_;
+      hit_selection _selection_;
+      std::vector<uint16_t> _ch_waveforms_[2]; ///< Working waveform buffers (one per SAMLONG channel)
+      std::vector<double>   _ft_;              ///< Working FFT buffer
+      std::vector<float>    _amplitudes_mV_;   ///< Working waveform amplitudes for the SIMD engine
+      waveform_conversion   _conversion_;      ///< SAMLONG sample conversion
+      simd_level_type       _simd_level_ = SIMD_NONE;  ///< SIMD instruction set of the kernels
+      std::unique_ptr<waveform_batch> _batch_; ///< Pending waveforms for the SIMD engine
+      std::vector<uint16_t> _batch_waveform_;  ///< Working waveform buffer for the batched channels
+      std::vector<uint8_t>  _encoded_;         ///< Working encoded waveform buffer
+
+    };
+
+  } // namespace calo
+} // namespace snfee
+
+#endif // CALO_HIT_PROCESSING_H
+
+// Local Variables: --
+// mode: c++ --
+// c-file-style: "gnu" --
+// tab-width: 2 --
+// End: --
@@ -0,0 +1,77 @@
+// Ourselves:
+#include "calo_hit_selection.h"
+
+// This project:
+#include <snfee/model/feb_constants.h>
+
+namespace snfee {
+  namespace calo {
+
+    hit_selection::hit_selection(const config_type & cfg_)
+      : _config_(cfg_)
+      , _calo_channel_selector_(cfg_.calo_channel_selector_cfg)
+    {
+      return;
+    }
+
+    // static
+    snfee::data::channel_id hit_selection::make_channel_id(const snfee::data::calo_hit_record & calo_hit_,
+                                                           const int ichannel_)
+    {
+      // Compute a comprehensive readout Wavecatcher channel ID object (crate number+board number+channel number):
+      return snfee::data::channel_id(calo_hit_.get_crate_num(), // [0-2]
+                                     calo_hit_.get_board_num(), // [0-9,11-20]
+                                     snfee::model::feb_constants::SAMLONG_NUMBER_OF_CHANNELS * calo_hit_.get_chip_num() + ichannel_); // [0-15]
+    }
+
+    bool hit_selection::select(const snfee::data::channel_id & ch_id_,
+                               const bool lt_,
+                               const bool ht_) const
+    {
+      if (_config_.process_lt and !lt_) return false;
+      if (_config_.process_ht and !ht_) return false;
+      return _calo_channel_selector_(ch_id_);
+    }
+
+    bool hit_selection::select_channel(const snfee::data::calo_hit_record & calo_hit_,
+                                       const int ichannel_) const
+    {
+      const snfee::data::calo_hit_record::channel_data_record & ch_data = calo_hit_.get_channel_data(ichannel_);
+      if (_config_.process_lt and !ch_data.is_lt()) {
+        // Hit with LT flag:
+        return false;
+      }
+      if (_config_.process_ht and !ch_data.is_ht()) {
+        // Hit with HT flag:
+        return false;
+      }
+      if (!_calo_channel_selector_(make_channel_id(calo_hit_, ichannel_))) {
+        // Hit with allowed channel ID:
+        return false;
+      }
+      return true;
+    }
+
+    uint32_t hit_selection::select_hit(const snfee::data::calo_hit_record & calo_hit_) const
+    {
+      uint32_t mask = 0;
+      for (int ichannel = 0; ichannel < snfee::model::feb_constants::SAMLONG_NUMBER_OF_CHANNELS; ichannel++) {
+        if (select_channel(calo_hit_, ichannel)) {
+          mask |= (0x1 << ichannel);
+        }
+      }
+      return mask;
+    }
+
+    bool hit_selection::select_record(const snfee::data::raw_trigger_data & rtd_) const
+    {
+      for (const auto & p_calo_hit : rtd_.get_calo_hits()) {
+        if (select_hit(*p_calo_hit) != 0) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+  } // namespace calo
+} // namespace snfee
@@ -0,0 +1,79 @@
+#ifndef CALO_HIT_SELECTION_H
+#define CALO_HIT_SELECTION_H
+
+// Standard library:
+#include <cstdint>
+
+// This project:
+#include <snfee/data/raw_trigger_data.h>
+#include <snfee/data/calo_hit_record.h>
+#include <snfee/data/channel_id.h>
+#include <snfee/data/channel_id_selection.h>
+
+namespace snfee {
+  namespace calo {
+
+    /// \brief Selection of calo hit channels from the hit headers
+    ///
+    /// Only the hit address (crate, board, chip) and the channel flags are
+    /// used. With RTD input files, the snfee deserialization of a record
+    /// always decodes the waveforms of all its calo hits: the selection
+    /// only saves the downstream processing of the dropped hits (sample
+    /// extraction, measurements, worker dispatch). The columnar store is
+    /// the lazy path: its rows are selected from the flag and channel
+    /// index columns, and the samples of the dropped rows are never read.
+    struct hit_selection
+    {
+
+      /// \brief Configuration parameters
+      struct config_type
+      {
+        /// Process only low-threshold calo hits
+        bool process_lt = false;
+
+        /// Process only high-threshold calo hits
+        bool process_ht = false;
+
+        /// Channel ID selector
+        snfee::data::channel_id_selection::config_type calo_channel_selector_cfg;
+      };
+
+      /// Constructor
+      hit_selection(const config_type & cfg_);
+
+      /// Return the channel ID of a SAMLONG channel in a calo hit
+      static snfee::data::channel_id make_channel_id(const snfee::data::calo_hit_record & calo_hit_,
+                                                     const int ichannel_);
+
+      /// Check if a channel is selected from its ID and threshold flags
+      bool select(const snfee::data::channel_id & ch_id_,
+                  const bool lt_,
+                  const bool ht_) const;
+
+      /// Check if a SAMLONG channel of a calo hit is selected
+      bool select_channel(const snfee::data::calo_hit_record & calo_hit_,
+                          const int ichannel_) const;
+
+      /// Return the mask of selected SAMLONG channels in a calo hit (bit i for channel i)
+      uint32_t select_hit(const snfee::data::calo_hit_record & calo_hit_) const;
+
+      /// Check if a RTD record contains at least one selected channel
+      bool select_record(const snfee::data::raw_trigger_data & rtd_) const;
+
+    private:
+
+      config_type _config_;
+      snfee::data::channel_id_selection _calo_channel_selector_;
+
+    };
+
+  } // namespace calo
+} // namespace snfee
+
+#endif // CALO_HIT_SELECTION_H
+
+// Local Variables: --
+// mode: c++ --
+// c-file-style: "gnu" --
+// tab-width: 2 --
+// End: --
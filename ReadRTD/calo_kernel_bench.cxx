@@ -0,0 +1,513 @@
+// Standard library:
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <exception>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Third party:
+// - Boost:
+#include <boost/program_options.hpp>
+// - Bayeux:
+#include <bayeux/datatools/logger.h>
+#include <bayeux/datatools/exception.h>
+
+// This project:
+#include <snfee/snfee.h>
+#include <snfee/data/calo_waveform_data.h>
+#include <snfee/algo/calo_waveform_analysis.h>
+#include <snfee/model/feb_constants.h>
+
+// This example:
+#include "calo_waveform_kernels.h"
+#include "calo_waveform_fft.h"
+#include "calo_noise_spectrum.h"
+#include "calo_measurement_engine.h"
+
+/// \brief Application configuration parameters
+struct app_params_type
+{
+  /// Logging priority
+  datatools::logger::priority logging = datatools::logger::PRIO_FATAL;
+
+  /// Number of synthetic calo hits
+  std::size_t number_of_hits = 1000;
+
+  /// Number of samples per channel
+  std::size_t number_of_samples = snfee::model::feb_constants::SAMLONG_MAX_NUMBER_OF_SAMPLES;
+
+  /// Number of passes over the calo hits
+  std::size_t number_of_passes = 10;
+
+  /// Seed of the synthetic waveform generator
+  unsigned int seed = 314159;
+
+  /// Calo waveforms analysis configuration path (snfee computers and SIMD engine)
+  std::string analysis_config_path;
+};
+
+/// \brief Synthetic interleaved SAMLONG samples of a set of calo hits
+struct synthetic_hits_type
+{
+  std::size_t number_of_samples = 0;
+  std::vector<std::vector<int16_t>> interleaved; ///< Interleaved samples per hit
+
+  /// Generate noisy baselines with negative pulses
+  void generate(const std::size_t number_of_hits_,
+                const std::size_t number_of_samples_,
+                const unsigned int seed_)
+  {
+    std::mt19937 rng(seed_);
+    std::normal_distribution<double> noise(0.0, 2.5);
+    std::uniform_real_distribution<double> amplitude(50.0, 1500.0);
+    std::uniform_int_distribution<int> position(100, (int) number_of_samples_ - 200);
+    number_of_samples = number_of_samples_;
+    interleaved.assign(number_of_hits_, std::vector<int16_t>(2 * number_of_samples_));
+    for (auto & samples : interleaved) {
+      for (int ichannel = 0; ichannel < 2; ichannel++) {
+        double pulse_amplitude = amplitude(rng);
+        int pulse_position = position(rng);
+        for (std::size_t isample = 0; isample < number_of_samples_; isample++) {
+          double adc = 2048.0 + noise(rng);
+          double dt = (double) isample - pulse_position;
+          if (dt > 0.0) {
+            adc -= pulse_amplitude * (std::exp(-dt / 20.0) - std::exp(-dt / 2.0));
+          }
+          samples[2 * isample + ichannel] = (int16_t) std::max(0.0, std::min(4095.0, std::round(adc)));
+        }
+      }
+    }
+    return;
+  }
+};
+
+/// Return the time elapsed since a start time (second)
+double elapsed_since(const std::chrono::steady_clock::time_point & start_)
+{
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_;
+  return elapsed.count();
+}
+
+/// Print a benchmark result line
+void print_result(const std::string & label_,
+                  const double seconds_,
+                  const std::size_t number_of_hits_,
+                  const double reference_seconds_)
+{
+  std::clog << "  " << std::left << std::setw(32) << label_ << std::right
+            << " : " << std::fixed << std::setprecision(1) << std::setw(10)
+            << 1e9 * seconds_ / number_of_hits_ << " ns/hit"
+            << "  (x" << std::setprecision(2) << reference_seconds_ / seconds_ << ")"
+            << std::defaultfloat << std::endl;
+  return;
+}
+
+/// Time a kernel over all the synthetic hits with the generic then the fixed-size kernels
+void bench_fixed_size(const std::string & label_,
+                      const std::size_t number_of_hits_,
+                      const std::size_t number_of_passes_,
+                      const std::function<void(const std::size_t)> & kernel_)
+{
+  double times[2];
+  for (int fixed = 0; fixed < 2; fixed++) {
+    snfee::calo::set_fixed_size_kernels(fixed == 1);
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t ipass = 0; ipass < number_of_passes_; ipass++) {
+      for (std::size_t ihit = 0; ihit < number_of_hits_; ihit++) {
+        kernel_(ihit);
+      }
+    }
+    times[fixed] = elapsed_since(start);
+  }
+  snfee::calo::set_fixed_size_kernels(true);
+  std::size_t total_hits = number_of_hits_ * number_of_passes_;
+  print_result(label_ + " (generic)", times[0], total_hits, times[0]);
+  print_result(label_ + " (fixed)", times[1], total_hits, times[0]);
+  return;
+}
+
+// Main program:
+int main(int argc_, char ** argv_)
+{
+  snfee::initialize();
+  int error_code = EXIT_SUCCESS;
+  try {
+
+    // Configuration:
+    app_params_type app_params;
+
+    // Parse options:
+    namespace po = boost::program_options;
+    po::options_description opts("Allowed options");
+    opts.add_options()
+      ("help", "produce help message")
+
+      ("logging,L",
+       po::value<std::string>()->value_name("level"),
+       "logging priority")
+
+      ("number-of-hits,n",
+       po::value<std::size_t>(&app_params.number_of_hits)
+       ->default_value(1000)
+       ->value_name("number"),
+       "set the number of synthetic calo hits")
+
+      ("number-of-samples,s",
+       po::value<std::size_t>(&app_params.number_of_samples)
+       ->default_value(snfee::model::feb_constants::SAMLONG_MAX_NUMBER_OF_SAMPLES)
+       ->value_name("number"),
+       "set the number of samples per channel")
+
+      ("number-of-passes,p",
+       po::value<std::size_t>(&app_params.number_of_passes)
+       ->default_value(10)
+       ->value_name("number"),
+       "set the number of passes over the calo hits")
+
+      ("calo-analysis-config,A",
+       po::value<std::string>(&app_params.analysis_config_path)
+       ->value_name("path"),
+       "set the calo waveforms analysis configuration path")
+
+    ; // end of options description
+
+    // Describe command line arguments :
+    po::variables_map vm;
+    po::store(po::command_line_parser(argc_, argv_)
+              .options(opts)
+              .run(), vm);
+    po::notify(vm);
+
+    // Use command line arguments :
+    if (vm.count("help")) {
+      std::cout << "snfee-calo-kernel-bench : "
+                << "Micro-benchmark of the calo waveform kernels on synthetic waveforms"
+                << std::endl << std::endl;
+      std::cout << "Usage : " << std::endl << std::endl;
+      std::cout << "  snfee-calo-kernel-bench [OPTIONS]" << std::endl << std::endl;
+      std::cout << opts << std::endl;
+      return (-1);
+    }
+
+    // Use command line arguments :
+    if (vm.count("logging")) {
+      std::string logging_repr = vm["logging"].as<std::string>();
+      app_params.logging = datatools::logger::get_priority(logging_repr);
+      DT_THROW_IF(app_params.logging == datatools::logger::PRIO_UNDEFINED,
+                  std::logic_error,
+                  "Invalid logging priority '" << vm["logging"].as<std::string>() << "'!");
+    }
+
+    // Checks:
+    DT_THROW_IF(app_params.number_of_hits == 0 or app_params.number_of_passes == 0,
+                std::logic_error,
+                "Invalid number of hits or passes!");
+    DT_THROW_IF(app_params.number_of_samples < 300,
+                std::logic_error,
+                "Invalid number of samples (< 300)!");
+
+    // Synthetic calo hits:
+    synthetic_hits_type hits;
+    hits.generate(app_params.number_of_hits, app_params.number_of_samples, app_params.seed);
+    std::size_t nsamples = hits.number_of_samples;
+    std::size_t total_hits = app_params.number_of_hits * app_params.number_of_passes;
+
+    // Constants:
+    double tdc_to_ns = snfee::model::feb_constants::SAMLONG_DEFAULT_TDC_LSB_NS;
+    double adc_to_mV = snfee::model::feb_constants::SAMLONG_ADC_VOLTAGE_LSB_MV;
+    int16_t adc_zero = snfee::model::feb_constants::SAMLONG_ADC_ZERO;
+    snfee::calo::waveform_conversion conversion;
+    conversion.tdc_to_ns = tdc_to_ns;
+    conversion.adc_zero  = adc_zero;
+    conversion.adc_to_mV = adc_to_mV;
+
+    snfee::calo::simd_level_type simd_level = snfee::calo::detect_simd_level();
+    std::clog << "Synthetic calo hits     : " << app_params.number_of_hits
+              << " x " << app_params.number_of_passes << " passes" << std::endl;
+    std::clog << "Samples per channel     : " << nsamples << std::endl;
+    std::clog << "CPU SIMD support        : " << snfee::calo::simd_level_name(simd_level) << std::endl;
+
+    // Reference: per-sample de-interleave and populate_waveform for both channels:
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t ipass = 0; ipass < app_params.number_of_passes; ipass++) {
+      for (const auto & samples : hits.interleaved) {
+        for (int ichannel = 0; ichannel < 2; ichannel++) {
+          std::vector<uint16_t> ch_waveform;
+          ch_waveform.reserve(nsamples);
+          for (std::size_t isample = 0; isample < nsamples; isample++) {
+            ch_waveform.push_back(samples[2 * isample + ichannel]);
+          }
+          snfee::data::calo_waveform waveform;
+          snfee::algo::calo_waveform_analysis::populate_waveform(ch_waveform,
+                                                                 waveform,
+                                                                 tdc_to_ns,
+                                                                 adc_zero,
+                                                                 adc_to_mV);
+        }
+      }
+    }
+    double reference_time = elapsed_since(start);
+
+    // Kernels:
+    snfee::calo::samlong_waveforms converted;
+    start = std::chrono::steady_clock::now();
+    for (std::size_t ipass = 0; ipass < app_params.number_of_passes; ipass++) {
+      for (const auto & samples : hits.interleaved) {
+        converted.convert(samples.data(), nsamples, conversion, snfee::calo::SIMD_NONE);
+      }
+    }
+    double scalar_time = elapsed_since(start);
+
+    double simd_time = scalar_time;
+    if (simd_level != snfee::calo::SIMD_NONE) {
+      start = std::chrono::steady_clock::now();
+      for (std::size_t ipass = 0; ipass < app_params.number_of_passes; ipass++) {
+        for (const auto & samples : hits.interleaved) {
+          converted.convert(samples.data(), nsamples, conversion, simd_level);
+        }
+      }
+      simd_time = elapsed_since(start);
+    }
+
+    std::clog << "Waveform conversion (both channels of a hit) :" << std::endl;
+    print_result("vector + populate_waveform", reference_time, total_hits, reference_time);
+    print_result("one-pass kernel (scalar)", scalar_time, total_hits, reference_time);
+    if (simd_level != snfee::calo::SIMD_NONE) {
+      print_result(std::string("one-pass kernel (") + snfee::calo::simd_level_name(simd_level) + ")",
+                   simd_time, total_hits, reference_time);
+    }
+
+    // Fixed-size kernels with respect to the generic ones:
+    std::clog << "Fixed-size kernels (" << snfee::calo::simd_level_name(simd_level) << ", "
+              << nsamples << " samples) :" << std::endl;
+    if (!snfee::calo::has_fixed_size_kernels(nsamples)) {
+      std::clog << "  no fixed-size kernels for " << nsamples << " samples (1024, 512, 256 or 128)" << std::endl;
+    } else {
+      std::vector<std::vector<float>> hit_amplitudes(app_params.number_of_hits);
+      for (std::size_t ihit = 0; ihit < app_params.number_of_hits; ihit++) {
+        converted.convert(hits.interleaved[ihit].data(), nsamples, conversion, simd_level);
+        hit_amplitudes[ihit] = converted.amplitudes_mV[0];
+      }
+      std::size_t baseline_samples = std::min<std::size_t>(128, nsamples);
+      std::vector<double> sums(nsamples, 0.0);
+      double sink = 0.0;
+      bench_fixed_size("extraction (2 channels)", app_params.number_of_hits, app_params.number_of_passes,
+                       [&](const std::size_t ihit_) {
+                         converted.convert(hits.interleaved[ihit_].data(), nsamples, conversion, simd_level);
+                       });
+      bench_fixed_size("baseline", app_params.number_of_hits, app_params.number_of_passes,
+                       [&](const std::size_t ihit_) {
+                         double sum = 0.0;
+                         double sum2 = 0.0;
+                         snfee::calo::sum_squares_samples(hit_amplitudes[ihit_].data(), baseline_samples,
+                                                          sum, sum2, simd_level);
+                         sink += sum + sum2;
+                       });
+      bench_fixed_size("peak", app_params.number_of_hits, app_params.number_of_passes,
+                       [&](const std::size_t ihit_) {
+                         sink += snfee::calo::argmin_samples(hit_amplitudes[ihit_].data(), nsamples, simd_level);
+                       });
+      bench_fixed_size("charge", app_params.number_of_hits, app_params.number_of_passes,
+                       [&](const std::size_t ihit_) {
+                         sink += snfee::calo::sum_samples(hit_amplitudes[ihit_].data(), nsamples, simd_level);
+                       });
+      bench_fixed_size("mean waveform accumulation", app_params.number_of_hits, app_params.number_of_passes,
+                       [&](const std::size_t ihit_) {
+                         snfee::calo::accumulate_samples(hit_amplitudes[ihit_].data(), nsamples,
+                                                         sums.data(), simd_level);
+                       });
+      DT_LOG_DEBUG(app_params.logging, "Kernel checksum: " << sink + sums[0]);
+    }
+
+    // Single precision half spectrum with respect to the double precision spectrum:
+    {
+      std::vector<std::vector<float>> hit_amplitudes(app_params.number_of_hits);
+      std::vector<snfee::data::calo_waveform> hit_waveforms(app_params.number_of_hits);
+      std::vector<uint16_t> ch_samples(nsamples);
+      for (std::size_t ihit = 0; ihit < app_params.number_of_hits; ihit++) {
+        converted.convert(hits.interleaved[ihit].data(), nsamples, conversion, simd_level);
+        hit_amplitudes[ihit] = converted.amplitudes_mV[0];
+        for (std::size_t isample = 0; isample < nsamples; isample++) {
+          ch_samples[isample] = hits.interleaved[ihit][2 * isample];
+        }
+        snfee::algo::calo_waveform_analysis::populate_waveform(ch_samples,
+                                                               hit_waveforms[ihit],
+                                                               tdc_to_ns,
+                                                               adc_zero,
+                                                               adc_to_mV);
+      }
+      snfee::algo::calo_waveform_fft::config_type fft_cfg;
+      snfee::algo::calo_waveform_fft fft(fft_cfg);
+      fft.initialize();
+      std::vector<double> ft;
+      std::vector<float> ft_float;
+      double frequency_step = 0.0;
+      start = std::chrono::steady_clock::now();
+      for (std::size_t ipass = 0; ipass < app_params.number_of_passes; ipass++) {
+        for (const auto & waveform : hit_waveforms) {
+          fft.transform(waveform, ft, frequency_step);
+        }
+      }
+      double double_time = elapsed_since(start);
+      start = std::chrono::steady_clock::now();
+      for (std::size_t ipass = 0; ipass < app_params.number_of_passes; ipass++) {
+        for (const auto & amplitudes : hit_amplitudes) {
+          fft.transform_half(amplitudes.data(), nsamples, ft_float);
+        }
+      }
+      double float_time = elapsed_since(start);
+
+      // Deviation of the non-redundant bins, relative to the largest Fourier amplitude:
+      double max_spectrum_diff = 0.0;
+      for (std::size_t ihit = 0; ihit < app_params.number_of_hits; ihit++) {
+        fft.transform(hit_waveforms[ihit], ft, frequency_step);
+        fft.transform_half(hit_amplitudes[ihit].data(), nsamples, ft_float);
+        DT_THROW_IF(ft_float.size() != nsamples / 2 + 1,
+                    std::logic_error,
+                    "Unexpected number of bins in the half spectrum!");
+        double max_amplitude = *std::max_element(ft.begin(), ft.end());
+        for (std::size_t k = 0; k < ft_float.size(); k++) {
+          max_spectrum_diff = std::max(max_spectrum_diff, std::abs(ft_float[k] - ft[k]) / max_amplitude);
+        }
+      }
+      fft.terminate();
+      std::clog << "Waveform spectrum (one channel) :" << std::endl;
+      print_result("double, full spectrum", double_time, total_hits, double_time);
+      print_result("float, half spectrum", float_time, total_hits, double_time);
+      std::clog << "  maximum relative deviation       : " << max_spectrum_diff << std::endl;
+    }
+
+    // Accuracy with respect to populate_waveform (double precision):
+    double max_time_diff = 0.0;
+    double max_amplitude_diff = 0.0;
+    std::vector<uint16_t> ch_waveform;
+    snfee::data::calo_waveform ref_waveforms[2];
+    for (const auto & samples : hits.interleaved) {
+      converted.convert(samples.data(), nsamples, conversion, simd_level);
+      for (int ichannel = 0; ichannel < 2; ichannel++) {
+        ch_waveform.clear();
+        for (std::size_t isample = 0; isample < nsamples; isample++) {
+          ch_waveform.push_back(samples[2 * isample + ichannel]);
+        }
+        snfee::data::calo_waveform & waveform = ref_waveforms[ichannel];
+        snfee::algo::calo_waveform_analysis::populate_waveform(ch_waveform,
+                                                               waveform,
+                                                               tdc_to_ns,
+                                                               adc_zero,
+                                                               adc_to_mV);
+        DT_THROW_IF(waveform.get_amplitudes_mV().size() != nsamples,
+                    std::logic_error,
+                    "Unexpected number of samples in the reference waveform!");
+        for (std::size_t isample = 0; isample < nsamples; isample++) {
+          max_time_diff = std::max(max_time_diff,
+                                   std::abs(waveform.get_times_ns()[isample] - converted.times_ns[isample]));
+          max_amplitude_diff = std::max(max_amplitude_diff,
+                                        std::abs(waveform.get_amplitudes_mV()[isample] - converted.amplitudes_mV[ichannel][isample]));
+        }
+      }
+    }
+    std::clog << "Maximum deviation from populate_waveform :" << std::endl;
+    std::clog << "  time                             : " << max_time_diff << " ns" << std::endl;
+    std::clog << "  amplitude                        : " << max_amplitude_diff << " mV" << std::endl;
+
+    // Fixed point round trip of the noise spectrum sums:
+    {
+      typedef snfee::calo::noise_spectrum noise_spectrum;
+      std::mt19937 rng(app_params.seed);
+      std::uniform_real_distribution<double> exponent(-6.0, 12.0);
+      double max_fixed_diff = 0.0;
+      const double values[] = {0.0, 0.25, 1.0, 3.5, 1000.0, 1.0e9};
+      std::vector<double> test_values(std::begin(values), std::end(values));
+      for (std::size_t i = 0; i < 10000; i++) {
+        test_values.push_back(std::pow(10.0, exponent(rng)));
+      }
+      for (double value : test_values) {
+        double round_trip = noise_spectrum::from_fixed(noise_spectrum::to_fixed(value));
+        // Half a fixed point unit, plus the double rounding of large values:
+        double tolerance = 0.5 / 4294967296.0 + value * 1e-15;
+        double diff = std::abs(round_trip - value);
+        DT_THROW_IF(diff > tolerance,
+                    std::logic_error,
+                    "Fixed point round trip of " << value << " mV^2 gives " << round_trip << " mV^2!");
+        max_fixed_diff = std::max(max_fixed_diff, diff);
+      }
+      std::clog << "Noise spectrum fixed point round trip :" << std::endl;
+      std::clog << "  maximum deviation                : " << max_fixed_diff << " mV^2" << std::endl;
+    }
+
+    // SIMD measurement engine with respect to the snfee computers:
+    {
+      snfee::algo::calo_waveform_analysis::config_type analysis_cfg;
+      snfee::calo::measurement_engine::config_type engine_cfg;
+      if (!app_params.analysis_config_path.empty()) {
+        analysis_cfg.parse(app_params.analysis_config_path);
+        engine_cfg.parse(app_params.analysis_config_path);
+      }
+      snfee::algo::calo_waveform_analysis analysis(analysis_cfg);
+      analysis.initialize();
+      snfee::calo::measurement_engine engine(engine_cfg, simd_level);
+      snfee::calo::measurement_engine scalar_engine(engine_cfg, snfee::calo::SIMD_NONE);
+      snfee::calo::measurement_comparison comparison;
+      snfee::calo::measurement_engine::result_type result;
+      snfee::calo::measurement_engine::result_type scalar_result;
+      std::size_t number_of_peaks = 0;
+      double max_simd_baseline_diff = 0.0;
+      double max_simd_charge_diff = 0.0;
+      for (const auto & samples : hits.interleaved) {
+        converted.convert(samples.data(), nsamples, conversion, simd_level);
+        for (int ichannel = 0; ichannel < 2; ichannel++) {
+          ch_waveform.clear();
+          for (std::size_t isample = 0; isample < nsamples; isample++) {
+            ch_waveform.push_back(samples[2 * isample + ichannel]);
+          }
+          snfee::data::channel_id ch_id(0, 0, ichannel);
+          snfee::data::calo_waveform_info waveform_info;
+          snfee::algo::calo_waveform_analysis::populate_waveform(ch_waveform,
+                                                                 waveform_info.waveform,
+                                                                 tdc_to_ns,
+                                                                 adc_zero,
+                                                                 adc_to_mV);
+          analysis.do_measurements(ch_id, waveform_info);
+          const std::vector<float> & amplitudes = converted.amplitudes_mV[ichannel];
+          engine.measure(amplitudes.data(), nsamples, tdc_to_ns, result);
+          scalar_engine.measure(amplitudes.data(), nsamples, tdc_to_ns, scalar_result);
+          comparison.compare(result, waveform_info);
+          if (result.has_peak) {
+            number_of_peaks++;
+            max_simd_charge_diff = std::max(max_simd_charge_diff,
+                                            (double) std::abs(result.charge_nVs - scalar_result.charge_nVs));
+          }
+          max_simd_baseline_diff = std::max(max_simd_baseline_diff,
+                                            (double) std::abs(result.baseline_mV - scalar_result.baseline_mV));
+        }
+      }
+      analysis.terminate();
+      comparison.print_report(std::clog);
+      std::clog << "  Channels with a validated peak   : " << number_of_peaks << std::endl;
+      std::clog << "  " << snfee::calo::simd_level_name(simd_level) << " vs scalar engine baseline : "
+                << max_simd_baseline_diff << " mV" << std::endl;
+      std::clog << "  " << snfee::calo::simd_level_name(simd_level) << " vs scalar engine charge   : "
+                << max_simd_charge_diff << " nV.s" << std::endl;
+      if (comparison.number_of_outliers > 0) {
+        std::cerr << "error: " << comparison.number_of_outliers
+                  << " channels out of the SIMD engine tolerances!" << std::endl;
+        error_code = EXIT_FAILURE;
+      }
+    }
+
+  } catch (std::exception & x) {
+    std::cerr << "error: " << x.what() << std::endl;
+    error_code = EXIT_FAILURE;
+  } catch (...) {
+    std::cerr << "error: " << "unexpected error!" << std::endl;
+    error_code = EXIT_FAILURE;
+  }
+  snfee::terminate();
+  return (error_code);
+}
@@ -0,0 +1,254 @@
+// Ourselves:
+#include "calo_measurement_engine.h"
+
+// Standard library:
+#include <algorithm>
+#include <cmath>
+
+// Third party:
+// - Bayeux:
+#include <bayeux/datatools/exception.h>
+
+namespace snfee {
+  namespace calo {
+
+    constexpr double measurement_engine::BASELINE_TOLERANCE_MV;
+    constexpr double measurement_engine::PEAK_TOLERANCE_MV;
+    constexpr double measurement_engine::CHARGE_TOLERANCE;
+    constexpr double measurement_engine::CHARGE_TOLERANCE_NVS;
+
+    void measurement_engine::config_type::parse(const std::string & path_)
+    {
+      datatools::properties config;
+      datatools::properties::read_config(path_, config);
+      configure(config);
+      return;
+    }
+
+    void measurement_engine::config_type::configure(const datatools::properties & config_)
+    {
+      if (config_.has_key("engine")) {
+        engine = config_.fetch_string("engine");
+      }
+      DT_THROW_IF(engine != "snfee" and engine != "simd",
+                  std::logic_error,
+                  "Invalid calo measurement engine '" << engine << "'!");
+
+      if (config_.has_key("baseline_computer.min_width_time_ns")) {
+        baseline_min_width_time_ns = config_.fetch_real("baseline_computer.min_width_time_ns");
+      }
+      if (config_.has_key("baseline_computer.block_size")) {
+        baseline_block_size = config_.fetch_integer("baseline_computer.block_size");
+      }
+      if (config_.has_key("baseline_computer.nsigmas")) {
+        baseline_nsigmas = config_.fetch_real("baseline_computer.nsigmas");
+      }
+
+      if (config_.has_key("peak_searcher.threshold_mV")) {
+        peak_threshold_mV = config_.fetch_real("peak_searcher.threshold_mV");
+      }
+      if (config_.has_key("peak_searcher.block_size")) {
+        peak_block_size = config_.fetch_integer("peak_searcher.block_size");
+      }
+
+      if (config_.has_key("cfd_computer.fraction")) {
+        cfd_fraction = config_.fetch_real("cfd_computer.fraction");
+      }
+      if (config_.has_key("cfd_computer.max_scope")) {
+        cfd_max_scope = config_.fetch_integer("cfd_computer.max_scope");
+      }
+      if (config_.has_key("cfd_computer.mode")) {
+        cfd_mode = config_.fetch_string("cfd_computer.mode");
+      }
+
+      if (config_.has_key("charge_computer.pre_cfd_time_ns")) {
+        charge_pre_cfd_time_ns = config_.fetch_real("charge_computer.pre_cfd_time_ns");
+      }
+      if (config_.has_key("charge_computer.width_ns")) {
+        charge_width_ns = config_.fetch_real("charge_computer.width_ns");
+      }
+      return;
+    }
+
+    bool measurement_engine::config_type::use_simd() const
+    {
+      return engine == "simd";
+    }
+
+    measurement_engine::measurement_engine(const config_type & cfg_,
+                                           const simd_level_type simd_level_)
+      : _config_(cfg_)
+      , _simd_level_(simd_level_)
+    {
+      DT_THROW_IF(_config_.baseline_block_size < 1, std::logic_error, "Invalid baseline block size!");
+      DT_THROW_IF(_config_.peak_block_size < 1, std::logic_error, "Invalid peak block size!");
+      DT_THROW_IF(_config_.cfd_fraction <= 0.0 or _config_.cfd_fraction >= 1.0,
+                  std::logic_error, "Invalid CFD fraction!");
+      DT_THROW_IF(_config_.cfd_max_scope < 1, std::logic_error, "Invalid CFD scope!");
+      DT_THROW_IF(_config_.cfd_mode != "linear_interpolation",
+                  std::logic_error,
+                  "Unsupported CFD mode '" << _config_.cfd_mode << "' for the SIMD measurement engine!");
+      DT_THROW_IF(_config_.charge_width_ns <= 0.0, std::logic_error, "Invalid charge integration width!");
+      return;
+    }
+
+    const measurement_engine::config_type & measurement_engine::get_config() const
+    {
+      return _config_;
+    }
+
+    void measurement_engine::measure(const float * amplitudes_mV_,
+                                     const std::size_t nsamples_,
+                                     const float tdc_to_ns_,
+                                     result_type & result_) const
+    {
+      result_ = result_type();
+      if (nsamples_ == 0) return;
+      const float * a = amplitudes_mV_;
+      const std::size_t n = nsamples_;
+
+      // Baseline from the first samples:
+      std::size_t block_size = _config_.baseline_block_size;
+      std::size_t nbase = std::lround(_config_.baseline_min_width_time_ns / tdc_to_ns_);
+      nbase = std::min(n, std::max(nbase, block_size));
+      double sum = 0.0;
+      double sum2 = 0.0;
+      sum_squares_samples(a, nbase, sum, sum2, _simd_level_);
+      double mean = sum / nbase;
+      double sigma = std::sqrt(std::max(0.0, sum2 / nbase - mean * mean));
+
+      // Extend the baseline window by blocks until a fluctuation is detected:
+      double block_tolerance = _config_.baseline_nsigmas * std::max(sigma, 0.1) / std::sqrt((double) block_size);
+      std::size_t base_end = nbase;
+      while (base_end + block_size <= n) {
+        double block_mean = sum_samples(a + base_end, block_size, _simd_level_) / block_size;
+        if (std::abs(block_mean - mean) > block_tolerance) break;
+        base_end += block_size;
+      }
+      if (base_end > nbase) {
+        sum_squares_samples(a, base_end, sum, sum2, _simd_level_);
+        mean = sum / base_end;
+        sigma = std::sqrt(std::max(0.0, sum2 / base_end - mean * mean));
+      }
+      result_.baseline_mV = mean;
+      result_.baseline_sigma_mV = sigma;
+
+      // Peak search:
+      std::size_t ipeak = argmin_samples(a, n, _simd_level_);
+      double amplitude = a[ipeak] - mean;
+      result_.peak_cell = ipeak;
+      result_.peak_amplitude_mV = amplitude;
+      result_.peak_time_ns = ipeak * tdc_to_ns_;
+      if (amplitude <= _config_.peak_threshold_mV) {
+        // Check the peak profile around the minimum sample:
+        std::size_t half_block = _config_.peak_block_size / 2;
+        std::size_t first = (ipeak > half_block) ? ipeak - half_block : 0;
+        std::size_t last = std::min(n, first + _config_.peak_block_size);
+        double block_mean = sum_samples(a + first, last - first, _simd_level_) / (last - first);
+        result_.has_peak = (block_mean - mean <= _config_.peak_threshold_mV);
+      }
+      if (!result_.has_peak) {
+        // No pulse: the CFD time and charge are not computed, as in the snfee computers
+        result_.cfd_time_ns = NAN;
+        result_.charge_nVs = NAN;
+        return;
+      }
+
+      // CFD on the leading edge:
+      double level = mean + _config_.cfd_fraction * amplitude;
+      std::size_t icross = ipeak;
+      while (icross > 0 and a[icross - 1] <= level) {
+        icross--;
+      }
+      double cfd_cell = icross;
+      if (icross > 0) {
+        // Linear fit over the crossing vicinity (samples [icross - scope, icross + scope - 1]):
+        std::size_t scope = _config_.cfd_max_scope;
+        std::size_t first = (icross > scope) ? icross - scope : 0;
+        std::size_t last = std::min(ipeak + 1, icross + scope);
+        double sx = 0.0, sy = 0.0, sxx = 0.0, sxy = 0.0;
+        std::size_t npoints = last - first;
+        for (std::size_t i = first; i < last; i++) {
+          sx  += i;
+          sy  += a[i];
+          sxx += (double) i * i;
+          sxy += i * (double) a[i];
+        }
+        double det = npoints * sxx - sx * sx;
+        double slope = (det != 0.0) ? (npoints * sxy - sx * sy) / det : 0.0;
+        if (npoints >= 2 and slope < 0.0) {
+          double offset = (sy - slope * sx) / npoints;
+          cfd_cell = (level - offset) / slope;
+        } else {
+          // Two-point interpolation:
+          double y0 = a[icross - 1];
+          double y1 = a[icross];
+          cfd_cell = (icross - 1) + (y0 != y1 ? (y0 - level) / (y0 - y1) : 0.0);
+        }
+        cfd_cell = std::max((double) icross - 1, std::min((double) icross, cfd_cell));
+      }
+      result_.cfd_time_ns = cfd_cell * tdc_to_ns_;
+
+      // Charge integration:
+      double t0 = result_.cfd_time_ns - _config_.charge_pre_cfd_time_ns;
+      long i0 = std::max(0L, std::lround(t0 / tdc_to_ns_));
+      long i1 = std::min((long) n, i0 + std::lround(_config_.charge_width_ns / tdc_to_ns_));
+      if (i1 > i0) {
+        double integral = sum_samples(a + i0, i1 - i0, _simd_level_) - mean * (i1 - i0);
+        result_.charge_nVs = integral * tdc_to_ns_ * 1e-3;
+      }
+      return;
+    }
+
+    void measurement_comparison::compare(const measurement_engine::result_type & result_,
+                                         const snfee::data::calo_waveform_info & reference_)
+    {
+      double baseline_diff = std::abs(result_.baseline_mV - reference_.baseline.baseline_mV);
+      double peak_diff     = 0.0;
+      double charge_diff   = 0.0;
+      if (result_.has_peak) {
+        // Pulse measurements only (not computed without a peak):
+        peak_diff   = std::abs(result_.peak_amplitude_mV - reference_.peak.amplitude_mV);
+        charge_diff = std::abs(result_.charge_nVs - reference_.charge.charge_nVs);
+      }
+      double charge_tolerance = std::max(measurement_engine::CHARGE_TOLERANCE_NVS,
+                                         measurement_engine::CHARGE_TOLERANCE * std::abs(reference_.charge.charge_nVs));
+      number_of_channels++;
+      if (baseline_diff > measurement_engine::BASELINE_TOLERANCE_MV
+          or peak_diff > measurement_engine::PEAK_TOLERANCE_MV
+          or charge_diff > charge_tolerance) {
+        number_of_outliers++;
+      }
+      max_baseline_diff_mV = std::max(max_baseline_diff_mV, baseline_diff);
+      max_peak_diff_mV     = std::max(max_peak_diff_mV, peak_diff);
+      max_charge_diff_nVs  = std::max(max_charge_diff_nVs, charge_diff);
+      return;
+    }
+
+    void measurement_comparison::merge(const measurement_comparison & other_)
+    {
+      number_of_channels  += other_.number_of_channels;
+      number_of_outliers  += other_.number_of_outliers;
+      max_baseline_diff_mV = std::max(max_baseline_diff_mV, other_.max_baseline_diff_mV);
+      max_peak_diff_mV     = std::max(max_peak_diff_mV, other_.max_peak_diff_mV);
+      max_charge_diff_nVs  = std::max(max_charge_diff_nVs, other_.max_charge_diff_nVs);
+      return;
+    }
+
+    void measurement_comparison::print_report(std::ostream & out_) const
+    {
+      out_ << "SIMD measurement engine vs snfee computers :" << std::endl;
+      out_ << "  Compared channels              : " << number_of_channels << std::endl;
+      out_ << "  Channels out of tolerance      : " << number_of_outliers << std::endl;
+      out_ << "  Maximum baseline deviation     : " << max_baseline_diff_mV << " mV (tolerance "
+           << measurement_engine::BASELINE_TOLERANCE_MV << " mV)" << std::endl;
+      out_ << "  Maximum peak deviation         : " << max_peak_diff_mV << " mV (tolerance "
+           << measurement_engine::PEAK_TOLERANCE_MV << " mV)" << std::endl;
+      out_ << "  Maximum charge deviation       : " << max_charge_diff_nVs << " nV.s (tolerance "
+           << 100 * measurement_engine::CHARGE_TOLERANCE << " % or "
+           << measurement_engine::CHARGE_TOLERANCE_NVS << " nV.s)" << std::endl;
+      return;
+    }
+
+  } // namespace calo
+} // namespace snfee
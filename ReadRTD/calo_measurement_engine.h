@@ -0,0 +1,157 @@
+#ifndef CALO_MEASUREMENT_ENGINE_H
+#define CALO_MEASUREMENT_ENGINE_H
+
+// Standard library:
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+// Third party:
+// - Bayeux:
+#include <bayeux/datatools/logger.h>
+#include <bayeux/datatools/properties.h>
+
+// This project:
+#include <snfee/data/calo_waveform_data.h>
+
+// This example:
+#include "calo_waveform_kernels.h"
+
+namespace snfee {
+  namespace calo {
+
+    /// \brief SIMD engine for the baseline, peak, CFD and charge measurements
+    ///
+    /// Alternative to snfee::algo::calo_waveform_analysis::do_measurements,
+    /// working on contiguous single precision samples (mV). The engine is
+    /// selected with the 'engine' key of the calo analysis configuration
+    /// file ("snfee", the default, or "simd") and reuses the parameters of
+    /// the baseline_computer, peak_searcher, cfd_computer and
+    /// charge_computer sections:
+    ///
+    /// - baseline: mean and RMS of the samples before the signal, starting
+    ///   with min_width_time_ns and extended by blocks of block_size samples
+    ///   until a block mean deviates by more than nsigmas standard errors,
+    /// - peak: minimum sample, validated if its amplitude and the mean
+    ///   amplitude of the block_size samples around it are below threshold_mV,
+    /// - CFD: crossing of fraction x peak amplitude on the leading edge,
+    ///   linear fit over the max_scope samples on each side of the crossing
+    ///   (mode "linear_interpolation" only),
+    /// - charge: baseline subtracted integral over width_ns starting
+    ///   pre_cfd_time_ns before the CFD time.
+    ///
+    /// Without a validated peak, the CFD time and the charge are not
+    /// computed (NaN) and the peak amplitude is only the noise minimum.
+    ///
+    /// The engine is experimental. Sums are accumulated in double precision:
+    /// the SIMD and scalar paths give the same results on the synthetic
+    /// pulses of snfee-calo-kernel-bench. The *_TOLERANCE constants bound
+    /// the algorithmic differences with the snfee computers; the bench
+    /// reports the worst deviations from do_measurements on its synthetic
+    /// pulses and fails when a channel is out of tolerance, and
+    /// measurement_comparison checks them at run time on real data.
+    struct measurement_engine
+    {
+      static constexpr double BASELINE_TOLERANCE_MV = 0.1;   ///< Baseline tolerance (mV)
+      static constexpr double PEAK_TOLERANCE_MV     = 0.2;   ///< Peak amplitude tolerance (mV)
+      static constexpr double CHARGE_TOLERANCE      = 0.01;  ///< Relative charge tolerance
+      static constexpr double CHARGE_TOLERANCE_NVS  = 0.005; ///< Absolute charge tolerance (nV.s)
+
+      /// \brief Configuration parameters
+      struct config_type
+      {
+        /// Measurement engine ("snfee" or "simd")
+        std::string engine = "snfee";
+
+        // Baseline computer:
+        double baseline_min_width_time_ns = 50.0;
+        int    baseline_block_size        = 15;
+        double baseline_nsigmas           = 5.0;
+
+        // Peak searcher:
+        double peak_threshold_mV = -4.0;
+        int    peak_block_size   = 4;
+
+        // CFD computer:
+        double      cfd_fraction  = 0.4;
+        int         cfd_max_scope = 3;
+        std::string cfd_mode      = "linear_interpolation";
+
+        // Charge computer:
+        double charge_pre_cfd_time_ns = 10.0;
+        double charge_width_ns        = 300.0;
+
+        /// Parse a calo analysis configuration file
+        void parse(const std::string & path_);
+
+        /// Set the parameters from a calo analysis configuration
+        void configure(const datatools::properties & config_);
+
+        /// Check if the SIMD engine is selected
+        bool use_simd() const;
+      };
+
+      /// \brief Measurements on a waveform
+      struct result_type
+      {
+        float    baseline_mV       = 0.0f;  ///< Baseline (mV)
+        float    baseline_sigma_mV = 0.0f;  ///< Baseline RMS (mV)
+        bool     has_peak          = false; ///< Peak above threshold
+        uint16_t peak_cell         = 0;     ///< Sample of the peak
+        float    peak_amplitude_mV = 0.0f;  ///< Peak amplitude, baseline subtracted (mV)
+        float    peak_time_ns      = 0.0f;  ///< Peak time (ns)
+        float    cfd_time_ns       = 0.0f;  ///< CFD time (ns, NaN without peak)
+        float    charge_nVs        = 0.0f;  ///< Charge (nV.s, NaN without peak)
+      };
+
+      /// Constructor
+      measurement_engine(const config_type & cfg_,
+                         const simd_level_type simd_level_ = detect_simd_level());
+
+      /// Measure a waveform
+      void measure(const float * amplitudes_mV_,
+                   const std::size_t nsamples_,
+                   const float tdc_to_ns_,
+                   result_type & result_) const;
+
+      /// Return the configuration
+      const config_type & get_config() const;
+
+    private:
+
+      config_type     _config_;
+      simd_level_type _simd_level_ = SIMD_NONE;
+
+    };
+
+    /// \brief Comparison of the SIMD engine with the snfee measurements
+    struct measurement_comparison
+    {
+      /// Compare the measurements on a channel
+      void compare(const measurement_engine::result_type & result_,
+                   const snfee::data::calo_waveform_info & reference_);
+
+      /// Add the counters of another comparison
+      void merge(const measurement_comparison & other_);
+
+      /// Print the comparison report
+      void print_report(std::ostream & out_) const;
+
+      std::size_t number_of_channels = 0;   ///< Number of compared channels
+      std::size_t number_of_outliers = 0;   ///< Number of channels out of tolerance
+      double max_baseline_diff_mV    = 0.0; ///< Maximum baseline deviation (mV)
+      double max_peak_diff_mV        = 0.0; ///< Maximum peak amplitude deviation (mV)
+      double max_charge_diff_nVs     = 0.0; ///< Maximum charge deviation (nV.s)
+    };
+
+  } // namespace calo
+} // namespace snfee
+
+#endif // CALO_MEASUREMENT_ENGINE_H
+
+// Local Variables: --
+// mode: c++ --
+// c-file-style: "gnu" --
+// tab-width: 2 --
+// End: --
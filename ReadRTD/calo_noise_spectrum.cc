@@ -0,0 +1,230 @@
+// Ourselves:
+#include "calo_noise_spectrum.h"
+
+// Standard library:
+#include <algorithm>
+#include <cmath>
+
+// Third party:
+// - Bayeux:
+#include <bayeux/datatools/exception.h>
+
+// This example:
+#include "calo_channel_index.h"
+#include "calo_histogramming.h"
+
+namespace snfee {
+  namespace calo {
+
+    namespace {
+
+      typedef noise_spectrum::fixed_sum_type fixed_sum_type;
+
+      /// Add the squared moduli of half-complex Fourier coefficients
+      template <typename T>
+      void add_squared_moduli(const T * coefs_, const std::size_t n_, fixed_sum_type * sums_)
+      {
+        sums_[0] += noise_spectrum::to_fixed((double) coefs_[0] * coefs_[0]);
+        for (std::size_t k = 1; 2 * k < n_; k++) {
+          sums_[k] += noise_spectrum::to_fixed((double) coefs_[2 * k - 1] * coefs_[2 * k - 1] + (double) coefs_[2 * k] * coefs_[2 * k]);
+        }
+        if (n_ % 2 == 0) {
+          sums_[n_ / 2] += noise_spectrum::to_fixed((double) coefs_[n_ - 1] * coefs_[n_ - 1]);
+        }
+        return;
+      }
+
+    }
+
+    void noise_spectrum::config_type::parse(const std::string & path_)
+    {
+      datatools::properties config;
+      datatools::properties::read_config(path_, config);
+      configure(config);
+      return;
+    }
+
+    void noise_spectrum::config_type::configure(const datatools::properties & config_)
+    {
+      if (config_.has_key("noise_spectrum.segment_samples")) {
+        segment_samples = config_.fetch_integer("noise_spectrum.segment_samples");
+      }
+      if (config_.has_key("noise_spectrum.segment_step")) {
+        segment_step = config_.fetch_integer("noise_spectrum.segment_step");
+      }
+      if (config_.has_key("noise_spectrum.pretrigger_samples")) {
+        pretrigger_samples = config_.fetch_integer("noise_spectrum.pretrigger_samples");
+      }
+      if (config_.has_key("noise_spectrum.batch_size")) {
+        batch_size = config_.fetch_integer("noise_spectrum.batch_size");
+      }
+      if (config_.has_key("noise_spectrum.single_precision")) {
+        single_precision = config_.fetch_boolean("noise_spectrum.single_precision");
+      }
+      return;
+    }
+
+    noise_spectrum::noise_spectrum(const config_type & cfg_)
+      : _config_(cfg_)
+      , _fft_(snfee::algo::calo_waveform_fft::config_type())
+    {
+      DT_THROW_IF(_config_.segment_samples < 2, std::logic_error,
+                  "Invalid number of samples per noise segment (" << _config_.segment_samples << ")!");
+      DT_THROW_IF(_config_.segment_step == 0, std::logic_error, "Invalid noise segment step!");
+      DT_THROW_IF(_config_.batch_size == 0, std::logic_error, "Invalid noise segment batch size!");
+      const std::size_t n = _config_.segment_samples;
+      _nfreqs_ = n / 2 + 1;
+      _window_.resize(n);
+      for (std::size_t i = 0; i < n; i++) {
+        _window_[i] = 0.5 * (1.0 - std::cos(2.0 * M_PI * i / n));
+        _window_power_ += _window_[i] * _window_[i];
+      }
+      if (_config_.single_precision) {
+        _rows_float_.resize(_config_.batch_size * n);
+      } else {
+        _rows_.resize(_config_.batch_size * n);
+      }
+      _row_channels_.resize(_config_.batch_size);
+      _sums_.resize(NUMBER_OF_CHANNEL_INDEXES);
+      _counts_.assign(NUMBER_OF_CHANNEL_INDEXES, 0);
+      _fft_.initialize();
+      return;
+    }
+
+    const noise_spectrum::config_type & noise_spectrum::get_config() const
+    {
+      return _config_;
+    }
+
+    std::size_t noise_spectrum::get_number_of_frequencies() const
+    {
+      return _nfreqs_;
+    }
+
+    void noise_spectrum::accumulate(const uint16_t channel_index_,
+                                    const uint16_t * samples_,
+                                    const std::size_t nsamples_,
+                                    const waveform_conversion & conversion_)
+    {
+      DT_THROW_IF(channel_index_ >= NUMBER_OF_CHANNEL_INDEXES, std::range_error,
+                  "Invalid channel index " << channel_index_ << "!");
+      _tdc_to_ns_ = conversion_.tdc_to_ns;
+      std::size_t nsamples = nsamples_;
+      if (_config_.pretrigger_samples > 0 and _config_.pretrigger_samples < nsamples) {
+        nsamples = _config_.pretrigger_samples;
+      }
+      const std::size_t n = _config_.segment_samples;
+      for (std::size_t first = 0; first + n <= nsamples; first += _config_.segment_step) {
+        const uint16_t * segment = samples_ + first;
+        // The mean is subtracted, so that the ADC zero does not matter:
+        double mean = 0.0;
+        for (std::size_t i = 0; i < n; i++) {
+          mean += segment[i];
+        }
+        mean /= n;
+        if (_config_.single_precision) {
+          float * row = &_rows_float_[_nrows_ * n];
+          for (std::size_t i = 0; i < n; i++) {
+            row[i] = (segment[i] - mean) * conversion_.adc_to_mV * _window_[i];
+          }
+        } else {
+          double * row = &_rows_[_nrows_ * n];
+          for (std::size_t i = 0; i < n; i++) {
+            row[i] = (segment[i] - mean) * conversion_.adc_to_mV * _window_[i];
+          }
+        }
+        _row_channels_[_nrows_] = channel_index_;
+        if (++_nrows_ == _config_.batch_size) {
+          flush();
+        }
+      }
+      return;
+    }
+
+    void noise_spectrum::flush()
+    {
+      if (_nrows_ == 0) return;
+      const std::size_t n = _config_.segment_samples;
+      if (_config_.single_precision) {
+        _fft_.transform_rows(_rows_float_.data(), n, _nrows_);
+      } else {
+        _fft_.transform_rows(_rows_.data(), n, _nrows_);
+      }
+      for (std::size_t row = 0; row < _nrows_; row++) {
+        std::vector<fixed_sum_type> & sums = _sums_[_row_channels_[row]];
+        if (sums.empty()) {
+          sums.assign(_nfreqs_, 0);
+        }
+        if (_config_.single_precision) {
+          add_squared_moduli(&_rows_float_[row * n], n, sums.data());
+        } else {
+          add_squared_moduli(&_rows_[row * n], n, sums.data());
+        }
+        _counts_[_row_channels_[row]]++;
+      }
+      _nrows_ = 0;
+      return;
+    }
+
+    void noise_spectrum::merge(const noise_spectrum & other_)
+    {
+      DT_THROW_IF(other_._config_.segment_samples != _config_.segment_samples,
+                  std::logic_error,
+                  "Cannot merge noise spectra with different segments!");
+      DT_THROW_IF(other_._nrows_ > 0, std::logic_error, "Merged noise spectra are not flushed!");
+      if (_tdc_to_ns_ == 0.0) {
+        _tdc_to_ns_ = other_._tdc_to_ns_;
+      }
+      for (std::size_t index = 0; index < NUMBER_OF_CHANNEL_INDEXES; index++) {
+        if (other_._counts_[index] == 0) continue;
+        std::vector<fixed_sum_type> & sums = _sums_[index];
+        if (sums.empty()) {
+          sums.assign(_nfreqs_, 0);
+        }
+        for (std::size_t k = 0; k < _nfreqs_; k++) {
+          sums[k] += other_._sums_[index][k];
+        }
+        _counts_[index] += other_._counts_[index];
+      }
+      return;
+    }
+
+    std::size_t noise_spectrum::get_number_of_segments(const uint16_t channel_index_) const
+    {
+      DT_THROW_IF(channel_index_ >= NUMBER_OF_CHANNEL_INDEXES, std::range_error,
+                  "Invalid channel index " << channel_index_ << "!");
+      return _counts_[channel_index_];
+    }
+
+    double noise_spectrum::compute_density(const uint16_t channel_index_, std::vector<double> & psd_) const
+    {
+      const std::size_t nsegments = get_number_of_segments(channel_index_);
+      const std::size_t n = _config_.segment_samples;
+      const double frequency_step = 1.0 / (n * _tdc_to_ns_);
+      psd_.assign(_nfreqs_, 0.0);
+      if (nsegments == 0) return frequency_step;
+      // One-sided density: the negative frequencies are folded, except DC and Nyquist:
+      const double sampling_frequency = 1.0 / _tdc_to_ns_;
+      const double norm = 1.0 / (nsegments * sampling_frequency * _window_power_);
+      const std::vector<fixed_sum_type> & sums = _sums_[channel_index_];
+      for (std::size_t k = 0; k < _nfreqs_; k++) {
+        double fold = (k == 0 or 2 * k == n) ? 1.0 : 2.0;
+        psd_[k] = fold * norm * from_fixed(sums[k]);
+      }
+      return frequency_step;
+    }
+
+    void noise_spectrum::store(histogramming & histos_)
+    {
+      flush();
+      std::vector<double> psd;
+      for (std::size_t index = 0; index < NUMBER_OF_CHANNEL_INDEXES; index++) {
+        if (_counts_[index] == 0) continue;
+        double frequency_step = compute_density(index, psd);
+        histos_.store_spectrum(channel_index_to_id(index).to_string(), "noise_psd", frequency_step, psd);
+      }
+      return;
+    }
+
+  } // namespace calo
+} // namespace snfee
@@ -0,0 +1,139 @@
+#ifndef CALO_NOISE_SPECTRUM_H
+#define CALO_NOISE_SPECTRUM_H
+
+// Standard library:
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Third party:
+// - Bayeux:
+#include <bayeux/datatools/properties.h>
+
+// This example:
+#include "calo_waveform_fft.h"
+#include "calo_waveform_kernels.h"
+
+namespace snfee {
+  namespace calo {
+
+    struct histogramming;
+
+    /// \brief Averaged noise power spectral density of the calo channels
+    ///
+    /// Welch method: the waveforms are cut in overlapping segments, the
+    /// mean of each segment is subtracted and a Hann window is applied.
+    /// The segments are gathered in rows and transformed by batches with
+    /// the same FFT plan, then the squared moduli of the coefficients are
+    /// summed per channel, in fixed point (2^-32 mV^2 units, 128-bit): the
+    /// sums are exact, so that the merged spectra do not depend on the
+    /// distribution of the records among the accumulators nor on the merge
+    /// order. The one-sided density (mV^2/GHz) is the average
+    /// over all the segments of a channel. Only the leading pre-trigger
+    /// samples can be used, to exclude the pulses. The segments can be
+    /// transformed in single precision. The parameters are read
+    /// from the 'noise_spectrum.*' keys of the calo analysis configuration
+    /// file.
+    struct noise_spectrum
+    {
+      /// Fixed point sum of squared moduli (2^-32 mV^2 units)
+      __extension__ typedef unsigned __int128 fixed_sum_type;
+
+      /// Convert a squared modulus (mV^2) to fixed point, rounded to the nearest unit
+      static fixed_sum_type to_fixed(const double value_);
+
+      /// Convert a fixed point sum to mV^2
+      static double from_fixed(const fixed_sum_type sum_);
+
+      /// \brief Configuration parameters
+      struct config_type
+      {
+        uint16_t segment_samples    = 256; ///< Number of samples per segment
+        uint16_t segment_step       = 128; ///< Number of samples between two segments
+        uint16_t pretrigger_samples = 0;   ///< Number of leading samples used (0: whole waveform)
+        uint16_t batch_size         = 64;  ///< Number of segments transformed at once
+        bool     single_precision   = false; ///< Single precision transforms
+
+        /// Parse a calo analysis configuration file
+        void parse(const std::string & path_);
+
+        /// Set the parameters from a calo analysis configuration
+        void configure(const datatools::properties & config_);
+      };
+
+      /// Constructor
+      noise_spectrum(const config_type & cfg_);
+
+      /// Return the configuration
+      const config_type & get_config() const;
+
+      /// Return the number of frequencies of the spectra (segment_samples/2+1)
+      std::size_t get_number_of_frequencies() const;
+
+      /// Add the segments of the ADC samples of a channel
+      void accumulate(const uint16_t channel_index_,
+                      const uint16_t * samples_,
+                      const std::size_t nsamples_,
+                      const waveform_conversion & conversion_);
+
+      /// Transform the pending segments
+      void flush();
+
+      /// Add the spectra of another accumulator (same configuration, flushed)
+      void merge(const noise_spectrum & other_);
+
+      /// Return the number of segments of a channel
+      std::size_t get_number_of_segments(const uint16_t channel_index_) const;
+
+      /// Compute the averaged spectral density of a channel (mV^2/GHz), returns the frequency step (GHz)
+      double compute_density(const uint16_t channel_index_, std::vector<double> & psd_) const;
+
+      /// Store the spectral densities of all channels as histograms
+      void store(histogramming & histos_);
+
+    private:
+
+      config_type _config_;
+      std::size_t _nfreqs_ = 0;               ///< Number of frequencies
+      std::vector<double> _window_;           ///< Hann window
+      double _window_power_ = 0.0;            ///< Sum of the squared window
+      double _tdc_to_ns_ = 0.0;               ///< Sampling period of the accumulated segments
+      snfee::algo::calo_waveform_fft _fft_;   ///< FFT plans
+      std::vector<double> _rows_;             ///< Pending segments (batch_size rows)
+      std::vector<float> _rows_float_;        ///< Pending segments in single precision mode
+      std::vector<uint16_t> _row_channels_;   ///< Channel index of the pending segments
+      std::size_t _nrows_ = 0;                ///< Number of pending segments
+      std::vector<std::vector<fixed_sum_type>> _sums_; ///< Sums of the squared moduli per channel index
+      std::vector<std::size_t> _counts_;      ///< Number of segments per channel index
+
+    };
+
+    inline noise_spectrum::fixed_sum_type noise_spectrum::to_fixed(const double value_)
+    {
+      if (!(value_ > 0.0)) return 0;
+      // Squared moduli of 12-bit ADC segments are far below 2^64 mV^2:
+      const double value = std::min(value_, 1.8e19);
+      const uint64_t integral = (uint64_t) value;
+      const uint64_t fraction = (uint64_t) ((value - integral) * 4294967296.0 + 0.5);
+      return ((fixed_sum_type) integral << 32) + fraction;
+    }
+
+    inline double noise_spectrum::from_fixed(const fixed_sum_type sum_)
+    {
+      // Integral part (mV^2) plus the 32-bit fraction:
+      return (double) (uint64_t) (sum_ >> 32)
+        + (double) (uint64_t) (sum_ & 0xFFFFFFFFu) / 4294967296.0;
+    }
+
+  } // namespace calo
+} // namespace snfee
+
+#endif // CALO_NOISE_SPECTRUM_H
+
+// Local Variables: --
+// mode: c++ --
+// c-file-style: "gnu" --
+// tab-width: 2 --
+// End: --
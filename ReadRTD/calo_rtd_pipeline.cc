@@ -0,0 +1,292 @@
+// Ourselves:
+#include "calo_rtd_pipeline.h"
+
+// Standard library:
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Third party:
+// - Bayeux:
+#include <bayeux/datatools/exception.h>
+
+namespace snfee {
+  namespace calo {
+
+    rtd_pipeline::rtd_pipeline(const config_type & cfg_,
+                               const datatools::logger::priority logging_)
+    {
+      logging = logging_;
+      _config_ = cfg_;
+      DT_THROW_IF(_config_.number_of_workers == 0, std::logic_error, "Invalid number of workers!");
+      DT_THROW_IF(_config_.queue_capacity == 0, std::logic_error, "Invalid queue capacity!");
+      DT_THROW_IF(_config_.batch_size == 0, std::logic_error, "Invalid batch size!");
+      if (_config_.queue_capacity < _config_.batch_size) {
+        // A whole batch must fit in the queue:
+        DT_LOG_NOTICE(logging, "Queue capacity raised to the batch size ("
+                      << _config_.batch_size << " RTD records)");
+        _config_.queue_capacity = _config_.batch_size;
+      }
+      return;
+    }
+
+    std::size_t rtd_pipeline::run(rtd_prefetch_reader & reader_,
+                                  const work_function_type & work_,
+                                  const filter_function_type & filter_,
+                                  const sync_request_function_type & sync_request_,
+                                  const sync_function_type & sync_)
+    {
+      typedef rtd_prefetch_reader::rtd_ptr_type rtd_ptr_type;
+
+      std::mutex mutex;
+      std::condition_variable not_empty;  // Signaled when a record is queued or at end of input
+      std::condition_variable not_full;   // Signaled when a record has been popped by a worker
+      std::condition_variable idle;       // Signaled when the queue is drained and the workers are idle
+      std::size_t busy = 0;               // Number of workers processing a record
+      std::deque<rtd_ptr_type> queue;     // Loaded records waiting for a worker
+      std::vector<rtd_ptr_type> recycled; // Processed records available for the next loads
+      bool done = false;                  // No more record will be queued
+      std::exception_ptr error;           // First exception thrown by a worker
+
+      auto worker = [&](const std::size_t worker_index_) {
+        while (true) {
+          rtd_ptr_type p_rtd;
+          {
+            std::unique_lock<std::mutex> lock(mutex);
+            not_empty.wait(lock, [&] { return !queue.empty() or done; });
+            if (queue.empty()) break;
+            p_rtd = queue.front();
+            queue.pop_front();
+            busy++;
+          }
+          not_full.notify_one();
+          try {
+            work_(worker_index_, *p_rtd);
+          } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!error) error = std::current_exception();
+            busy--;
+            done = true;
+            queue.clear();
+            not_full.notify_all();
+            not_empty.notify_all();
+            idle.notify_all();
+            break;
+          }
+          std::lock_guard<std::mutex> lock(mutex);
+          recycled.push_back(p_rtd);
+          if (--busy == 0 and queue.empty()) {
+            idle.notify_all();
+          }
+        }
+        return;
+      };
+
+      std::vector<std::thread> workers;
+      for (std::size_t iworker = 0; iworker < _config_.number_of_workers; iworker++) {
+        workers.push_back(std::thread(worker, iworker));
+      }
+
+      // The calling thread is the reader:
+      std::size_t rtd_counter = 0;
+      std::vector<rtd_ptr_type> batch;    // Records loaded at once
+      std::vector<rtd_ptr_type> accepted; // Loaded records handed to the workers
+      std::vector<rtd_ptr_type> rejected; // Loaded records rejected by the filter
+      try {
+        while (true) {
+
+          std::size_t batch_size = _config_.batch_size;
+          if (_config_.max_rtd > 0) {
+            batch_size = std::min<std::size_t>(batch_size, _config_.max_rtd - rtd_counter);
+          }
+
+          // Wait for room for the whole batch, hand the processed records back to the reader:
+          {
+            std::unique_lock<std::mutex> lock(mutex);
+            not_full.wait(lock, [&] { return queue.size() + batch_size <= _config_.queue_capacity or done; });
+            if (done) break;
+            batch.insert(batch.end(), recycled.begin(), recycled.end());
+            recycled.clear();
+          }
+
+          // Load the next RTD objects:
+          std::size_t loaded = 0;
+          {
+            stage_timing::scope timed(timing, stage_timing::STAGE_LOAD);
+            loaded = reader_.load_batch(batch, batch_size);
+          }
+          if (loaded == 0) break;
+          accepted.clear();
+          rejected.clear();
+          for (auto & p_rtd : batch) {
+            if (filter_ and !filter_(*p_rtd)) {
+              // Rejected record:
+              rejected.push_back(p_rtd);
+            } else {
+              accepted.push_back(p_rtd);
+            }
+            rtd_counter++;
+            if (rtd_counter % 500 == 0) {
+              std::clog << "Number of read RTD objects: " << rtd_counter << std::endl;
+            }
+          }
+          batch.clear();
+          {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.insert(queue.end(), accepted.begin(), accepted.end());
+            recycled.insert(recycled.end(), rejected.begin(), rejected.end());
+          }
+          if (accepted.size() == 1) {
+            not_empty.notify_one();
+          } else if (accepted.size() > 1) {
+            not_empty.notify_all();
+          }
+
+          if (_config_.max_rtd > 0 and rtd_counter == _config_.max_rtd) {
+            break;
+          }
+
+          // Synchronize the workers on request:
+          if (sync_ and sync_request_ and sync_request_(rtd_counter)) {
+            {
+              std::unique_lock<std::mutex> lock(mutex);
+              idle.wait(lock, [&] { return (queue.empty() and busy == 0) or done; });
+              if (done) break;
+            }
+            // The workers wait for the next records meanwhile:
+            sync_(rtd_counter);
+          }
+        }
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!error) error = std::current_exception();
+        queue.clear();
+      }
+
+      // Let the workers drain the queue:
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        done = true;
+      }
+      not_empty.notify_all();
+      for (auto & w : workers) {
+        w.join();
+      }
+      if (error) {
+        std::rethrow_exception(error);
+      }
+      DT_LOG_DEBUG(logging, "Pipeline processed " << rtd_counter << " RTD records with "
+                   << _config_.number_of_workers << " workers.");
+      return rtd_counter;
+    }
+
+    std::size_t rtd_pipeline::run_parts(const rtd_prefetch_reader::config_type & reader_cfg_,
+                                        const work_function_type & work_,
+                                        const filter_function_type & filter_)
+    {
+      DT_THROW_IF(_config_.max_rtd > 0 or reader_cfg_.first_record > 0, std::logic_error,
+                  "RTD record range is not supported when processing parts concurrently!");
+      std::vector<stage_timing> worker_timings(_config_.number_of_workers);
+      std::atomic<std::size_t> next_part(0);
+      std::atomic<std::size_t> rtd_counter(0);
+      std::atomic<bool> failed(false);
+      std::mutex mutex;
+      std::exception_ptr error;
+
+      auto worker = [&](const std::size_t worker_index_) {
+        try {
+          while (!failed) {
+            std::size_t part_index = next_part++;
+            if (part_index >= reader_cfg_.filenames.size()) break;
+            DT_LOG_DEBUG(logging, "Worker #" << worker_index_ << " processes part '"
+                         << reader_cfg_.filenames[part_index] << "'...");
+            rtd_prefetch_reader::config_type part_reader_cfg = reader_cfg_;
+            part_reader_cfg.filenames = { reader_cfg_.filenames[part_index] };
+            rtd_prefetch_reader part_reader(part_reader_cfg, logging);
+            rtd_prefetch_reader::rtd_ptr_type p_rtd;
+            stage_timing * worker_timing = timing ? &worker_timings[worker_index_] : nullptr;
+            while (!failed) {
+              {
+                stage_timing::scope timed(worker_timing, stage_timing::STAGE_LOAD);
+                if (!part_reader.load(p_rtd)) break;
+              }
+              if (!filter_ or filter_(*p_rtd)) {
+                work_(worker_index_, *p_rtd);
+              }
+              std::size_t count = ++rtd_counter;
+              if (count % 500 == 0) {
+                std::lock_guard<std::mutex> lock(mutex);
+                std::clog << "Number of read RTD objects: " << count << std::endl;
+              }
+            }
+          }
+        } catch (...) {
+          std::lock_guard<std::mutex> lock(mutex);
+          if (!error) error = std::current_exception();
+          failed = true;
+        }
+        return;
+      };
+
+      std::vector<std::thread> workers;
+      for (std::size_t iworker = 0; iworker < _config_.number_of_workers; iworker++) {
+        workers.push_back(std::thread(worker, iworker));
+      }
+      for (auto & w : workers) {
+        w.join();
+      }
+      if (error) {
+        std::rethrow_exception(error);
+      }
+      if (timing) {
+        for (const auto & worker_timing : worker_timings) {
+          timing->merge(worker_timing);
+        }
+      }
+      return rtd_counter;
+    }
+
+    void rtd_pipeline::run_tasks(const std::size_t number_of_tasks_,
+                                 const task_function_type & task_)
+    {
+      std::atomic<std::size_t> next_task(0);
+      std::atomic<bool> failed(false);
+      std::mutex mutex;
+      std::exception_ptr error;
+
+      auto worker = [&](const std::size_t worker_index_) {
+        try {
+          while (!failed) {
+            std::size_t task_index = next_task++;
+            if (task_index >= number_of_tasks_) break;
+            task_(worker_index_, task_index);
+          }
+        } catch (...) {
+          std::lock_guard<std::mutex> lock(mutex);
+          if (!error) error = std::current_exception();
+          failed = true;
+        }
+        return;
+      };
+
+      std::vector<std::thread> workers;
+      for (std::size_t iworker = 0; iworker < _config_.number_of_workers; iworker++) {
+        workers.push_back(std::thread(worker, iworker));
+      }
+      for (auto & w : workers) {
+        w.join();
+      }
+      if (error) {
+        std::rethrow_exception(error);
+      }
+      return;
+    }
+
+  } // namespace calo
+} // namespace snfee
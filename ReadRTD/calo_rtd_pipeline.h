@@ -0,0 +1,118 @@
+#ifndef CALO_RTD_PIPELINE_H
+#define CALO_RTD_PIPELINE_H
+
+// Standard library:
+#include <cstdint>
+#include <functional>
+
+// Third party:
+// - Bayeux:
+#include <bayeux/datatools/logger.h>
+
+// This project:
+#include <snfee/data/raw_trigger_data.h>
+
+// This example:
+#include "rtd_prefetch_reader.h"
+#include "calo_stage_timing.h"
+
+namespace snfee {
+  namespace calo {
+
+    /// \brief Reader/worker pipeline for RTD records
+    ///
+    /// The calling thread fetches the RTD records from the reader
+    /// and pushes them in a bounded queue. A pool of worker threads pops
+    /// the records and hands them to the work function, together with the
+    /// index of the worker. Records are thus processed out of order.
+    /// Records rejected by the optional filter are dropped by the reader
+    /// and never reach the workers.
+    ///
+    /// The reader can synchronize the workers between two batches: it
+    /// waits until the queue is drained and all the workers are idle, so
+    /// that all the records read so far are processed, then calls the sync
+    /// function (checkpoints, periodic outputs) before going on.
+    ///
+    /// Alternatively, the input file parts, or any set of independent tasks
+    /// such as the blocks of a columnar store, can be distributed to the
+    /// workers.
+    struct rtd_pipeline
+    {
+
+      /// \brief Configuration parameters
+      struct config_type
+      {
+        /// Number of worker threads
+        std::size_t number_of_workers = 2;
+
+        /// Maximum number of loaded RTD records waiting for a worker
+        ///
+        /// A batch is only loaded when it fits in the queue; the capacity is
+        /// raised to the batch size if it is smaller.
+        std::size_t queue_capacity = 64;
+
+        /// Maximum number of RTD records to be read
+        uint32_t max_rtd = 0;
+
+        /// Number of RTD records fetched from the reader at once
+        std::size_t batch_size = 16;
+      };
+
+      /// Work function called by worker threads on each record
+      typedef std::function<void(const std::size_t worker_index_,
+                                 const snfee::data::raw_trigger_data & rtd_)> work_function_type;
+
+      /// Task function called by worker threads on each task index
+      typedef std::function<void(const std::size_t worker_index_,
+                                 const std::size_t task_index_)> task_function_type;
+
+      /// Filter function called on each record before it is handed to a worker
+      typedef std::function<bool(const snfee::data::raw_trigger_data & rtd_)> filter_function_type;
+
+      /// Function called by the reader after each batch, returns true to synchronize the workers
+      typedef std::function<bool(const std::size_t rtd_counter_)> sync_request_function_type;
+
+      /// Function called by the reader while the workers are idle, once the read records are processed
+      typedef std::function<void(const std::size_t rtd_counter_)> sync_function_type;
+
+      /// Constructor
+      rtd_pipeline(const config_type & cfg_,
+                   const datatools::logger::priority logging_ = datatools::logger::PRIO_FATAL);
+
+      /// Run the pipeline until the reader is exhausted, returns the number of read RTD records
+      std::size_t run(rtd_prefetch_reader & reader_,
+                      const work_function_type & work_,
+                      const filter_function_type & filter_ = filter_function_type(),
+                      const sync_request_function_type & sync_request_ = sync_request_function_type(),
+                      const sync_function_type & sync_ = sync_function_type());
+
+      /// Process the input file parts concurrently, one part per worker at a time,
+      /// returns the number of read RTD records
+      std::size_t run_parts(const rtd_prefetch_reader::config_type & reader_cfg_,
+                            const work_function_type & work_,
+                            const filter_function_type & filter_ = filter_function_type());
+
+      /// Run independent tasks numbered [0, number_of_tasks_) on the workers,
+      /// each worker taking the next available task
+      void run_tasks(const std::size_t number_of_tasks_,
+                     const task_function_type & task_);
+
+      datatools::logger::priority logging = datatools::logger::PRIO_FATAL; ///< Logging priority threshold
+      stage_timing * timing = nullptr; ///< Timing of the record loads (not owned)
+
+    private:
+
+      config_type _config_;
+
+    };
+
+  } // namespace calo
+} // namespace snfee
+
+#endif // CALO_RTD_PIPELINE_H
+
+// Local Variables: --
+// mode: c++ --
+// c-file-style: "gnu" --
+// tab-width: 2 --
+// End: --
@@ -0,0 +1,156 @@
+// Ourselves:
+#include "calo_sparse_histogram.h"
+
+// Standard library:
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <limits>
+
+// Third party:
+// - ROOT:
+#include <TH2D.h>
+// - Bayeux:
+#include <bayeux/datatools/exception.h>
+
+namespace snfee {
+  namespace calo {
+
+    namespace {
+
+      /// Compute the bin edges of a uniform binning, as GSL does
+      void make_uniform_ranges(const std::size_t n_, const double min_, const double max_,
+                               std::vector<double> & ranges_)
+      {
+        ranges_.resize(n_ + 1);
+        for (std::size_t i = 0; i <= n_; i++) {
+          ranges_[i] = min_ + ((double) i / (double) n_) * (max_ - min_);
+        }
+        return;
+      }
+
+    }
+
+    void sparse_histogram_2d::initialize(const std::size_t nx_, const double xmin_, const double xmax_,
+                                         const std::size_t ny_, const double ymin_, const double ymax_)
+    {
+      DT_THROW_IF(nx_ == 0 or ny_ == 0, std::logic_error, "Invalid number of bins!");
+      DT_THROW_IF(!(xmin_ < xmax_) or !(ymin_ < ymax_), std::logic_error, "Invalid histogram range!");
+      DT_THROW_IF((nx_ + 2) * (ny_ + 2) > std::numeric_limits<uint32_t>::max(),
+                  std::logic_error, "Too many bins for a sparse histogram!");
+      make_uniform_ranges(nx_, xmin_, xmax_, _xranges_);
+      make_uniform_ranges(ny_, ymin_, ymax_, _yranges_);
+      _counts_.clear();
+      _invalid_ = 0;
+      _entries_ = 0;
+      return;
+    }
+
+    bool sparse_histogram_2d::is_initialized() const
+    {
+      return !_xranges_.empty();
+    }
+
+    // static
+    uint32_t sparse_histogram_2d::_find_cell_(const std::vector<double> & ranges_, const double v_)
+    {
+      const std::size_t n = ranges_.size() - 1;
+      if (v_ < ranges_.front()) return 0;
+      if (v_ >= ranges_.back()) return n + 1;
+      // Linear guess, then search among the edges:
+      std::size_t i = (std::size_t) ((v_ - ranges_.front()) / (ranges_.back() - ranges_.front()) * n);
+      if (i >= n or v_ < ranges_[i] or v_ >= ranges_[i + 1]) {
+        i = std::upper_bound(ranges_.begin(), ranges_.end(), v_) - ranges_.begin() - 1;
+      }
+      return i + 1;
+    }
+
+    void sparse_histogram_2d::fill(const double x_, const double y_)
+    {
+      _entries_++;
+      if (std::isnan(x_) or std::isnan(y_)) {
+        _invalid_++;
+        return;
+      }
+      const uint32_t cell = _find_cell_(_xranges_, x_) * (_yranges_.size() + 1) + _find_cell_(_yranges_, y_);
+      _counts_[cell]++;
+      return;
+    }
+
+    void sparse_histogram_2d::add(const sparse_histogram_2d & other_)
+    {
+      DT_THROW_IF(other_._xranges_ != _xranges_ or other_._yranges_ != _yranges_,
+                  std::logic_error,
+                  "Cannot add sparse histograms with different binnings!");
+      for (const auto & cell_count : other_._counts_) {
+        _counts_[cell_count.first] += cell_count.second;
+      }
+      _invalid_ += other_._invalid_;
+      _entries_ += other_._entries_;
+      return;
+    }
+
+    std::size_t sparse_histogram_2d::get_number_of_cells() const
+    {
+      return _counts_.size();
+    }
+
+    uint64_t sparse_histogram_2d::get_number_of_entries() const
+    {
+      return _entries_;
+    }
+
+    std::unique_ptr<TH2D> sparse_histogram_2d::make_root_histogram(const std::string & name_,
+                                                                   const std::string & title_) const
+    {
+      DT_THROW_IF(!is_initialized(), std::logic_error, "Sparse histogram is not initialized!");
+      std::unique_ptr<TH2D> h(new TH2D(name_.c_str(), title_.c_str(),
+                                       _xranges_.size() - 1, _xranges_.front(), _xranges_.back(),
+                                       _yranges_.size() - 1, _yranges_.front(), _yranges_.back()));
+      h->SetDirectory(nullptr);
+      // The cells follow the ROOT bin numbering (0: underflow, n+1: overflow):
+      const uint32_t ny_cells = _yranges_.size() + 1;
+      for (const auto & cell_count : _counts_) {
+        h->SetBinContent(cell_count.first / ny_cells, cell_count.first % ny_cells, cell_count.second);
+      }
+      h->SetEntries(_entries_);
+      return h;
+    }
+
+    void sparse_histogram_2d::store(std::ostream & out_) const
+    {
+      DT_THROW_IF(!is_initialized(), std::logic_error, "Sparse histogram is not initialized!");
+      out_ << std::setprecision(17);
+      out_ << _xranges_.size() - 1 << ' ' << _xranges_.front() << ' ' << _xranges_.back() << ' '
+           << _yranges_.size() - 1 << ' ' << _yranges_.front() << ' ' << _yranges_.back() << '\n';
+      out_ << _entries_ << ' ' << _invalid_ << ' ' << _counts_.size() << '\n';
+      std::vector<std::pair<uint32_t, uint32_t>> cells(_counts_.begin(), _counts_.end());
+      std::sort(cells.begin(), cells.end());
+      for (const auto & cell_count : cells) {
+        out_ << cell_count.first << ' ' << cell_count.second << '\n';
+      }
+      return;
+    }
+
+    void sparse_histogram_2d::load(std::istream & in_)
+    {
+      std::size_t nx = 0;
+      std::size_t ny = 0;
+      double xmin, xmax, ymin, ymax;
+      in_ >> nx >> xmin >> xmax >> ny >> ymin >> ymax;
+      DT_THROW_IF(!in_, std::runtime_error, "Cannot read the binning of a sparse histogram!");
+      initialize(nx, xmin, xmax, ny, ymin, ymax);
+      std::size_t ncells = 0;
+      in_ >> _entries_ >> _invalid_ >> ncells;
+      for (std::size_t icell = 0; icell < ncells and in_; icell++) {
+        uint32_t cell = 0;
+        uint32_t count = 0;
+        in_ >> cell >> count;
+        _counts_[cell] = count;
+      }
+      DT_THROW_IF(!in_, std::runtime_error, "Cannot read the counts of a sparse histogram!");
+      return;
+    }
+
+  } // namespace calo
+} // namespace snfee
@@ -0,0 +1,82 @@
+#ifndef CALO_SPARSE_HISTOGRAM_H
+#define CALO_SPARSE_HISTOGRAM_H
+
+// Standard library:
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Third party:
+// - ROOT:
+class TH2D;
+
+namespace snfee {
+  namespace calo {
+
+    /// \brief Sparse 2D-histogram with integer counts
+    ///
+    /// Only the non empty bins are stored, as 32-bit counts of unit weight
+    /// fills, so that a histogram with a narrow populated band (peak versus
+    /// charge) costs a few tens of bytes per filled bin instead of one
+    /// double per bin. The bins follow the GSL uniform binning convention
+    /// (bin i covers [x_i, x_i+1)). Out of range fills are counted in the
+    /// underflow/overflow cells around the grid and invalid (NaN) values
+    /// apart. A dense histogram is only built at export, one histogram at a
+    /// time.
+    struct sparse_histogram_2d
+    {
+      /// Set the binning (the histogram is reset)
+      void initialize(const std::size_t nx_, const double xmin_, const double xmax_,
+                      const std::size_t ny_, const double ymin_, const double ymax_);
+
+      /// Check if the histogram is initialized
+      bool is_initialized() const;
+
+      /// Add one entry
+      void fill(const double x_, const double y_);
+
+      /// Add the counts of another histogram (same binning)
+      void add(const sparse_histogram_2d & other_);
+
+      /// Return the number of stored cells (filled bins, underflows and overflows)
+      std::size_t get_number_of_cells() const;
+
+      /// Return the number of entries
+      uint64_t get_number_of_entries() const;
+
+      /// Build the equivalent dense ROOT histogram (bin counts, underflows and overflows, not attached to a directory)
+      std::unique_ptr<TH2D> make_root_histogram(const std::string & name_, const std::string & title_) const;
+
+      /// Write the binning and the counts (text, exact)
+      void store(std::ostream & out_) const;
+
+      /// Read the binning and the counts written by store
+      void load(std::istream & in_);
+
+    private:
+
+      /// Return the cell of a value along an axis: 0 (underflow), 1 to n (bins), n+1 (overflow)
+      static uint32_t _find_cell_(const std::vector<double> & ranges_, const double v_);
+
+      std::vector<double> _xranges_; ///< Bin edges along x (nx+1)
+      std::vector<double> _yranges_; ///< Bin edges along y (ny+1)
+      std::unordered_map<uint32_t, uint32_t> _counts_; ///< Counts per cell (x cell * (ny+2) + y cell)
+      uint64_t _invalid_ = 0;        ///< Number of entries with an invalid value
+      uint64_t _entries_ = 0;        ///< Number of entries
+
+    };
+
+  } // namespace calo
+} // namespace snfee
+
+#endif // CALO_SPARSE_HISTOGRAM_H
+
+// Local Variables: --
+// mode: c++ --
+// c-file-style: "gnu" --
+// tab-width: 2 --
+// End: --
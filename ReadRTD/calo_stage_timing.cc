@@ -0,0 +1,119 @@
+// Ourselves:
+#include "calo_stage_timing.h"
+
+// Standard library:
+#include <fstream>
+#include <iomanip>
+
+// Third party:
+// - Bayeux:
+#include <bayeux/datatools/exception.h>
+
+namespace snfee {
+  namespace calo {
+
+    // static
+    const char * stage_timing::stage_name(const stage_type stage_)
+    {
+      switch (stage_) {
+      case STAGE_LOAD          : return "load";
+      case STAGE_EXTRACT       : return "extract";
+      case STAGE_INIT          : return "init_from_raw_data";
+      case STAGE_MEASURE       : return "do_measurements";
+      case STAGE_FFT           : return "fft";
+      case STAGE_MEAN_WAVEFORM : return "process_waveform";
+      case STAGE_FILL          : return "fill";
+      default                  : break;
+      }
+      return "";
+    }
+
+    void stage_timing::start()
+    {
+      _start_time_  = std::chrono::steady_clock::now();
+      _start_ticks_ = now();
+      return;
+    }
+
+    void stage_timing::stop()
+    {
+      _stop_time_  = std::chrono::steady_clock::now();
+      _stop_ticks_ = now();
+      return;
+    }
+
+    void stage_timing::merge(const stage_timing & other_)
+    {
+      for (int istage = 0; istage < NUMBER_OF_STAGES; istage++) {
+        ticks[istage] += other_.ticks[istage];
+        calls[istage] += other_.calls[istage];
+      }
+      number_of_records  += other_.number_of_records;
+      number_of_hits     += other_.number_of_hits;
+      number_of_channels += other_.number_of_channels;
+      number_of_bytes    += other_.number_of_bytes;
+      return;
+    }
+
+    double stage_timing::get_wall_time() const
+    {
+      std::chrono::duration<double> elapsed = _stop_time_ - _start_time_;
+      return elapsed.count();
+    }
+
+    double stage_timing::get_stage_time(const stage_type stage_) const
+    {
+      if (_stop_ticks_ <= _start_ticks_) return 0.0;
+      return ticks[stage_] * get_wall_time() / (_stop_ticks_ - _start_ticks_);
+    }
+
+    void stage_timing::print_report(std::ostream & out_) const
+    {
+      double wall_time = get_wall_time();
+      // Restore the formatting flags, precision and width of the stream when done:
+      std::ios state(nullptr);
+      state.copyfmt(out_);
+      out_ << "Stage timing (summed over threads) :" << std::endl;
+      for (int istage = 0; istage < NUMBER_OF_STAGES; istage++) {
+        stage_type stage = static_cast<stage_type>(istage);
+        double stage_time = get_stage_time(stage);
+        out_ << "  " << std::left << std::setw(20) << stage_name(stage) << std::right
+             << " : " << std::fixed << std::setprecision(3) << std::setw(10) << stage_time << " s"
+             << "  (" << std::setw(5) << std::setprecision(1)
+             << (wall_time > 0.0 ? 100.0 * stage_time / wall_time : 0.0) << " % of wall time, "
+             << calls[istage] << " calls)" << std::endl;
+      }
+      out_ << std::setprecision(3);
+      out_ << "  Wall time            : " << wall_time << " s" << std::endl;
+      if (wall_time > 0.0) {
+        out_ << "  Records rate         : " << number_of_records / wall_time << " /s" << std::endl;
+        out_ << "  Calo hits rate       : " << number_of_hits / wall_time << " /s" << std::endl;
+        out_ << "  Channels rate        : " << number_of_channels / wall_time << " /s" << std::endl;
+        out_ << "  Input data rate      : " << number_of_bytes * 1e-6 / wall_time << " MB/s" << std::endl;
+      }
+      out_.copyfmt(state);
+      return;
+    }
+
+    void stage_timing::store(const std::string & path_) const
+    {
+      std::ofstream fout(path_);
+      DT_THROW_IF(!fout, std::runtime_error, "Cannot open timing file '" << path_ << "'!");
+      fout << "#@snfee.rtd_timing" << std::endl;
+      fout << std::setprecision(9);
+      fout << "wall_time=" << get_wall_time() << std::endl;
+      fout << "records=" << number_of_records << std::endl;
+      fout << "hits=" << number_of_hits << std::endl;
+      fout << "channels=" << number_of_channels << std::endl;
+      fout << "bytes=" << number_of_bytes << std::endl;
+      for (int istage = 0; istage < NUMBER_OF_STAGES; istage++) {
+        stage_type stage = static_cast<stage_type>(istage);
+        fout << "stage." << stage_name(stage) << ".time=" << get_stage_time(stage) << std::endl;
+        fout << "stage." << stage_name(stage) << ".calls=" << calls[istage] << std::endl;
+      }
+      DT_THROW_IF(!fout, std::runtime_error, "Cannot write timing file '" << path_ << "'!");
+      return;
+    }
+
+  } // namespace calo
+} // namespace snfee
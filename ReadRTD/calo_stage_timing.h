@@ -0,0 +1,126 @@
+#ifndef CALO_STAGE_TIMING_H
+#define CALO_STAGE_TIMING_H
+
+// Standard library:
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace snfee {
+  namespace calo {
+
+    /// \brief Time spent in the stages of the RTD analysis
+    ///
+    /// Stages are timed with the CPU time stamp counter when available
+    /// (steady clock otherwise). Ticks are converted to seconds at the end of
+    /// the run, from the wall clock time elapsed between start() and stop().
+    /// Each thread fills its own object, objects are merged at the end.
+    struct stage_timing
+    {
+      /// \brief Timed stages
+      enum stage_type {
+        STAGE_LOAD          = 0, ///< Record load (wait for the reader)
+        STAGE_EXTRACT       = 1, ///< Channel waveform extraction
+        STAGE_INIT          = 2, ///< Waveform initialization (init_from_raw_data)
+        STAGE_MEASURE       = 3, ///< Waveform measurements (do_measurements)
+        STAGE_FFT           = 4, ///< Waveform FFT
+        STAGE_MEAN_WAVEFORM = 5, ///< Mean waveform processing
+        STAGE_FILL          = 6, ///< Histogram filling
+        NUMBER_OF_STAGES    = 7
+      };
+
+      /// \brief Time a stage in the current scope (no-op if the timing is null)
+      struct scope
+      {
+        scope(stage_timing * timing_, const stage_type stage_)
+          : _timing_(timing_), _stage_(stage_)
+        {
+          if (_timing_) _start_ = now();
+          return;
+        }
+
+        ~scope()
+        {
+          if (_timing_) _timing_->add(_stage_, now() - _start_);
+          return;
+        }
+
+      private:
+
+        stage_timing * _timing_;
+        stage_type     _stage_;
+        uint64_t       _start_ = 0;
+      };
+
+      /// Return the name of a stage
+      static const char * stage_name(const stage_type stage_);
+
+      /// Return the current tick counter
+      static uint64_t now()
+      {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+      }
+
+      /// Add ticks to a stage
+      void add(const stage_type stage_, const uint64_t ticks_)
+      {
+        ticks[stage_] += ticks_;
+        calls[stage_]++;
+        return;
+      }
+
+      /// Start the run clock
+      void start();
+
+      /// Stop the run clock
+      void stop();
+
+      /// Add the stage ticks and counters of another object (run clock is kept)
+      void merge(const stage_timing & other_);
+
+      /// Return the run wall clock time (second)
+      double get_wall_time() const;
+
+      /// Return the time spent in a stage (second)
+      double get_stage_time(const stage_type stage_) const;
+
+      /// Print the report
+      void print_report(std::ostream & out_) const;
+
+      /// Store the report in a machine-readable file ('key=value' lines)
+      void store(const std::string & path_) const;
+
+      uint64_t ticks[NUMBER_OF_STAGES] = {};   ///< Ticks spent per stage
+      uint64_t calls[NUMBER_OF_STAGES] = {};   ///< Number of calls per stage
+      std::size_t number_of_records  = 0;      ///< Number of processed RTD records
+      std::size_t number_of_hits     = 0;      ///< Number of processed calo hits
+      std::size_t number_of_channels = 0;      ///< Number of processed channels
+      std::size_t number_of_bytes    = 0;      ///< Size of the input files (byte)
+
+    private:
+
+      uint64_t _start_ticks_ = 0;
+      uint64_t _stop_ticks_  = 0;
+      std::chrono::steady_clock::time_point _start_time_;
+      std::chrono::steady_clock::time_point _stop_time_;
+
+    };
+
+  } // namespace calo
+} // namespace snfee
+
+#endif // CALO_STAGE_TIMING_H
+
+// Local Variables: --
+// mode: c++ --
+// c-file-style: "gnu" --
+// tab-width: 2 --
+// End: --
@@ -0,0 +1,144 @@
+// Ourselves:
+#include "calo_waveform_batch.h"
+
+// Standard library:
+#include <algorithm>
+
+// Third party:
+// - Bayeux:
+#include <bayeux/datatools/exception.h>
+
+namespace snfee {
+  namespace calo {
+
+    waveform_batch::waveform_batch(const std::size_t capacity_,
+                                   const std::size_t max_number_of_samples_)
+      : _capacity_(capacity_)
+      , _stride_(max_number_of_samples_)
+    {
+      DT_THROW_IF(_capacity_ == 0, std::logic_error, "Invalid waveform batch capacity!");
+      DT_THROW_IF(_stride_ == 0, std::logic_error, "Invalid number of samples per waveform!");
+      run_id.resize(_capacity_);
+      trigger_id.resize(_capacity_);
+      ch_id.resize(_capacity_);
+      fw_baseline.resize(_capacity_);
+      fw_peak.resize(_capacity_);
+      fw_charge.resize(_capacity_);
+      fw_peak_cell.resize(_capacity_);
+      fw_rising_cell.resize(_capacity_);
+      number_of_samples.resize(_capacity_);
+      flagged.resize(_capacity_);
+      results.resize(_capacity_);
+      _samples_.resize(_capacity_ * _stride_);
+      _amplitudes_mV_.resize(_capacity_ * _stride_);
+      _ch_data_.resize(_capacity_);
+      _has_ch_data_.resize(_capacity_);
+      return;
+    }
+
+    std::size_t waveform_batch::get_capacity() const
+    {
+      return _capacity_;
+    }
+
+    std::size_t waveform_batch::size() const
+    {
+      return _size_;
+    }
+
+    bool waveform_batch::is_full() const
+    {
+      return _size_ == _capacity_;
+    }
+
+    std::size_t waveform_batch::add(const int32_t run_id_,
+                                    const int32_t trigger_id_,
+                                    const snfee::data::channel_id & ch_id_,
+                                    const int32_t fw_baseline_,
+                                    const int32_t fw_peak_,
+                                    const int32_t fw_charge_,
+                                    const int32_t fw_peak_cell_,
+                                    const int32_t fw_rising_cell_,
+                                    const bool flagged_,
+                                    const snfee::data::calo_hit_record::channel_data_record * ch_data_,
+                                    const std::vector<uint16_t> & waveform_)
+    {
+      DT_THROW_IF(is_full(), std::logic_error, "Waveform batch is full!");
+      DT_THROW_IF(waveform_.size() > _stride_,
+                  std::logic_error,
+                  "Waveform with " << waveform_.size() << " samples does not fit in a batch row of "
+                  << _stride_ << " samples!");
+      std::size_t row = _size_++;
+      run_id[row]            = run_id_;
+      trigger_id[row]        = trigger_id_;
+      ch_id[row]             = ch_id_;
+      fw_baseline[row]       = fw_baseline_;
+      fw_peak[row]           = fw_peak_;
+      fw_charge[row]         = fw_charge_;
+      fw_peak_cell[row]      = fw_peak_cell_;
+      fw_rising_cell[row]    = fw_rising_cell_;
+      number_of_samples[row] = waveform_.size();
+      flagged[row]           = flagged_;
+      _has_ch_data_[row]     = (ch_data_ != nullptr);
+      if (ch_data_) {
+        _ch_data_[row] = *ch_data_;
+      }
+      std::copy(waveform_.begin(), waveform_.end(), _samples_.begin() + row * _stride_);
+      return row;
+    }
+
+    void waveform_batch::measure(const measurement_engine & engine_,
+                                 const waveform_conversion & conversion_,
+                                 const simd_level_type simd_level_,
+                                 stage_timing * timing_)
+    {
+      {
+        stage_timing::scope timed(timing_, stage_timing::STAGE_INIT);
+        for (std::size_t row = 0; row < _size_; row++) {
+          convert_channel_waveform(reinterpret_cast<const int16_t *>(&_samples_[row * _stride_]),
+                                   number_of_samples[row],
+                                   conversion_,
+                                   &_amplitudes_mV_[row * _stride_],
+                                   simd_level_);
+        }
+      }
+      {
+        stage_timing::scope timed(timing_, stage_timing::STAGE_MEASURE);
+        for (std::size_t row = 0; row < _size_; row++) {
+          engine_.measure(&_amplitudes_mV_[row * _stride_],
+                          number_of_samples[row],
+                          conversion_.tdc_to_ns,
+                          results[row]);
+        }
+      }
+      return;
+    }
+
+    void waveform_batch::copy_samples(const std::size_t row_, std::vector<uint16_t> & waveform_) const
+    {
+      DT_THROW_IF(row_ >= _size_, std::range_error, "Invalid waveform batch row!");
+      const uint16_t * first = &_samples_[row_ * _stride_];
+      waveform_.assign(first, first + number_of_samples[row_]);
+      return;
+    }
+
+    const float * waveform_batch::get_amplitudes_mV(const std::size_t row_) const
+    {
+      DT_THROW_IF(row_ >= _size_, std::range_error, "Invalid waveform batch row!");
+      return &_amplitudes_mV_[row_ * _stride_];
+    }
+
+    const snfee::data::calo_hit_record::channel_data_record * waveform_batch::get_ch_data(const std::size_t row_) const
+    {
+      DT_THROW_IF(row_ >= _size_, std::range_error, "Invalid waveform batch row!");
+      return _has_ch_data_[row_] ? &_ch_data_[row_] : nullptr;
+    }
+
+    void waveform_batch::clear()
+    {
+      _size_ = 0;
+      return;
+    }
+
+  } // namespace calo
+} // namespace snfee
@@ -0,0 +1,111 @@
+#ifndef CALO_WAVEFORM_BATCH_H
+#define CALO_WAVEFORM_BATCH_H
+
+// Standard library:
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// This project:
+#include <snfee/data/calo_hit_record.h>
+#include <snfee/data/channel_id.h>
+#include <snfee/model/feb_constants.h>
+
+// This example:
+#include "calo_measurement_engine.h"
+#include "calo_stage_timing.h"
+#include "calo_waveform_kernels.h"
+
+namespace snfee {
+  namespace calo {
+
+    /// \brief Structure-of-arrays buffer of waveforms gathered from many calo hits
+    ///
+    /// Each row holds the ADC samples of a channel, padded to a fixed number
+    /// of samples, and its metadata, including a copy of the raw channel
+    /// data (the RTD record may be recycled before the batch is measured).
+    /// The whole batch is converted then
+    /// measured in two passes, so the kernels and the engine run on a hot
+    /// cache over contiguous rows. Results stay available by row until the
+    /// batch is cleared.
+    struct waveform_batch
+    {
+      /// Constructor
+      waveform_batch(const std::size_t capacity_,
+                     const std::size_t max_number_of_samples_ = snfee::model::feb_constants::SAMLONG_MAX_NUMBER_OF_SAMPLES);
+
+      /// Return the maximum number of rows
+      std::size_t get_capacity() const;
+
+      /// Return the number of rows
+      std::size_t size() const;
+
+      /// Check if the batch is full
+      bool is_full() const;
+
+      /// Add the waveform of a channel, returns its row
+      std::size_t add(const int32_t run_id_,
+                      const int32_t trigger_id_,
+                      const snfee::data::channel_id & ch_id_,
+                      const int32_t fw_baseline_,
+                      const int32_t fw_peak_,
+                      const int32_t fw_charge_,
+                      const int32_t fw_peak_cell_,
+                      const int32_t fw_rising_cell_,
+                      const bool flagged_,
+                      const snfee::data::calo_hit_record::channel_data_record * ch_data_,
+                      const std::vector<uint16_t> & waveform_);
+
+      /// Convert and measure all the waveforms of the batch
+      void measure(const measurement_engine & engine_,
+                   const waveform_conversion & conversion_,
+                   const simd_level_type simd_level_,
+                   stage_timing * timing_ = nullptr);
+
+      /// Copy the ADC samples of a row
+      void copy_samples(const std::size_t row_, std::vector<uint16_t> & waveform_) const;
+
+      /// Return the amplitudes of a row (mV, after measure)
+      const float * get_amplitudes_mV(const std::size_t row_) const;
+
+      /// Return the raw channel data of a row (null if the channel does not come from a RTD record)
+      const snfee::data::calo_hit_record::channel_data_record * get_ch_data(const std::size_t row_) const;
+
+      /// Remove all rows
+      void clear();
+
+      // Metadata and measurements per row (capacity entries, size() used):
+      std::vector<int32_t>                         run_id;            ///< Run ID
+      std::vector<int32_t>                         trigger_id;        ///< Trigger ID
+      std::vector<snfee::data::channel_id>         ch_id;             ///< Readout channel ID
+      std::vector<int32_t>                         fw_baseline;       ///< Firmware baseline       (LSB: ADC unit/16)
+      std::vector<int32_t>                         fw_peak;           ///< Firmware peak amplitude (LSB: ADC unit/8)
+      std::vector<int32_t>                         fw_charge;         ///< Firmware charge
+      std::vector<int32_t>                         fw_peak_cell;      ///< Firmware peak position        (TDC: 0-1023)
+      std::vector<int32_t>                         fw_rising_cell;    ///< Firmware rising edge crossing (LSB: TDC unit/256)
+      std::vector<uint16_t>                        number_of_samples; ///< Number of samples
+      std::vector<uint8_t>                         flagged;           ///< Flagged for display
+      std::vector<measurement_engine::result_type> results;           ///< Engine measurements
+
+    private:
+
+      std::size_t _capacity_ = 0;        ///< Maximum number of rows
+      std::size_t _stride_ = 0;          ///< Number of samples per row
+      std::size_t _size_ = 0;            ///< Number of rows
+      std::vector<uint16_t> _samples_;   ///< ADC samples (rows)
+      std::vector<float> _amplitudes_mV_; ///< Converted amplitudes (rows)
+      std::vector<snfee::data::calo_hit_record::channel_data_record> _ch_data_; ///< Copies of the raw channel data (rows)
+      std::vector<uint8_t> _has_ch_data_; ///< Raw channel data availability (rows)
+
+    };
+
+  } // namespace calo
+} // namespace snfee
+
+#endif // CALO_WAVEFORM_BATCH_H
+
+// Local Variables: --
+// mode: c++ --
+// c-file-style: "gnu" --
+// tab-width: 2 --
+// End: --
@@ -0,0 +1,182 @@
+// Ourselves:
+#include "calo_waveform_codec.h"
+
+// Standard library:
+#include <cstring>
+
+// Third party:
+// - Bayeux:
+#include <bayeux/datatools/exception.h>
+
+namespace snfee {
+  namespace calo {
+
+    const unsigned int waveform_codec::ESCAPE_QUOTIENT;
+    const unsigned int waveform_codec::ESCAPE_BITS;
+
+    namespace {
+
+      inline uint32_t zigzag(const int32_t value_)
+      {
+        return (uint32_t) ((value_ << 1) ^ (value_ >> 31));
+      }
+
+      inline int32_t unzigzag(const uint32_t value_)
+      {
+        return (int32_t) (value_ >> 1) ^ -(int32_t) (value_ & 0x1);
+      }
+
+      /// \brief Little-endian bit stream writer
+      struct bit_writer
+      {
+        std::vector<uint8_t> & bytes;
+        uint64_t buffer = 0;
+        unsigned int nbits = 0;
+
+        explicit bit_writer(std::vector<uint8_t> & bytes_) : bytes(bytes_) {}
+
+        // Write up to 56 bits:
+        inline void put(const uint64_t value_, const unsigned int count_)
+        {
+          buffer |= value_ << nbits;
+          nbits += count_;
+          while (nbits >= 8) {
+            bytes.push_back((uint8_t) buffer);
+            buffer >>= 8;
+            nbits -= 8;
+          }
+          return;
+        }
+
+        inline void finish()
+        {
+          if (nbits > 0) {
+            bytes.push_back((uint8_t) buffer);
+          }
+          buffer = 0;
+          nbits = 0;
+          return;
+        }
+      };
+
+      /// \brief Little-endian bit stream reader
+      struct bit_reader
+      {
+        const uint8_t * data;
+        const uint8_t * end;
+        uint64_t buffer = 0;
+        unsigned int nbits = 0;
+        std::size_t padding = 0; ///< Number of zero bytes read after the end
+
+        bit_reader(const uint8_t * data_, const std::size_t size_) : data(data_), end(data_ + size_) {}
+
+        // Make at least 56 bits available (zeros after the end of the stream):
+        inline void refill()
+        {
+          if (end - data >= 8) {
+            // Load whole bytes from a 64-bit little-endian word:
+            uint64_t word;
+            std::memcpy(&word, data, sizeof(word));
+            buffer |= word << nbits;
+            unsigned int nbytes = (63 - nbits) >> 3;
+            data += nbytes;
+            nbits += 8 * nbytes;
+            return;
+          }
+          while (nbits <= 56) {
+            uint64_t byte = 0;
+            if (data < end) {
+              byte = *data++;
+            } else {
+              padding++;
+            }
+            buffer |= byte << nbits;
+            nbits += 8;
+          }
+          return;
+        }
+
+        // Read up to 32 bits, after a refill:
+        inline uint32_t get(const unsigned int count_)
+        {
+          uint32_t value = (uint32_t) (buffer & ((UINT64_C(1) << count_) - 1));
+          buffer >>= count_;
+          nbits -= count_;
+          return value;
+        }
+      };
+
+    } // namespace
+
+    void waveform_codec::encode(const uint16_t * samples_,
+                                const std::size_t nsamples_,
+                                std::vector<uint8_t> & encoded_)
+    {
+      encoded_.clear();
+      if (nsamples_ == 0) return;
+
+      // Rice parameter from the mean zig-zag difference:
+      uint64_t sum = 0;
+      for (std::size_t i = 1; i < nsamples_; i++) {
+        sum += zigzag((int32_t) samples_[i] - (int32_t) samples_[i - 1]);
+      }
+      unsigned int k = 0;
+      uint64_t count = nsamples_ - 1;
+      while (k < 16 and (count << (k + 1)) <= sum) {
+        k++;
+      }
+
+      encoded_.reserve(1 + nsamples_ / 2);
+      encoded_.push_back((uint8_t) k);
+      bit_writer out(encoded_);
+      out.put(samples_[0], 16);
+      const uint32_t remainder_mask = (1u << k) - 1;
+      for (std::size_t i = 1; i < nsamples_; i++) {
+        uint32_t value = zigzag((int32_t) samples_[i] - (int32_t) samples_[i - 1]);
+        uint32_t quotient = value >> k;
+        if (quotient < ESCAPE_QUOTIENT) {
+          // Unary quotient, its 0 terminator and the remainder:
+          out.put(((1u << quotient) - 1) | ((value & remainder_mask) << (quotient + 1)), quotient + 1 + k);
+        } else {
+          out.put((1u << ESCAPE_QUOTIENT) - 1, ESCAPE_QUOTIENT);
+          out.put(value, ESCAPE_BITS);
+        }
+      }
+      out.finish();
+      return;
+    }
+
+    void waveform_codec::decode(const uint8_t * encoded_,
+                                const std::size_t encoded_size_,
+                                const std::size_t nsamples_,
+                                uint16_t * samples_)
+    {
+      if (nsamples_ == 0) return;
+      DT_THROW_IF(encoded_size_ < 3, std::logic_error, "Truncated encoded waveform!");
+      unsigned int k = encoded_[0];
+      DT_THROW_IF(k > 16, std::logic_error, "Invalid Rice parameter " << k << " in encoded waveform!");
+      bit_reader in(encoded_ + 1, encoded_size_ - 1);
+      in.refill();
+      int32_t sample = in.get(16);
+      samples_[0] = (uint16_t) sample;
+      for (std::size_t i = 1; i < nsamples_; i++) {
+        in.refill();
+        // Number of leading 1 bits (at most ESCAPE_QUOTIENT):
+        unsigned int quotient = __builtin_ctzll(~in.buffer | (UINT64_C(1) << ESCAPE_QUOTIENT));
+        uint32_t value;
+        if (quotient < ESCAPE_QUOTIENT) {
+          in.get(quotient + 1);
+          value = (quotient << k) | in.get(k);
+        } else {
+          in.get(ESCAPE_QUOTIENT);
+          value = in.get(ESCAPE_BITS);
+        }
+        sample += unzigzag(value);
+        samples_[i] = (uint16_t) sample;
+      }
+      DT_THROW_IF(in.padding * 8 > in.nbits, std::logic_error, "Truncated encoded waveform!");
+      return;
+    }
+
+  } // namespace calo
+} // namespace snfee
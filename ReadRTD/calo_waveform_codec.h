@@ -0,0 +1,52 @@
+#ifndef CALO_WAVEFORM_CODEC_H
+#define CALO_WAVEFORM_CODEC_H
+
+// Standard library:
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace snfee {
+  namespace calo {
+
+    /// \brief Lossless codec of SAMLONG waveforms
+    ///
+    /// Encoded waveform layout:
+    /// - byte 0: Rice parameter k of the waveform,
+    /// - then a little-endian bit stream (LSB first): the first sample
+    ///   (16 bits), then the zig-zag mapped differences between consecutive
+    ///   samples, Rice coded with parameter k (unary quotient terminated by
+    ///   a 0 bit, then k remainder bits). Quotients of ESCAPE_QUOTIENT or
+    ///   more are written as ESCAPE_QUOTIENT 1 bits followed by the raw
+    ///   zig-zag value on ESCAPE_BITS bits.
+    ///
+    /// The parameter k is chosen from the mean difference of each waveform.
+    /// Noise-dominated 12-bit waveforms are typically coded on 3 to 4 bits
+    /// per sample.
+    struct waveform_codec
+    {
+      static const unsigned int ESCAPE_QUOTIENT = 16; ///< Escape quotient
+      static const unsigned int ESCAPE_BITS     = 17; ///< Bits of an escaped zig-zag value
+
+      /// Encode samples (the encoded buffer is overwritten)
+      static void encode(const uint16_t * samples_,
+                         const std::size_t nsamples_,
+                         std::vector<uint8_t> & encoded_);
+
+      /// Decode samples (nsamples_ samples are written)
+      static void decode(const uint8_t * encoded_,
+                         const std::size_t encoded_size_,
+                         const std::size_t nsamples_,
+                         uint16_t * samples_);
+    };
+
+  } // namespace calo
+} // namespace snfee
+
+#endif // CALO_WAVEFORM_CODEC_H
+
+// Local Variables: --
+// mode: c++ --
+// c-file-style: "gnu" --
+// tab-width: 2 --
+// End: --
@@ -0,0 +1,216 @@
+// Ourselves:
+#include "calo_waveform_display.h"
+
+// Standard library:
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <ctime>
+#include <pthread.h>
+
+// Third party:
+// - Bayeux:
+#include <bayeux/datatools/exception.h>
+
+namespace snfee {
+  namespace calo {
+
+    namespace {
+
+      /// Block SIGPIPE in the calling thread, returns the previous signal mask
+      sigset_t block_sigpipe()
+      {
+        sigset_t sigpipe_set;
+        sigemptyset(&sigpipe_set);
+        sigaddset(&sigpipe_set, SIGPIPE);
+        sigset_t previous;
+        pthread_sigmask(SIG_BLOCK, &sigpipe_set, &previous);
+        return previous;
+      }
+
+      /// Discard the SIGPIPE raised by failed writes of the calling thread, if any
+      void discard_sigpipe()
+      {
+        sigset_t sigpipe_set;
+        sigemptyset(&sigpipe_set);
+        sigaddset(&sigpipe_set, SIGPIPE);
+        struct timespec no_wait = { 0, 0 };
+        while (sigtimedwait(&sigpipe_set, nullptr, &no_wait) == SIGPIPE) {}
+        return;
+      }
+
+    }
+
+    waveform_display::waveform_display(const config_type & cfg_,
+                                       const datatools::logger::priority logging_)
+    {
+      logging = logging_;
+      _config_ = cfg_;
+      DT_THROW_IF(_config_.capacity == 0, std::logic_error, "Invalid display queue capacity!");
+      DT_THROW_IF(_config_.every == 0, std::logic_error, "Invalid display period (every N-th waveform)!");
+      _pipe_ = ::popen(_config_.gnuplot.c_str(), "w");
+      DT_THROW_IF(_pipe_ == nullptr, std::runtime_error,
+                  "Cannot start the display process '" << _config_.gnuplot << "'!");
+      // All the writes to the pipe are done by the display thread:
+      _thread_ = std::thread(&waveform_display::_run_, this);
+      return;
+    }
+
+    waveform_display::~waveform_display()
+    {
+      {
+        std::lock_guard<std::mutex> lock(_mutex_);
+        _stop_ = true;
+      }
+      _not_empty_.notify_all();
+      _thread_.join();
+      // Closing the pipe flushes the data left by a failed write:
+      sigset_t previous = block_sigpipe();
+      ::pclose(_pipe_);
+      discard_sigpipe();
+      pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+      DT_LOG_NOTICE(logging, "Displayed waveforms: " << _displayed_ << " (dropped: " << _dropped_ << ")");
+      return;
+    }
+
+    bool waveform_display::submit(const std::string & title_,
+                                  const snfee::data::calo_waveform & waveform_,
+                                  const std::vector<double> * ft_,
+                                  const double frequency_step_GHz_,
+                                  const bool flagged_)
+    {
+      {
+        std::lock_guard<std::mutex> lock(_mutex_);
+        if (_disabled_) return false;
+        // Display policy:
+        if (_config_.only_flagged and !flagged_) return false;
+        if (_candidates_++ % _config_.every != 0) return false;
+        if (_queue_.size() >= _config_.capacity) {
+          _dropped_++;
+          return false;
+        }
+        if (_recycled_.empty()) {
+          _queue_.push_back(item_type());
+        } else {
+          _queue_.push_back(std::move(_recycled_.back()));
+          _recycled_.pop_back();
+        }
+        item_type & item = _queue_.back();
+        item.title = title_;
+        item.times_ns.assign(waveform_.get_times_ns().begin(), waveform_.get_times_ns().end());
+        item.amplitudes_mV.assign(waveform_.get_amplitudes_mV().begin(), waveform_.get_amplitudes_mV().end());
+        if (ft_) {
+          item.ft.assign(ft_->begin(), ft_->end());
+        } else {
+          item.ft.clear();
+        }
+        item.frequency_step_GHz = frequency_step_GHz_;
+      }
+      _not_empty_.notify_one();
+      return true;
+    }
+
+    std::size_t waveform_display::get_number_of_displayed() const
+    {
+      std::lock_guard<std::mutex> lock(_mutex_);
+      return _displayed_;
+    }
+
+    std::size_t waveform_display::get_number_of_dropped() const
+    {
+      std::lock_guard<std::mutex> lock(_mutex_);
+      return _dropped_;
+    }
+
+    bool waveform_display::is_disabled() const
+    {
+      std::lock_guard<std::mutex> lock(_mutex_);
+      return _disabled_;
+    }
+
+    void waveform_display::_run_()
+    {
+      // A gnuplot process which exits must not kill the processing: SIGPIPE
+      // is blocked in this thread, so that the writes fail with EPIPE instead.
+      block_sigpipe();
+
+      const std::chrono::duration<double> min_period(_config_.min_period);
+      std::string setup = "set terminal " + _config_.terminal + "\nset encoding utf8\nset grid\n";
+      bool ok = _send_commands_(setup.c_str());
+      item_type item;
+      while (ok) {
+        {
+          std::unique_lock<std::mutex> lock(_mutex_);
+          _not_empty_.wait(lock, [this] { return !_queue_.empty() or _stop_; });
+          if (_stop_) break;
+          item = std::move(_queue_.front());
+          _queue_.pop_front();
+        }
+        ok = _render_(item);
+        if (!ok) break;
+        {
+          // Keep each display on screen for a while, the waveforms submitted meanwhile may be dropped:
+          std::unique_lock<std::mutex> lock(_mutex_);
+          _recycled_.push_back(std::move(item));
+          _displayed_++;
+          _not_empty_.wait_for(lock, min_period, [this] { return _stop_; });
+          if (_stop_) break;
+        }
+      }
+      if (ok) {
+        _send_commands_("quit\n");
+      } else {
+        DT_LOG_WARNING(logging, "Display process '" << _config_.gnuplot << "' failed ("
+                       << std::strerror(errno) << "), the waveform display is disabled!");
+        std::lock_guard<std::mutex> lock(_mutex_);
+        _disabled_ = true;
+        _queue_.clear();
+      }
+      discard_sigpipe();
+      return;
+    }
+
+    bool waveform_display::_send_commands_(const char * commands_)
+    {
+      return std::fputs(commands_, _pipe_) >= 0 and std::fflush(_pipe_) == 0;
+    }
+
+    bool waveform_display::_render_(const item_type & item_)
+    {
+      std::string title = item_.title;
+      std::replace(title.begin(), title.end(), '\'', '"');
+      const bool with_ft = !item_.ft.empty();
+      if (with_ft) {
+        std::fprintf(_pipe_, "set multiplot layout 2,1 title '%s'\n", title.c_str());
+        std::fprintf(_pipe_, "unset title\n");
+      } else {
+        std::fprintf(_pipe_, "set title '%s'\n", title.c_str());
+      }
+      std::fprintf(_pipe_, "set autoscale\n");
+      std::fprintf(_pipe_, "set xlabel 'Time (ns)'\n");
+      std::fprintf(_pipe_, "set ylabel 'Amplitude (mV)'\n");
+      std::fprintf(_pipe_, "plot '-' notitle with lines lt rgb '#0090ff' lw 1\n");
+      for (std::size_t i = 0; i < item_.amplitudes_mV.size(); i++) {
+        std::fprintf(_pipe_, "%g %g\n", item_.times_ns[i], item_.amplitudes_mV[i]);
+      }
+      std::fprintf(_pipe_, "e\n");
+      if (std::ferror(_pipe_)) return false;
+      if (with_ft) {
+        // Low frequency part of the spectrum:
+        std::fprintf(_pipe_, "set xlabel 'Frequency (GHz)'\n");
+        std::fprintf(_pipe_, "set ylabel 'Fourier amplitude'\n");
+        std::fprintf(_pipe_, "set xrange [0:%g]\n", item_.ft.size() * item_.frequency_step_GHz / 4);
+        std::fprintf(_pipe_, "plot '-' notitle with impulses lt rgb '#0090ff' lw 1\n");
+        for (std::size_t i = 0; i < item_.ft.size(); i++) {
+          std::fprintf(_pipe_, "%g %g\n", i * item_.frequency_step_GHz, item_.ft[i]);
+        }
+        std::fprintf(_pipe_, "e\n");
+        std::fprintf(_pipe_, "unset multiplot\n");
+      }
+      return std::fflush(_pipe_) == 0 and !std::ferror(_pipe_);
+    }
+
+  } // namespace calo
+} // namespace snfee
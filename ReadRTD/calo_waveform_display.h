@@ -0,0 +1,119 @@
+#ifndef CALO_WAVEFORM_DISPLAY_H
+#define CALO_WAVEFORM_DISPLAY_H
+
+// Standard library:
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Third party:
+// - Bayeux:
+#include <bayeux/datatools/logger.h>
+
+// This project:
+#include <snfee/data/calo_waveform_data.h>
+
+namespace snfee {
+  namespace calo {
+
+    /// \brief Asynchronous display of the calo waveforms and their spectra
+    ///
+    /// The processing threads submit copies of the waveforms to a bounded
+    /// queue and never wait: a waveform is dropped if the queue is full. A
+    /// display thread streams the queued waveforms to one persistent
+    /// gnuplot process through a pipe (inline data, no temporary file), at
+    /// most one display per period. The display policy keeps every N-th
+    /// submitted waveform, optionally among the flagged ones only. If the
+    /// gnuplot process exits (window closed, missing terminal), SIGPIPE is
+    /// ignored by the display thread, which disables the display instead of
+    /// killing the processing.
+    struct waveform_display
+    {
+      /// \brief Configuration parameters
+      struct config_type
+      {
+        std::size_t capacity     = 4;     ///< Number of pending displays (further ones are dropped)
+        std::size_t every        = 1;     ///< Display every N-th candidate waveform
+        bool        only_flagged = false; ///< Only flagged waveforms are candidates
+        double      min_period   = 0.5;   ///< Minimum time between two displays (second)
+        std::string gnuplot      = "gnuplot"; ///< Gnuplot command
+        std::string terminal     = "x11"; ///< Gnuplot terminal
+      };
+
+      /// Constructor (starts the gnuplot process and the display thread)
+      waveform_display(const config_type & cfg_,
+                       const datatools::logger::priority logging_ = datatools::logger::PRIO_FATAL);
+
+      /// Destructor (pending displays are dropped)
+      ~waveform_display();
+
+      /// Submit a waveform and optionally its spectrum, returns true if it is queued
+      bool submit(const std::string & title_,
+                  const snfee::data::calo_waveform & waveform_,
+                  const std::vector<double> * ft_ = nullptr,
+                  const double frequency_step_GHz_ = 0.0,
+                  const bool flagged_ = false);
+
+      /// Return the number of displayed waveforms
+      std::size_t get_number_of_displayed() const;
+
+      /// Return the number of waveforms dropped because the queue was full
+      std::size_t get_number_of_dropped() const;
+
+      /// Check if the display has been disabled after a gnuplot failure
+      bool is_disabled() const;
+
+      datatools::logger::priority logging = datatools::logger::PRIO_FATAL; ///< Logging priority threshold
+
+    private:
+
+      /// \brief Queued display
+      struct item_type
+      {
+        std::string title;
+        std::vector<double> times_ns;
+        std::vector<double> amplitudes_mV;
+        std::vector<double> ft;
+        double frequency_step_GHz = 0.0;
+      };
+
+      /// Main loop of the display thread
+      void _run_();
+
+      /// Send commands to gnuplot, returns false on failure
+      bool _send_commands_(const char * commands_);
+
+      /// Send a display to gnuplot, returns false on failure
+      bool _render_(const item_type & item_);
+
+      config_type _config_;
+      std::FILE * _pipe_ = nullptr;     ///< Gnuplot process input
+
+      // Display thread:
+      std::thread              _thread_;
+      mutable std::mutex       _mutex_;
+      std::condition_variable  _not_empty_;
+      std::deque<item_type>    _queue_;
+      std::vector<item_type>   _recycled_;   ///< Items reused to avoid reallocations
+      std::size_t              _candidates_ = 0; ///< Number of candidate waveforms
+      std::size_t              _displayed_  = 0; ///< Number of displayed waveforms
+      std::size_t              _dropped_    = 0; ///< Number of dropped waveforms
+      bool                     _stop_ = false;
+      bool                     _disabled_ = false; ///< Gnuplot failure, submissions are ignored
+
+    };
+
+  } // namespace calo
+} // namespace snfee
+
+#endif // CALO_WAVEFORM_DISPLAY_H
+
+// Local Variables: --
+// mode: c++ --
+// c-file-style: "gnu" --
+// tab-width: 2 --
+// End: --
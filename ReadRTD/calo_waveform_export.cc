@@ -0,0 +1,196 @@
+// Ourselves:
+#include "calo_waveform_export.h"
+
+// Standard library:
+#include <cstring>
+#include <iostream>
+
+// Third party:
+// - Bayeux:
+#include <bayeux/datatools/exception.h>
+#include <bayeux/datatools/utils.h>
+
+// This example:
+#include "calo_waveform_codec.h"
+
+namespace snfee {
+  namespace calo {
+
+    const char     waveform_export::MAGIC[8] = {'S', 'N', 'C', 'A', 'L', 'W', 'F', 'Z'};
+    const uint32_t waveform_export::VERSION;
+
+    namespace {
+
+      /// \brief File header (number of waveforms and index offset are null until the file is closed)
+      struct file_header_type
+      {
+        char     magic[8];
+        uint32_t version;
+        uint32_t entry_size;
+        uint64_t number_of_waveforms;
+        uint64_t index_offset;
+      };
+
+      /// Make the header of a file
+      file_header_type make_header(const uint64_t number_of_waveforms_, const uint64_t index_offset_)
+      {
+        file_header_type header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, waveform_export::MAGIC, sizeof(header.magic));
+        header.version             = waveform_export::VERSION;
+        header.entry_size          = sizeof(waveform_export::entry_type);
+        header.number_of_waveforms = number_of_waveforms_;
+        header.index_offset        = index_offset_;
+        return header;
+      }
+
+    } // namespace
+
+    // ----- Writer -----
+
+    waveform_export_writer::waveform_export_writer(const std::string & path_)
+    {
+      _path_ = path_;
+      DT_THROW_IF(!datatools::fetch_path_with_env(_path_), std::logic_error,
+                  "Invalid waveform export path '" << path_ << "'!");
+      _fout_.open(_path_.c_str(), std::ios::binary | std::ios::trunc);
+      DT_THROW_IF(!_fout_, std::runtime_error, "Cannot open waveform export file '" << _path_ << "'!");
+      // Header of an open file, completed at close:
+      file_header_type header = make_header(0, 0);
+      _fout_.write(reinterpret_cast<const char *>(&header), sizeof(header));
+      DT_THROW_IF(!_fout_, std::runtime_error, "Cannot write waveform export file '" << _path_ << "'!");
+      _offset_ = sizeof(header);
+      return;
+    }
+
+    waveform_export_writer::~waveform_export_writer()
+    {
+      try {
+        close();
+      } catch (std::exception & x) {
+        std::cerr << "error: " << x.what() << std::endl;
+      }
+      return;
+    }
+
+    void waveform_export_writer::write(const waveform_export::entry_type & entry_,
+                                       const std::vector<uint8_t> & encoded_)
+    {
+      DT_THROW_IF(!_fout_.is_open(), std::logic_error, "Waveform export file '" << _path_ << "' is closed!");
+      _index_.push_back(entry_);
+      waveform_export::entry_type & entry = _index_.back();
+      entry.offset       = _offset_ + sizeof(waveform_export::entry_type);
+      entry.encoded_size = encoded_.size();
+      // Record: entry then encoded samples
+      _fout_.write(reinterpret_cast<const char *>(&entry), sizeof(entry));
+      _fout_.write(reinterpret_cast<const char *>(encoded_.data()), encoded_.size());
+      DT_THROW_IF(!_fout_, std::runtime_error, "Cannot write waveform export file '" << _path_ << "'!");
+      _offset_ = entry.offset + encoded_.size();
+      return;
+    }
+
+    std::size_t waveform_export_writer::get_number_of_waveforms() const
+    {
+      return _index_.size();
+    }
+
+    void waveform_export_writer::close()
+    {
+      if (!_fout_.is_open()) return;
+      file_header_type header = make_header(_index_.size(), _offset_);
+      _fout_.write(reinterpret_cast<const char *>(_index_.data()),
+                   _index_.size() * sizeof(waveform_export::entry_type));
+      _fout_.seekp(0);
+      _fout_.write(reinterpret_cast<const char *>(&header), sizeof(header));
+      bool ok = _fout_.good();
+      _fout_.close();
+      // The records remain readable without the index:
+      DT_THROW_IF(!ok or _fout_.fail(), std::runtime_error,
+                  "Cannot write the index of waveform export file '" << _path_ << "'!");
+      return;
+    }
+
+    // ----- Reader -----
+
+    waveform_export_reader::waveform_export_reader(const std::string & path_)
+    {
+      _path_ = path_;
+      DT_THROW_IF(!datatools::fetch_path_with_env(_path_), std::logic_error,
+                  "Invalid waveform export path '" << path_ << "'!");
+      _fin_.open(_path_.c_str(), std::ios::binary);
+      DT_THROW_IF(!_fin_, std::runtime_error, "Cannot open waveform export file '" << _path_ << "'!");
+      file_header_type header;
+      _fin_.read(reinterpret_cast<char *>(&header), sizeof(header));
+      DT_THROW_IF(!_fin_ or std::memcmp(header.magic, waveform_export::MAGIC, sizeof(header.magic)) != 0,
+                  std::logic_error,
+                  "File '" << _path_ << "' is not a waveform export file!");
+      DT_THROW_IF(header.version != waveform_export::VERSION
+                  or header.entry_size != sizeof(waveform_export::entry_type),
+                  std::logic_error,
+                  "Unsupported waveform export file format in '" << _path_ << "'!");
+      _complete_ = (header.index_offset != 0);
+      if (!_complete_) {
+        _scan_records_();
+        return;
+      }
+      _index_.resize(header.number_of_waveforms);
+      _fin_.seekg(header.index_offset);
+      _fin_.read(reinterpret_cast<char *>(_index_.data()),
+                 _index_.size() * sizeof(waveform_export::entry_type));
+      DT_THROW_IF(!_fin_, std::runtime_error, "Cannot read the index of waveform export file '" << _path_ << "'!");
+      return;
+    }
+
+    void waveform_export_reader::_scan_records_()
+    {
+      _fin_.seekg(0, std::ios::end);
+      const uint64_t file_size = _fin_.tellg();
+      uint64_t offset = sizeof(file_header_type);
+      _fin_.seekg(offset);
+      waveform_export::entry_type entry;
+      while (offset + sizeof(entry) <= file_size) {
+        _fin_.read(reinterpret_cast<char *>(&entry), sizeof(entry));
+        // Stop at the first truncated or inconsistent record:
+        if (!_fin_
+            or entry.offset != offset + sizeof(entry)
+            or entry.offset + entry.encoded_size > file_size) break;
+        _index_.push_back(entry);
+        offset = entry.offset + entry.encoded_size;
+        _fin_.seekg(offset);
+      }
+      _fin_.clear();
+      std::cerr << "warning: waveform export file '" << _path_ << "' was not closed, "
+                << _index_.size() << " complete waveforms recovered" << std::endl;
+      return;
+    }
+
+    bool waveform_export_reader::is_complete() const
+    {
+      return _complete_;
+    }
+
+    std::size_t waveform_export_reader::get_number_of_waveforms() const
+    {
+      return _index_.size();
+    }
+
+    const waveform_export::entry_type & waveform_export_reader::get_entry(const std::size_t index_) const
+    {
+      DT_THROW_IF(index_ >= _index_.size(), std::range_error, "Invalid exported waveform index " << index_ << "!");
+      return _index_[index_];
+    }
+
+    void waveform_export_reader::load_samples(const std::size_t index_, std::vector<uint16_t> & samples_)
+    {
+      const waveform_export::entry_type & entry = get_entry(index_);
+      _encoded_.resize(entry.encoded_size);
+      _fin_.seekg(entry.offset);
+      _fin_.read(reinterpret_cast<char *>(_encoded_.data()), _encoded_.size());
+      DT_THROW_IF(!_fin_, std::runtime_error, "Cannot read waveform " << index_ << " from '" << _path_ << "'!");
+      samples_.resize(entry.number_of_samples);
+      waveform_codec::decode(_encoded_.data(), _encoded_.size(), samples_.size(), samples_.data());
+      return;
+    }
+
+  } // namespace calo
+} // namespace snfee
@@ -0,0 +1,115 @@
+#ifndef CALO_WAVEFORM_EXPORT_H
+#define CALO_WAVEFORM_EXPORT_H
+
+// Standard library:
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace snfee {
+  namespace calo {
+
+    /// \brief Export file of compressed waveforms with their measurements
+    ///
+    /// The file ('.wfz' extension) is made of a header, of the records of
+    /// the waveforms (index entry followed by the encoded samples, see
+    /// waveform_codec) and, once closed, of an index holding all the
+    /// entries. The index is loaded at once by the reader, so that
+    /// waveforms can be selected from their measurements before being
+    /// decoded. The file is appended record by record: if the writer did
+    /// not close it (crash), the reader rebuilds the index from the
+    /// records, up to the last complete one. Numbers are stored in the
+    /// native byte order.
+    struct waveform_export
+    {
+      static const char     MAGIC[8];    ///< File signature
+      static const uint32_t VERSION = 2; ///< Format version
+
+      /// \brief Index entry of an exported waveform
+      struct entry_type
+      {
+        uint64_t offset            = 0;    ///< Offset of the encoded waveform in the file
+        uint32_t encoded_size      = 0;    ///< Size of the encoded waveform (bytes)
+        int32_t  run_id            = -1;   ///< Run ID
+        int32_t  trigger_id        = -1;   ///< Trigger ID
+        uint16_t channel_index     = 0;    ///< Dense channel index (see calo_channel_index.h)
+        uint16_t number_of_samples = 0;    ///< Number of samples
+        int32_t  fw_baseline       = 0;    ///< Firmware baseline       (LSB: ADC unit/16)
+        int32_t  fw_peak           = 0;    ///< Firmware peak amplitude (LSB: ADC unit/8)
+        int32_t  fw_charge         = 0;    ///< Firmware charge
+        float    baseline_mV       = 0.0f; ///< Measured baseline (mV, NaN if not measured)
+        float    peak_mV           = 0.0f; ///< Measured peak amplitude (mV, NaN if not measured)
+        float    charge_nVs        = 0.0f; ///< Measured charge (nV.s, NaN if not measured)
+      };
+    };
+
+    /// \brief Writer of a waveform export file
+    struct waveform_export_writer
+    {
+      /// Constructor
+      waveform_export_writer(const std::string & path_);
+
+      /// Destructor (closes the file, errors are reported but not thrown)
+      ~waveform_export_writer();
+
+      /// Append an encoded waveform (offset and size of the entry are set by the writer)
+      void write(const waveform_export::entry_type & entry_,
+                 const std::vector<uint8_t> & encoded_);
+
+      /// Return the number of exported waveforms
+      std::size_t get_number_of_waveforms() const;
+
+      /// Write the index and close the file
+      void close();
+
+    private:
+
+      std::string   _path_;
+      std::ofstream _fout_;
+      uint64_t      _offset_ = 0;
+      std::vector<waveform_export::entry_type> _index_;
+
+    };
+
+    /// \brief Reader of a waveform export file
+    struct waveform_export_reader
+    {
+      /// Constructor (loads the index, or rebuilds it if the file was not closed)
+      waveform_export_reader(const std::string & path_);
+
+      /// Check if the file was closed by its writer
+      bool is_complete() const;
+
+      /// Return the number of exported waveforms
+      std::size_t get_number_of_waveforms() const;
+
+      /// Return the index entry of a waveform
+      const waveform_export::entry_type & get_entry(const std::size_t index_) const;
+
+      /// Read and decode the samples of a waveform
+      void load_samples(const std::size_t index_, std::vector<uint16_t> & samples_);
+
+    private:
+
+      std::string   _path_;
+      std::ifstream _fin_;
+      std::vector<waveform_export::entry_type> _index_;
+      std::vector<uint8_t> _encoded_; ///< Working buffer
+      bool _complete_ = false;        ///< The file was closed by its writer
+
+      /// Rebuild the index from the records of a file which was not closed
+      void _scan_records_();
+
+    };
+
+  } // namespace calo
+} // namespace snfee
+
+#endif // CALO_WAVEFORM_EXPORT_H
+
+// Local Variables: --
+// mode: c++ --
+// c-file-style: "gnu" --
+// tab-width: 2 --
+// End: --
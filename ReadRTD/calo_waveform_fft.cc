@@ -1,9 +1,15 @@
 // Ourselves:
 #include "calo_waveform_fft.h"
 
+// Standard library:
+#include <cmath>
+
 // Third party:
+// - GSL:
+#include <gsl/gsl_fft_real.h>
+#include <gsl/gsl_fft_halfcomplex.h>
+#include <gsl/gsl_fft_real_float.h>
 // - Bayeux:
-#include <bayeux/mygsl/fft_real.h>
 #include <bayeux/datatools/exception.h>
 #include <bayeux/geomtools/geomtools_config.h>
 #if GEOMTOOLS_WITH_GNUPLOT_DISPLAY == 1
@@ -20,6 +26,63 @@
 namespace snfee {
   namespace algo {
 
+    /// \brief GSL wavetables and workspace for a waveform length
+    struct calo_waveform_fft::plan_type
+    {
+      plan_type(const std::size_t size_)
+        : size(size_)
+      {
+        real_wavetable = gsl_fft_real_wavetable_alloc(size);
+        workspace = gsl_fft_real_workspace_alloc(size);
+        DT_THROW_IF(real_wavetable == nullptr or workspace == nullptr,
+                    std::runtime_error,
+                    "Cannot allocate the FFT plan for " << size << " samples!");
+        return;
+      }
+
+      ~plan_type()
+      {
+        if (float_workspace) gsl_fft_real_workspace_float_free(float_workspace);
+        if (float_wavetable) gsl_fft_real_wavetable_float_free(float_wavetable);
+        if (halfcomplex_wavetable) gsl_fft_halfcomplex_wavetable_free(halfcomplex_wavetable);
+        gsl_fft_real_workspace_free(workspace);
+        gsl_fft_real_wavetable_free(real_wavetable);
+        return;
+      }
+
+      // Inverse wavetable, only allocated for the filtered waveforms:
+      const gsl_fft_halfcomplex_wavetable * get_halfcomplex_wavetable()
+      {
+        if (halfcomplex_wavetable == nullptr) {
+          halfcomplex_wavetable = gsl_fft_halfcomplex_wavetable_alloc(size);
+          DT_THROW_IF(halfcomplex_wavetable == nullptr,
+                      std::runtime_error,
+                      "Cannot allocate the inverse FFT plan for " << size << " samples!");
+        }
+        return halfcomplex_wavetable;
+      }
+
+      // Single precision wavetable and workspace, only allocated for the single precision transforms:
+      void prepare_float()
+      {
+        if (float_wavetable == nullptr) {
+          float_wavetable = gsl_fft_real_wavetable_float_alloc(size);
+          float_workspace = gsl_fft_real_workspace_float_alloc(size);
+          DT_THROW_IF(float_wavetable == nullptr or float_workspace == nullptr,
+                      std::runtime_error,
+                      "Cannot allocate the single precision FFT plan for " << size << " samples!");
+        }
+        return;
+      }
+
+      std::size_t size = 0;
+      gsl_fft_real_wavetable        * real_wavetable = nullptr;
+      gsl_fft_halfcomplex_wavetable * halfcomplex_wavetable = nullptr;
+      gsl_fft_real_workspace        * workspace = nullptr;
+      gsl_fft_real_wavetable_float  * float_wavetable = nullptr;
+      gsl_fft_real_workspace_float  * float_workspace = nullptr;
+    };
+
     calo_waveform_fft::calo_waveform_fft(const config_type & cfg_,
                                          const datatools::logger::priority logging_)
     {
@@ -28,6 +91,11 @@ namespace snfee {
       return;
     }
 
+    calo_waveform_fft::~calo_waveform_fft()
+    {
+      return;
+    }
+
     void calo_waveform_fft::initialize()
     {
       return;
@@ -35,31 +103,135 @@ namespace snfee {
     
     void calo_waveform_fft::terminate()
     {
-       _config_ = config_type();
+      _plans_.clear();
+      _data_.clear();
+      _data_float_.clear();
+      _config_ = config_type();
       return;
     }
 
+    calo_waveform_fft::plan_type & calo_waveform_fft::_get_plan_(const std::size_t size_)
+    {
+      std::unique_ptr<plan_type> & plan = _plans_[size_];
+      if (!plan) {
+        DT_LOG_DEBUG(logging, "New FFT plan for " << size_ << " samples");
+        plan.reset(new plan_type(size_));
+      }
+      return *plan;
+    }
+
     void calo_waveform_fft::transform(const snfee::data::calo_waveform & wf_,
                                       std::vector<double> & ft_,
                                       std::vector<double> & fwf_,
                                       double & frequency_step_)
+    {
+      transform(wf_, &ft_, &fwf_, frequency_step_);
+      return;
+    }
+
+    void calo_waveform_fft::transform(const snfee::data::calo_waveform & wf_,
+                                      std::vector<double> & ft_,
+                                      double & frequency_step_)
+    {
+      transform(wf_, &ft_, nullptr, frequency_step_);
+      return;
+    }
+
+    void calo_waveform_fft::transform(const snfee::data::calo_waveform & wf_,
+                                      std::vector<double> * ft_,
+                                      std::vector<double> * fwf_,
+                                      double & frequency_step_)
+    {
+      DT_THROW_IF(!wf_.is_locked(), std::logic_error, "Waveform is not locked!");
+      const std::size_t n = wf_.get_amplitudes_mV().size();
+      DT_THROW_IF(n < 2, std::logic_error, "Not enough samples for a waveform FFT!");
+      double time_step = wf_.get_times_ns()[1] - wf_.get_times_ns()[0];
+      frequency_step_ = 1.0 / (n * time_step);
+      plan_type & plan = _get_plan_(n);
+
+      // Forward transform in place, half-complex layout:
+      //  [Re(0), Re(1), Im(1), ..., Re(n/2-1), Im(n/2-1), (Re(n/2) if n is even)]
+      _data_.assign(wf_.get_amplitudes_mV().begin(),
+                    wf_.get_amplitudes_mV().end());
+      gsl_fft_real_transform(_data_.data(), 1, n, plan.real_wavetable, plan.workspace);
+
+      if (ft_) {
+        std::vector<double> & ft = *ft_;
+        ft.resize(n);
+        ft[0] = std::abs(_data_[0]);
+        for (std::size_t k = 1; 2 * k < n; k++) {
+          double modulus = std::hypot(_data_[2 * k - 1], _data_[2 * k]);
+          ft[k]     = modulus;
+          ft[n - k] = modulus;
+        }
+        if (n % 2 == 0) {
+          ft[n / 2] = std::abs(_data_[n - 1]);
+        }
+      }
+
+      if (fwf_) {
+        // Inverse transform in place (normalized by GSL):
+        gsl_fft_halfcomplex_inverse(_data_.data(), 1, n, plan.get_halfcomplex_wavetable(), plan.workspace);
+        fwf_->assign(_data_.begin(), _data_.end());
+      }
+      return;
+    }
+
+    void calo_waveform_fft::transform_rows(double * rows_,
+                                           const std::size_t size_,
+                                           const std::size_t nrows_)
+    {
+      DT_THROW_IF(size_ < 2, std::logic_error, "Not enough samples for a FFT!");
+      plan_type & plan = _get_plan_(size_);
+      for (std::size_t row = 0; row < nrows_; row++) {
+        gsl_fft_real_transform(rows_ + row * size_, 1, size_, plan.real_wavetable, plan.workspace);
+      }
+      return;
+    }
+
+    void calo_waveform_fft::transform_rows(float * rows_,
+                                           const std::size_t size_,
+                                           const std::size_t nrows_)
+    {
+      DT_THROW_IF(size_ < 2, std::logic_error, "Not enough samples for a FFT!");
+      plan_type & plan = _get_plan_(size_);
+      plan.prepare_float();
+      for (std::size_t row = 0; row < nrows_; row++) {
+        gsl_fft_real_float_transform(rows_ + row * size_, 1, size_, plan.float_wavetable, plan.float_workspace);
+      }
+      return;
+    }
+
+    void calo_waveform_fft::transform_half(const float * amplitudes_mV_,
+                                           const std::size_t size_,
+                                           std::vector<float> & ft_)
+    {
+      const std::size_t n = size_;
+      _data_float_.assign(amplitudes_mV_, amplitudes_mV_ + n);
+      transform_rows(_data_float_.data(), n, 1);
+      ft_.resize(n / 2 + 1);
+      ft_[0] = std::abs(_data_float_[0]);
+      for (std::size_t k = 1; 2 * k < n; k++) {
+        ft_[k] = std::hypot(_data_float_[2 * k - 1], _data_float_[2 * k]);
+      }
+      if (n % 2 == 0) {
+        ft_[n / 2] = std::abs(_data_float_[n - 1]);
+      }
+      return;
+    }
+
+    void calo_waveform_fft::transform_half(const snfee::data::calo_waveform & wf_,
+                                           std::vector<float> & ft_,
+                                           double & frequency_step_)
     {
       DT_THROW_IF(!wf_.is_locked(), std::logic_error, "Waveform is not locked!");
+      const std::size_t n = wf_.get_amplitudes_mV().size();
+      DT_THROW_IF(n < 2, std::logic_error, "Not enough samples for a waveform FFT!");
       double time_step = wf_.get_times_ns()[1] - wf_.get_times_ns()[0];
-      double Nyquist_frequency = 0.5 / time_step;
-      double min_freq_cut = 0.0;
-      double max_freq_cut = Nyquist_frequency;
-      double time_min = wf_.get_times_ns()[0];
-      std::vector<double> data(wf_.get_amplitudes_mV().size());
-      std::copy(wf_.get_amplitudes_mV().begin(),
-                wf_.get_amplitudes_mV().end(),
-                data.begin());
-      mygsl::fft_real fft;
-      fft.init(data, time_min, time_step, min_freq_cut, max_freq_cut);
-      fft.process();
-      fft.compute_fourier_spectrum(ft_);
-      fft.compute_filtered_data(fwf_);
-      frequency_step_ = fft.get_frequency_step();
+      frequency_step_ = 1.0 / (n * time_step);
+      _amplitudes_float_.assign(wf_.get_amplitudes_mV().begin(),
+                                wf_.get_amplitudes_mV().end());
+      transform_half(_amplitudes_float_.data(), n, ft_);
       return;
     }
 
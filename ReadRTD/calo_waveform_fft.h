@@ -2,9 +2,12 @@
 #define SNFEE_ALGO_CALO_WAVEFORM_FFT_H
 
 // Standard library:
+#include <cstddef>
 #include <cstdint>
 #include <vector>
 #include <limits>
+#include <map>
+#include <memory>
 
 // Third party:
 // - Bayeux:
@@ -17,6 +20,17 @@ namespace snfee {
   namespace algo {
  
     /// \brief Calo waveform FFT
+    ///
+    /// The GSL wavetables and workspace are computed once per waveform
+    /// length and cached until terminate, and the working buffers are
+    /// reused from one waveform to the next. Only the requested outputs
+    /// are computed: the inverse transform is skipped if the filtered
+    /// waveform is not requested. An instance must not be shared between
+    /// threads.
+    ///
+    /// A single precision mode returns only the N/2+1 non-redundant bins
+    /// of the spectrum: 12-bit ADC samples do not need double precision
+    /// (see the accuracy check of snfee-calo-kernel-bench).
     struct calo_waveform_fft
     {
 
@@ -29,18 +43,63 @@ namespace snfee {
       calo_waveform_fft(const config_type & cfg_,
                         const datatools::logger::priority logging_ = datatools::logger::PRIO_FATAL);
 
+      /// Destructor
+      ~calo_waveform_fft();
+
       /// Initialize
       void initialize();
 
       /// Terminate
       void terminate();
 
+      /// Fourier transform with a selection of outputs
+      ///
+      /// The spectrum holds the modulus of the Fourier coefficients for the
+      /// N frequencies of a N samples waveform, the filtered waveform its
+      /// reconstruction by the inverse transform. Null outputs are not
+      /// computed.
+      void transform(const snfee::data::calo_waveform & wf_,
+                     std::vector<double> * ft_,
+                     std::vector<double> * fwf_,
+                     double & frequency_step_);
+
+      /// Forward transforms of contiguous rows of samples, in place
+      ///
+      /// Each row of size_ samples is replaced by its Fourier coefficients in
+      /// the GSL half-complex layout. All rows share the same cached plan.
+      void transform_rows(double * rows_,
+                          const std::size_t size_,
+                          const std::size_t nrows_);
+
+      /// Forward transforms of contiguous rows of samples, in place (single precision)
+      void transform_rows(float * rows_,
+                          const std::size_t size_,
+                          const std::size_t nrows_);
+
+      /// Half spectrum in single precision
+      ///
+      /// The spectrum holds the modulus of the Fourier coefficients for the
+      /// N/2+1 non-negative frequencies of N amplitudes.
+      void transform_half(const float * amplitudes_mV_,
+                          const std::size_t size_,
+                          std::vector<float> & ft_);
+
+      /// Half spectrum of a waveform in single precision
+      void transform_half(const snfee::data::calo_waveform & wf_,
+                          std::vector<float> & ft_,
+                          double & frequency_step_);
+
       /// Fourier transform
       void transform(const snfee::data::calo_waveform & wf_,
                      std::vector<double> & ft_,
                      std::vector<double> & fwf_,
                      double & frequency_step_);
 
+      /// Fourier transform (spectrum only, without the filtered waveform)
+      void transform(const snfee::data::calo_waveform & wf_,
+                     std::vector<double> & ft_,
+                     double & frequency_step_);
+
       /// Display waveform FFT
       static void display_waveform_fft(const std::vector<double> & ft_,
                                        const double frequency_step_,
@@ -48,9 +107,21 @@ namespace snfee {
       
       datatools::logger::priority logging = datatools::logger::PRIO_FATAL; ///< Logging priority threshold:
       
+    private:
+
+      /// \brief GSL wavetables and workspace for a waveform length
+      struct plan_type;
+
+      /// Return the plan for a waveform length
+      plan_type & _get_plan_(const std::size_t size_);
+
     private:
 
       config_type _config_;
+      std::map<std::size_t, std::unique_ptr<plan_type>> _plans_; ///< Plans per waveform length
+      std::vector<double> _data_; ///< Working buffer for the Fourier coefficients (half-complex)
+      std::vector<float> _data_float_; ///< Working buffer for the single precision Fourier coefficients
+      std::vector<float> _amplitudes_float_; ///< Working buffer for the single precision waveform amplitudes
       
     };
     
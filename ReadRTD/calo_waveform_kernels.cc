@@ -0,0 +1,496 @@
+// Ourselves:
+#include "calo_waveform_kernels.h"
+
+// Standard library:
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define CALO_WAVEFORM_KERNELS_AVX2 1
+#include <immintrin.h>
+#endif
+
+namespace snfee {
+  namespace calo {
+
+    simd_level_type detect_simd_level()
+    {
+#if defined(CALO_WAVEFORM_KERNELS_AVX2)
+      static const simd_level_type level = __builtin_cpu_supports("avx2") ? SIMD_AVX2 : SIMD_NONE;
+      return level;
+#else
+      return SIMD_NONE;
+#endif
+    }
+
+    const char * simd_level_name(const simd_level_type level_)
+    {
+      switch (level_) {
+      case SIMD_AVX2 : return "avx2";
+      default        : break;
+      }
+      return "scalar";
+    }
+
+    namespace {
+
+      /// Use of the fixed-size kernels
+      bool fixed_size_kernels_enabled = true;
+
+      /// Compile-time number of samples, converts to std::size_t
+      template <std::size_t N>
+      struct fixed_size
+      {
+        constexpr operator std::size_t() const { return N; }
+      };
+
+      /// Run a kernel functor on a fixed number of samples if it is one of
+      /// the specialized sizes, on a runtime number of samples otherwise
+      template <typename Kernel>
+      auto dispatch_fixed_size(const std::size_t nsamples_, const Kernel & kernel_)
+        -> decltype(kernel_(nsamples_))
+      {
+        if (fixed_size_kernels_enabled) {
+          switch (nsamples_) {
+          case 1024 : return kernel_(fixed_size<1024>());
+          case 512  : return kernel_(fixed_size<512>());
+          case 256  : return kernel_(fixed_size<256>());
+          case 128  : return kernel_(fixed_size<128>());
+          default   : break;
+          }
+        }
+        return kernel_(nsamples_);
+      }
+
+      template <typename Size>
+      inline void convert_samlong_waveforms_scalar(const int16_t * interleaved_,
+                                                   const std::size_t begin_,
+                                                   const Size end_,
+                                                   const waveform_conversion & conversion_,
+                                                   float * times_ns_,
+                                                   float * ch0_mV_,
+                                                   float * ch1_mV_)
+      {
+        for (std::size_t isample = begin_; isample < end_; isample++) {
+          times_ns_[isample] = (float) isample * conversion_.tdc_to_ns;
+          ch0_mV_[isample] = ((float) interleaved_[2 * isample] - conversion_.adc_zero) * conversion_.adc_to_mV;
+          ch1_mV_[isample] = ((float) interleaved_[2 * isample + 1] - conversion_.adc_zero) * conversion_.adc_to_mV;
+        }
+        return;
+      }
+
+      template <typename Size>
+      inline void convert_channel_waveform_scalar(const int16_t * samples_,
+                                                  const std::size_t begin_,
+                                                  const Size end_,
+                                                  const waveform_conversion & conversion_,
+                                                  float * amplitudes_mV_)
+      {
+        for (std::size_t isample = begin_; isample < end_; isample++) {
+          amplitudes_mV_[isample] = ((float) samples_[isample] - conversion_.adc_zero) * conversion_.adc_to_mV;
+        }
+        return;
+      }
+
+#if defined(CALO_WAVEFORM_KERNELS_AVX2)
+
+      // Process 8 samples per iteration, returns the number of processed samples:
+      template <typename Size>
+      __attribute__((target("avx2")))
+      inline std::size_t convert_samlong_waveforms_avx2(const int16_t * interleaved_,
+                                                        const Size nsamples_,
+                                                        const waveform_conversion & conversion_,
+                                                        float * times_ns_,
+                                                        float * ch0_mV_,
+                                                        float * ch1_mV_)
+      {
+        const __m256  tdc_to_ns = _mm256_set1_ps(conversion_.tdc_to_ns);
+        const __m256  adc_zero  = _mm256_set1_ps(conversion_.adc_zero);
+        const __m256  adc_to_mV = _mm256_set1_ps(conversion_.adc_to_mV);
+        const __m256i iota      = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+        std::size_t isample = 0;
+        for (; isample + 8 <= nsamples_; isample += 8) {
+          // 8 pairs of samples (channel 0 in the low half of each 32-bit lane):
+          __m256i pairs = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(interleaved_ + 2 * isample));
+          __m256i adc0  = _mm256_srai_epi32(_mm256_slli_epi32(pairs, 16), 16);
+          __m256i adc1  = _mm256_srai_epi32(pairs, 16);
+          __m256  mV0   = _mm256_mul_ps(_mm256_sub_ps(_mm256_cvtepi32_ps(adc0), adc_zero), adc_to_mV);
+          __m256  mV1   = _mm256_mul_ps(_mm256_sub_ps(_mm256_cvtepi32_ps(adc1), adc_zero), adc_to_mV);
+          __m256i index = _mm256_add_epi32(_mm256_set1_epi32((int) isample), iota);
+          __m256  times = _mm256_mul_ps(_mm256_cvtepi32_ps(index), tdc_to_ns);
+          _mm256_storeu_ps(times_ns_ + isample, times);
+          _mm256_storeu_ps(ch0_mV_ + isample, mV0);
+          _mm256_storeu_ps(ch1_mV_ + isample, mV1);
+        }
+        return isample;
+      }
+
+      // Process 8 samples per iteration, returns the number of processed samples:
+      template <typename Size>
+      __attribute__((target("avx2")))
+      inline std::size_t convert_channel_waveform_avx2(const int16_t * samples_,
+                                                       const Size nsamples_,
+                                                       const waveform_conversion & conversion_,
+                                                       float * amplitudes_mV_)
+      {
+        const __m256 adc_zero  = _mm256_set1_ps(conversion_.adc_zero);
+        const __m256 adc_to_mV = _mm256_set1_ps(conversion_.adc_to_mV);
+        std::size_t isample = 0;
+        for (; isample + 8 <= nsamples_; isample += 8) {
+          __m128i adc16 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(samples_ + isample));
+          __m256  adc   = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(adc16));
+          _mm256_storeu_ps(amplitudes_mV_ + isample, _mm256_mul_ps(_mm256_sub_ps(adc, adc_zero), adc_to_mV));
+        }
+        return isample;
+      }
+
+      // Horizontal sum of 4 doubles:
+      __attribute__((target("avx2")))
+      inline double hsum_avx2(const __m256d v_)
+      {
+        __m128d v2 = _mm_add_pd(_mm256_castpd256_pd128(v_), _mm256_extractf128_pd(v_, 1));
+        __m128d v1 = _mm_add_sd(v2, _mm_unpackhi_pd(v2, v2));
+        return _mm_cvtsd_f64(v1);
+      }
+
+      // Sums over the first multiple of 8 samples, returns the number of processed samples
+      // (accumulated in double precision, as the scalar sums):
+      template <typename Size>
+      __attribute__((target("avx2")))
+      inline std::size_t sum_squares_samples_avx2(const float * samples_,
+                                                  const Size nsamples_,
+                                                  double & sum_,
+                                                  double & sum2_)
+      {
+        __m256d sum_lo  = _mm256_setzero_pd();
+        __m256d sum_hi  = _mm256_setzero_pd();
+        __m256d sum2_lo = _mm256_setzero_pd();
+        __m256d sum2_hi = _mm256_setzero_pd();
+        std::size_t isample = 0;
+        for (; isample + 8 <= nsamples_; isample += 8) {
+          __m256 x = _mm256_loadu_ps(samples_ + isample);
+          __m256d x_lo = _mm256_cvtps_pd(_mm256_castps256_ps128(x));
+          __m256d x_hi = _mm256_cvtps_pd(_mm256_extractf128_ps(x, 1));
+          sum_lo  = _mm256_add_pd(sum_lo, x_lo);
+          sum_hi  = _mm256_add_pd(sum_hi, x_hi);
+          sum2_lo = _mm256_add_pd(sum2_lo, _mm256_mul_pd(x_lo, x_lo));
+          sum2_hi = _mm256_add_pd(sum2_hi, _mm256_mul_pd(x_hi, x_hi));
+        }
+        sum_  = hsum_avx2(_mm256_add_pd(sum_lo, sum_hi));
+        sum2_ = hsum_avx2(_mm256_add_pd(sum2_lo, sum2_hi));
+        return isample;
+      }
+
+      // Sum over the first multiple of 8 samples, returns the number of processed samples
+      // (accumulated in double precision, as the scalar sum):
+      template <typename Size>
+      __attribute__((target("avx2")))
+      inline std::size_t sum_samples_avx2(const float * samples_,
+                                          const Size nsamples_,
+                                          double & sum_)
+      {
+        __m256d sum_lo = _mm256_setzero_pd();
+        __m256d sum_hi = _mm256_setzero_pd();
+        std::size_t isample = 0;
+        for (; isample + 8 <= nsamples_; isample += 8) {
+          __m256 x = _mm256_loadu_ps(samples_ + isample);
+          sum_lo = _mm256_add_pd(sum_lo, _mm256_cvtps_pd(_mm256_castps256_ps128(x)));
+          sum_hi = _mm256_add_pd(sum_hi, _mm256_cvtps_pd(_mm256_extractf128_ps(x, 1)));
+        }
+        sum_ = hsum_avx2(_mm256_add_pd(sum_lo, sum_hi));
+        return isample;
+      }
+
+      // Minimum over the first multiple of 8 samples, returns the number of processed samples:
+      template <typename Size>
+      __attribute__((target("avx2")))
+      inline std::size_t min_samples_avx2(const float * samples_,
+                                          const Size nsamples_,
+                                          float & min_)
+      {
+        if (nsamples_ < 8) return 0;
+        __m256 vmin = _mm256_loadu_ps(samples_);
+        std::size_t isample = 8;
+        for (; isample + 8 <= nsamples_; isample += 8) {
+          vmin = _mm256_min_ps(vmin, _mm256_loadu_ps(samples_ + isample));
+        }
+        __m128 v4 = _mm_min_ps(_mm256_castps256_ps128(vmin), _mm256_extractf128_ps(vmin, 1));
+        __m128 v2 = _mm_min_ps(v4, _mm_movehl_ps(v4, v4));
+        __m128 v1 = _mm_min_ss(v2, _mm_shuffle_ps(v2, v2, 0x1));
+        min_ = _mm_cvtss_f32(v1);
+        return isample;
+      }
+
+      // Index of the first sample equal to a value, nsamples_ if not found:
+      template <typename Size>
+      __attribute__((target("avx2")))
+      inline std::size_t find_sample_avx2(const float * samples_,
+                                          const Size nsamples_,
+                                          const float value_)
+      {
+        const __m256 value = _mm256_set1_ps(value_);
+        std::size_t isample = 0;
+        for (; isample + 8 <= nsamples_; isample += 8) {
+          int mask = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(samples_ + isample), value, _CMP_EQ_OQ));
+          if (mask != 0) {
+            return isample + __builtin_ctz(mask);
+          }
+        }
+        for (; isample < nsamples_; isample++) {
+          if (samples_[isample] == value_) return isample;
+        }
+        return nsamples_;
+      }
+
+      // Accumulation over the first multiple of 4 samples, returns the number of processed samples:
+      template <typename Size>
+      __attribute__((target("avx2")))
+      inline std::size_t accumulate_samples_avx2(const float * samples_,
+                                                 const Size nsamples_,
+                                                 double * sums_)
+      {
+        std::size_t isample = 0;
+        for (; isample + 4 <= nsamples_; isample += 4) {
+          __m256d x = _mm256_cvtps_pd(_mm_loadu_ps(samples_ + isample));
+          _mm256_storeu_pd(sums_ + isample, _mm256_add_pd(_mm256_loadu_pd(sums_ + isample), x));
+        }
+        return isample;
+      }
+
+#endif // CALO_WAVEFORM_KERNELS_AVX2
+
+
+      // Kernel functors, templated on the type of the number of samples:
+
+      struct convert_samlong_waveforms_kernel
+      {
+        const int16_t * interleaved;
+        const waveform_conversion & conversion;
+        float * times_ns;
+        float * ch0_mV;
+        float * ch1_mV;
+        simd_level_type level;
+
+        template <typename Size>
+        void operator()(const Size nsamples_) const
+        {
+          std::size_t done = 0;
+#if defined(CALO_WAVEFORM_KERNELS_AVX2)
+          if (level == SIMD_AVX2) {
+            done = convert_samlong_waveforms_avx2(interleaved, nsamples_, conversion, times_ns, ch0_mV, ch1_mV);
+          }
+#endif // CALO_WAVEFORM_KERNELS_AVX2
+          // Remaining samples:
+          convert_samlong_waveforms_scalar(interleaved, done, nsamples_, conversion, times_ns, ch0_mV, ch1_mV);
+          return;
+        }
+      };
+
+      struct convert_channel_waveform_kernel
+      {
+        const int16_t * samples;
+        const waveform_conversion & conversion;
+        float * amplitudes_mV;
+        simd_level_type level;
+
+        template <typename Size>
+        void operator()(const Size nsamples_) const
+        {
+          std::size_t done = 0;
+#if defined(CALO_WAVEFORM_KERNELS_AVX2)
+          if (level == SIMD_AVX2) {
+            done = convert_channel_waveform_avx2(samples, nsamples_, conversion, amplitudes_mV);
+          }
+#endif // CALO_WAVEFORM_KERNELS_AVX2
+          // Remaining samples:
+          convert_channel_waveform_scalar(samples, done, nsamples_, conversion, amplitudes_mV);
+          return;
+        }
+      };
+
+      struct sum_samples_kernel
+      {
+        const float * samples;
+        simd_level_type level;
+
+        template <typename Size>
+        double operator()(const Size nsamples_) const
+        {
+          double sum = 0.0;
+          std::size_t done = 0;
+#if defined(CALO_WAVEFORM_KERNELS_AVX2)
+          if (level == SIMD_AVX2) {
+            done = sum_samples_avx2(samples, nsamples_, sum);
+          }
+#endif // CALO_WAVEFORM_KERNELS_AVX2
+          for (std::size_t isample = done; isample < nsamples_; isample++) {
+            sum += samples[isample];
+          }
+          return sum;
+        }
+      };
+
+      struct sum_squares_samples_kernel
+      {
+        const float * samples;
+        double & sum;
+        double & sum2;
+        simd_level_type level;
+
+        template <typename Size>
+        void operator()(const Size nsamples_) const
+        {
+          sum  = 0.0;
+          sum2 = 0.0;
+          std::size_t done = 0;
+#if defined(CALO_WAVEFORM_KERNELS_AVX2)
+          if (level == SIMD_AVX2) {
+            done = sum_squares_samples_avx2(samples, nsamples_, sum, sum2);
+          }
+#endif // CALO_WAVEFORM_KERNELS_AVX2
+          for (std::size_t isample = done; isample < nsamples_; isample++) {
+            double x = samples[isample];
+            sum  += x;
+            sum2 += x * x;
+          }
+          return;
+        }
+      };
+
+      struct argmin_samples_kernel
+      {
+        const float * samples;
+        simd_level_type level;
+
+        template <typename Size>
+        std::size_t operator()(const Size nsamples_) const
+        {
+          if (nsamples_ == 0) return 0;
+#if defined(CALO_WAVEFORM_KERNELS_AVX2)
+          if (level == SIMD_AVX2 and nsamples_ >= 8) {
+            float min = 0.0f;
+            std::size_t done = min_samples_avx2(samples, nsamples_, min);
+            for (std::size_t isample = done; isample < nsamples_; isample++) {
+              if (samples[isample] < min) min = samples[isample];
+            }
+            return find_sample_avx2(samples, nsamples_, min);
+          }
+#endif // CALO_WAVEFORM_KERNELS_AVX2
+          std::size_t imin = 0;
+          for (std::size_t isample = 1; isample < nsamples_; isample++) {
+            if (samples[isample] < samples[imin]) imin = isample;
+          }
+          return imin;
+        }
+      };
+
+      struct accumulate_samples_kernel
+      {
+        const float * samples;
+        double * sums;
+        simd_level_type level;
+
+        template <typename Size>
+        void operator()(const Size nsamples_) const
+        {
+          std::size_t done = 0;
+#if defined(CALO_WAVEFORM_KERNELS_AVX2)
+          if (level == SIMD_AVX2) {
+            done = accumulate_samples_avx2(samples, nsamples_, sums);
+          }
+#endif // CALO_WAVEFORM_KERNELS_AVX2
+          for (std::size_t isample = done; isample < nsamples_; isample++) {
+            sums[isample] += samples[isample];
+          }
+          return;
+        }
+      };
+
+    } // namespace
+
+    void set_fixed_size_kernels(const bool enabled_)
+    {
+      fixed_size_kernels_enabled = enabled_;
+      return;
+    }
+
+    bool has_fixed_size_kernels(const std::size_t nsamples_)
+    {
+      return fixed_size_kernels_enabled
+        and (nsamples_ == 1024 or nsamples_ == 512 or nsamples_ == 256 or nsamples_ == 128);
+    }
+
+    void convert_samlong_waveforms(const int16_t * interleaved_,
+                                   const std::size_t nsamples_,
+                                   const waveform_conversion & conversion_,
+                                   float * times_ns_,
+                                   float * ch0_mV_,
+                                   float * ch1_mV_,
+                                   const simd_level_type level_)
+    {
+      convert_samlong_waveforms_kernel kernel{interleaved_, conversion_, times_ns_, ch0_mV_, ch1_mV_, level_};
+      dispatch_fixed_size(nsamples_, kernel);
+      return;
+    }
+
+    void convert_channel_waveform(const int16_t * samples_,
+                                  const std::size_t nsamples_,
+                                  const waveform_conversion & conversion_,
+                                  float * amplitudes_mV_,
+                                  const simd_level_type level_)
+    {
+      convert_channel_waveform_kernel kernel{samples_, conversion_, amplitudes_mV_, level_};
+      dispatch_fixed_size(nsamples_, kernel);
+      return;
+    }
+
+    double sum_samples(const float * samples_,
+                       const std::size_t nsamples_,
+                       const simd_level_type level_)
+    {
+      sum_samples_kernel kernel{samples_, level_};
+      return dispatch_fixed_size(nsamples_, kernel);
+    }
+
+    void sum_squares_samples(const float * samples_,
+                             const std::size_t nsamples_,
+                             double & sum_,
+                             double & sum2_,
+                             const simd_level_type level_)
+    {
+      sum_squares_samples_kernel kernel{samples_, sum_, sum2_, level_};
+      dispatch_fixed_size(nsamples_, kernel);
+      return;
+    }
+
+    std::size_t argmin_samples(const float * samples_,
+                               const std::size_t nsamples_,
+                               const simd_level_type level_)
+    {
+      argmin_samples_kernel kernel{samples_, level_};
+      return dispatch_fixed_size(nsamples_, kernel);
+    }
+
+    void accumulate_samples(const float * samples_,
+                            const std::size_t nsamples_,
+                            double * sums_,
+                            const simd_level_type level_)
+    {
+      accumulate_samples_kernel kernel{samples_, sums_, level_};
+      dispatch_fixed_size(nsamples_, kernel);
+      return;
+    }
+
+    void samlong_waveforms::convert(const int16_t * interleaved_,
+                                    const std::size_t nsamples_,
+                                    const waveform_conversion & conversion_,
+                                    const simd_level_type level_)
+    {
+      times_ns.resize(nsamples_);
+      amplitudes_mV[0].resize(nsamples_);
+      amplitudes_mV[1].resize(nsamples_);
+      convert_samlong_waveforms(interleaved_, nsamples_, conversion_,
+                                times_ns.data(), amplitudes_mV[0].data(), amplitudes_mV[1].data(),
+                                level_);
+      return;
+    }
+
+  } // namespace calo
+} // namespace snfee
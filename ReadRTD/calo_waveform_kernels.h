@@ -0,0 +1,111 @@
+#ifndef CALO_WAVEFORM_KERNELS_H
+#define CALO_WAVEFORM_KERNELS_H
+
+// Standard library:
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace snfee {
+  namespace calo {
+
+    /// \brief SIMD instruction set used by the waveform kernels
+    enum simd_level_type {
+      SIMD_NONE = 0, ///< Scalar code
+      SIMD_AVX2 = 1  ///< AVX2 (x86-64)
+    };
+
+    /// Return the best SIMD instruction set supported by the CPU
+    simd_level_type detect_simd_level();
+
+    /// Return the name of a SIMD instruction set
+    const char * simd_level_name(const simd_level_type level_);
+
+    /// Enable or disable the fixed-size kernels (enabled by default)
+    ///
+    /// The kernels are specialized at compile time for the common readout
+    /// windows (1024, 512, 256 and 128 samples), so that their loops have
+    /// fixed trip counts; other sizes use the generic kernels. Disabling
+    /// them is meant for benchmarks, it is not thread-safe.
+    void set_fixed_size_kernels(const bool enabled_);
+
+    /// Check if a number of samples is processed by the fixed-size kernels
+    bool has_fixed_size_kernels(const std::size_t nsamples_);
+
+    /// \brief Conversion of SAMLONG samples to physical units
+    ///
+    /// Same convention as snfee::algo::calo_waveform_analysis::populate_waveform:
+    /// the time of sample i is i * tdc_to_ns and its amplitude is
+    /// (adc - adc_zero) * adc_to_mV. Computations are done in single precision.
+    struct waveform_conversion
+    {
+      float tdc_to_ns = 0.390625f;    ///< TDC LSB (ns)
+      float adc_zero  = 2048.0f;      ///< ADC value of the 0 mV level
+      float adc_to_mV = 0.610351563f; ///< ADC LSB (mV)
+    };
+
+    /// \brief Converted waveforms of the two channels of a SAMLONG chip
+    struct samlong_waveforms
+    {
+      std::vector<float> times_ns;         ///< Sample times, common to both channels (ns)
+      std::vector<float> amplitudes_mV[2]; ///< Sample amplitudes per channel (mV)
+
+      /// Convert the interleaved samples of both channels in one pass
+      void convert(const int16_t * interleaved_,
+                   const std::size_t nsamples_,
+                   const waveform_conversion & conversion_,
+                   const simd_level_type level_);
+    };
+
+    /// De-interleave and convert the samples of both channels of a SAMLONG chip
+    ///
+    /// The interleaved buffer holds 2 * nsamples_ values (sample i of channel c
+    /// at index 2 * i + c). Output arrays hold nsamples_ values.
+    void convert_samlong_waveforms(const int16_t * interleaved_,
+                                   const std::size_t nsamples_,
+                                   const waveform_conversion & conversion_,
+                                   float * times_ns_,
+                                   float * ch0_mV_,
+                                   float * ch1_mV_,
+                                   const simd_level_type level_);
+
+    /// Convert the contiguous samples of a single channel
+    void convert_channel_waveform(const int16_t * samples_,
+                                  const std::size_t nsamples_,
+                                  const waveform_conversion & conversion_,
+                                  float * amplitudes_mV_,
+                                  const simd_level_type level_);
+
+    /// Return the sum of samples
+    double sum_samples(const float * samples_,
+                       const std::size_t nsamples_,
+                       const simd_level_type level_);
+
+    /// Compute the sum and the sum of squares of samples
+    void sum_squares_samples(const float * samples_,
+                             const std::size_t nsamples_,
+                             double & sum_,
+                             double & sum2_,
+                             const simd_level_type level_);
+
+    /// Return the index of the first minimum sample (0 if there is no sample)
+    std::size_t argmin_samples(const float * samples_,
+                               const std::size_t nsamples_,
+                               const simd_level_type level_);
+
+    /// Add samples to running sums (mean waveforms)
+    void accumulate_samples(const float * samples_,
+                            const std::size_t nsamples_,
+                            double * sums_,
+                            const simd_level_type level_);
+
+  } // namespace calo
+} // namespace snfee
+
+#endif // CALO_WAVEFORM_KERNELS_H
+
+// Local Variables: --
+// mode: c++ --
+// c-file-style: "gnu" --
+// tab-width: 2 --
+// End: --
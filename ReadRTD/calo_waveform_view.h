@@ -0,0 +1,89 @@
+#ifndef CALO_WAVEFORM_VIEW_H
+#define CALO_WAVEFORM_VIEW_H
+
+// Standard library:
+#include <cstdint>
+#include <vector>
+
+// Third party:
+// - Bayeux:
+#include <bayeux/datatools/exception.h>
+
+// This project:
+#include <snfee/data/calo_hit_record.h>
+#include <snfee/model/feb_constants.h>
+
+namespace snfee {
+  namespace calo {
+
+    /// \brief Non-owning strided view on the ADC samples of a SAMLONG channel
+    ///
+    /// The samples of the two channels of a SAMLONG chip are stored
+    /// interleaved in the waveforms record of a calo hit (sample i of
+    /// channel c at index i * 2 + c). The view must not outlive the hit.
+    struct waveform_view
+    {
+      const int16_t * data   = nullptr; ///< Address of the first sample
+      uint16_t        size   = 0;       ///< Number of samples
+      uint16_t        stride = 1;       ///< Distance between two consecutive samples
+
+      /// Return the ADC value of a sample (0-4095)
+      int16_t operator[](const uint16_t isample_) const
+      {
+        return data[isample_ * stride];
+      }
+
+      /// Copy the samples in a vector
+      void copy_to(std::vector<uint16_t> & samples_) const
+      {
+        samples_.resize(size);
+        for (uint16_t isample = 0; isample < size; isample++) {
+          samples_[isample] = data[isample * stride];
+        }
+        return;
+      }
+    };
+
+    /// Return a view on the samples of a SAMLONG channel of a calo hit (empty if no waveform)
+    inline waveform_view make_waveform_view(const snfee::data::calo_hit_record & calo_hit_,
+                                            const int ichannel_)
+    {
+      waveform_view view;
+      if (!calo_hit_.has_waveforms()) return view;
+      const std::vector<int16_t> & samples = calo_hit_.get_waveforms().get_samples();
+      uint16_t nsamples = calo_hit_.get_waveform_number_of_samples();
+      DT_THROW_IF(samples.size() < (std::size_t) nsamples * snfee::model::feb_constants::SAMLONG_NUMBER_OF_CHANNELS,
+                  std::logic_error,
+                  "Unexpected number of interleaved waveform samples (" << samples.size() << ")!");
+      view.data   = samples.data() + ichannel_;
+      view.size   = nsamples;
+      view.stride = snfee::model::feb_constants::SAMLONG_NUMBER_OF_CHANNELS;
+      return view;
+    }
+
+    /// De-interleave the samples of both SAMLONG channels of a calo hit in one pass
+    inline void deinterleave_waveforms(const snfee::data::calo_hit_record & calo_hit_,
+                                       std::vector<uint16_t> & ch0_samples_,
+                                       std::vector<uint16_t> & ch1_samples_)
+    {
+      waveform_view view0 = make_waveform_view(calo_hit_, 0);
+      ch0_samples_.resize(view0.size);
+      ch1_samples_.resize(view0.size);
+      const int16_t * samples = view0.data;
+      for (uint16_t isample = 0; isample < view0.size; isample++) {
+        ch0_samples_[isample] = samples[2 * isample];
+        ch1_samples_[isample] = samples[2 * isample + 1];
+      }
+      return;
+    }
+
+  } // namespace calo
+} // namespace snfee
+
+#endif // CALO_WAVEFORM_VIEW_H
+
+// Local Variables: --
+// mode: c++ --
+// c-file-style: "gnu" --
+// tab-width: 2 --
+// End: --
@@ -1,11 +1,18 @@
 // Standard library:
+#include <algorithm>
+#include <chrono>
 #include <cstdlib>
 #include <exception>
+#include <limits>
 #include <iostream>
 #include <string>
 #include <vector>
 #include <set>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <sys/stat.h>
 
 // Third party:
 // - Boost:
@@ -13,18 +20,17 @@
 // - Bayeux:
 #include <bayeux/datatools/clhep_units.h>
 #include <bayeux/datatools/temporary_files.h>
+#include <bayeux/datatools/utils.h>
 #include <bayeux/dpp/histogram_service.h>
 #include <bayeux/mygsl/tabulated_sampling.h>
 #include <bayeux/mygsl/tabulated_function.h>
 
 // This project:
 #include <snfee/snfee.h>
-#include <snfee/io/multifile_data_reader.h>
 #include <snfee/data/raw_trigger_data.h>
 #include <snfee/data/calo_hit_record.h>
 #include <snfee/data/channel_id.h>
 #include <snfee/data/channel_id_selection.h>
-#include <snfee/data/calo_waveform_drawer.h>
 #include <snfee/data/calo_waveform_data.h>
 #include <snfee/algo/calo_waveform_analysis.h>
 #include <snfee/algo/calo_mean_waveform.h>
@@ -34,6 +40,16 @@
 // This example:
 #include "calo_histogramming.h"
 #include "calo_waveform_fft.h"
+#include "calo_hit_processing.h"
+#include "calo_rtd_pipeline.h"
+#include "rtd_prefetch_reader.h"
+#include "calo_stage_timing.h"
+#include "calo_measurement_engine.h"
+#include "calo_firmware_emulation.h"
+#include "calo_columnar_store.h"
+#include "calo_waveform_export.h"
+#include "calo_noise_spectrum.h"
+#include "calo_waveform_display.h"
 
 /// \brief Application configuration parameters
 struct app_params_type
@@ -42,7 +58,7 @@ struct app_params_type
   datatools::logger::priority logging = datatools::logger::PRIO_FATAL;
   
   /// Configuration for raw data reader: 
-  snfee::io::multifile_data_reader::config_type reader_cfg;
+  snfee::calo::rtd_prefetch_reader::config_type reader_cfg;
   
   /// Maximum number of RTD records to be read
   uint32_t max_rtd = 0;
@@ -79,9 +95,71 @@ struct app_params_type
   
   /// Activation of visualization
   bool display = false;
+
+  /// Configuration of the waveform display
+  snfee::calo::waveform_display::config_type display_cfg;
+
+  /// Number of worker threads (pipelined mode if > 1)
+  std::size_t number_of_threads = 1;
+
+  /// Distribute the input file parts to the worker threads
+  bool parallel_parts = false;
+
+  /// Number of RTD records loaded at once
+  std::size_t batch_size = 16;
+
+  /// Period of the histogram flushes (second, 0: no periodic flush)
+  double flush_period = 0.0;
+
+  /// Number of RTD records between histogram flushes (0: no periodic flush)
+  std::size_t flush_records = 0;
+
+  /// Checkpoint filename, stored with each histogram flush (empty: no checkpoint)
+  std::string checkpoint_filename;
+
+  /// Resume the processing from the checkpoint
+  bool resume = false;
+
+  /// Activation of the stage timing report
+  bool timing = false;
+
+  /// Output filename of the machine-readable stage timing report
+  std::string timing_output_filename;
+
+  /// Comparison of the SIMD measurement engine with the snfee measurements
+  bool engine_check = false;
+
+  /// Number of waveforms measured at once by the SIMD engine (0: no batching)
+  std::size_t waveform_batch_size = 0;
+
+  /// Comparison of the recorded firmware measurements with their emulation
+  bool firmware_check = false;
+
+  /// Accumulation of the averaged noise spectral densities per channel
+  bool noise_spectra = false;
+
+  /// Output filename of the compressed waveform export (empty: no export)
+  std::string export_filename;
+
+  /// Maximum peak amplitude magnitude of the exported waveforms (mV, pulses are negative)
+  double export_max_peak_mV = std::numeric_limits<double>::infinity();
   
 };
 
+/// \brief Processing resources owned by a worker thread in pipelined mode
+struct worker_type
+{
+  std::unique_ptr<snfee::algo::calo_waveform_analysis> calo_analysis;
+  std::unique_ptr<snfee::algo::calo_waveform_fft>      calo_fft;
+  snfee::calo::histogramming *                         calo_histograms = nullptr; ///< Histogram shard
+  std::unique_ptr<snfee::calo::hit_processing>         calo_processing;
+  std::size_t selection_counter = 0;
+  snfee::calo::stage_timing timing;
+  snfee::calo::measurement_comparison engine_comparison;
+  snfee::calo::firmware_comparison fw_comparison;
+  std::unique_ptr<snfee::calo::noise_spectrum> noise;
+};
+
 int main(int argc_, char ** argv_)
 {
   snfee::initialize();
@@ -105,12 +183,22 @@ int main(int argc_, char ** argv_)
        po::value<std::vector<std::string>>(&app_params.reader_cfg.filenames)
        ->multitoken()
        ->value_name("path"),
-       "add a RTD input filename")
+       "add a RTD input filename (or a columnar store '.cols' filename)")
   
       ("max-rtd,X",
        po::value<uint32_t>(&app_params.max_rtd)
        ->value_name("number"),
        "set the maximum number of processed RTD objects")
+
+      ("first-rtd",
+       po::value<std::size_t>(&app_params.reader_cfg.first_record)
+       ->value_name("number"),
+       "set the rank of the first processed RTD object (previous ones are skipped)")
+
+      ("prefetch",
+       po::value<std::size_t>(&app_params.reader_cfg.capacity)
+       ->value_name("number"),
+       "set the number of RTD objects loaded in advance by a background thread (0: no prefetch, else at least the batch size)")
  
       ("low-threshold,l",
        po::value<bool>(&app_params.process_lt)->zero_tokens()->default_value(false),
@@ -182,7 +270,7 @@ int main(int argc_, char ** argv_)
        po::value<bool>(&app_params.do_waveform_fft)
        ->zero_tokens()
        ->default_value(false),
-       "compute waveform FFT")
+       "compute waveform FFT (displayed with --calo-display, ignored otherwise)")
      
       ("calo-display,D",
        po::value<bool>(&app_params.display)
@@ -190,6 +278,121 @@ int main(int argc_, char ** argv_)
        ->default_value(false),
        "display the calo hit waveforms (and FFT is available)")
 
+      ("display-every",
+       po::value<std::size_t>(&app_params.display_cfg.every)
+       ->default_value(1)
+       ->value_name("number"),
+       "display every N-th candidate waveform")
+
+      ("display-flagged",
+       po::value<bool>(&app_params.display_cfg.only_flagged)
+       ->zero_tokens()
+       ->default_value(false),
+       "display only the flagged waveforms (firmware emulation mismatches, see --calo-firmware-check)")
+
+      ("display-period",
+       po::value<double>(&app_params.display_cfg.min_period)
+       ->default_value(0.5)
+       ->value_name("second"),
+       "set the minimum time between two displays (waveforms submitted meanwhile are dropped)")
+
+      ("threads,j",
+       po::value<std::size_t>(&app_params.number_of_threads)
+       ->value_name("number"),
+       "set the number of worker threads processing the calo hits")
+
+      ("parallel-parts",
+       po::value<bool>(&app_params.parallel_parts)
+       ->zero_tokens()
+       ->default_value(false),
+       "process each input file part in its own worker thread")
+
+      ("batch-size",
+       po::value<std::size_t>(&app_params.batch_size)
+       ->default_value(16)
+       ->value_name("number"),
+       "set the number of RTD records loaded at once")
+
+      ("follow",
+       po::value<bool>(&app_params.reader_cfg.follow)
+       ->zero_tokens()
+       ->default_value(false),
+       "wait for new records at the end of the last input file (file being written by the DAQ)")
+
+      ("follow-timeout",
+       po::value<double>(&app_params.reader_cfg.follow_timeout)
+       ->default_value(600.0)
+       ->value_name("seconds"),
+       "stop following the last input file after this duration without new data (0: never)")
+
+      ("flush-period",
+       po::value<double>(&app_params.flush_period)
+       ->default_value(0.0)
+       ->value_name("seconds"),
+       "periodically store the histograms in the output file")
+
+      ("flush-records",
+       po::value<std::size_t>(&app_params.flush_records)
+       ->default_value(0)
+       ->value_name("number"),
+       "store the histograms in the output file every given number of RTD records")
+
+      ("checkpoint-file",
+       po::value<std::string>(&app_params.checkpoint_filename)
+       ->value_name("path"),
+       "store the histograms and the reader position in a checkpoint file at each histogram flush")
+
+      ("resume",
+       po::value<bool>(&app_params.resume)
+       ->zero_tokens()
+       ->default_value(false),
+       "resume the processing from the checkpoint file, if it exists")
+
+      ("timing",
+       po::value<bool>(&app_params.timing)
+       ->zero_tokens()
+       ->default_value(false),
+       "report the time spent in each processing stage and the throughput")
+
+      ("timing-output-file",
+       po::value<std::string>(&app_params.timing_output_filename)
+       ->value_name("path"),
+       "store the stage timing report in a machine-readable file (implies --timing)")
+
+      ("calo-engine-check",
+       po::value<bool>(&app_params.engine_check)
+       ->zero_tokens()
+       ->default_value(false),
+       "compare the SIMD measurement engine with the snfee measurements")
+
+      ("calo-batch-size",
+       po::value<std::size_t>(&app_params.waveform_batch_size)
+       ->default_value(0)
+       ->value_name("number"),
+       "set the number of waveforms measured at once by the SIMD engine (0: no batching)")
+
+      ("calo-firmware-check",
+       po::value<bool>(&app_params.firmware_check)
+       ->zero_tokens()
+       ->default_value(false),
+       "compare the firmware measurements with their emulation on the waveforms")
+
+      ("calo-noise-spectra",
+       po::value<bool>(&app_params.noise_spectra)
+       ->zero_tokens()
+       ->default_value(false),
+       "accumulate the averaged noise spectral density of each channel in the histograms")
+
+      ("export-waveforms",
+       po::value<std::string>(&app_params.export_filename)
+       ->value_name("path"),
+       "set the output filename of the compressed waveform export")
+
+      ("export-max-peak",
+       po::value<double>(&app_params.export_max_peak_mV)
+       ->value_name("mV"),
+       "set the maximum magnitude of the (negative) peak amplitude of the exported waveforms (mV, default: no limit)")
+
     ; // end of options description
 
     // Describe command line arguments :
@@ -211,7 +414,8 @@ int main(int argc_, char ** argv_)
       std::cout << " snfee-rtd-ana-calo \\\n";
       std::cout << "    --input-file \"snemo_run-8_rtd_part-0.data.gz\" \\\n";
       std::cout << "    --input-file \"snemo_run-8_rtd_part-1.data.gz\" \\\n";
-      std::cout << "    --input-file \"snemo_run-8_rtd_part-2.data.gz\" \n";
+      std::cout << "    --input-file \"snemo_run-8_rtd_part-2.data.gz\" \\\n";
+      std::cout << "    --threads 8 \\\n";
       std::cout << "    --output-file-histograms \"snemo_run-8_rtd_calo_histos.root\" \n";
       std::cout << std::endl << std::endl;  
       return (-1);
@@ -240,11 +444,74 @@ int main(int argc_, char ** argv_)
       }
     }
 
+    // Columnar stores ('.cols' files) are processed by blocks of calo hit channels:
+    std::size_t number_of_columnar_inputs = 0;
+    for (const auto & filename : app_params.reader_cfg.filenames) {
+      if (filename.size() > 5 and filename.compare(filename.size() - 5, 5, ".cols") == 0) {
+        number_of_columnar_inputs++;
+      }
+    }
+    bool columnar_input = (number_of_columnar_inputs > 0);
+    if (columnar_input) {
+      DT_THROW_IF(number_of_columnar_inputs != app_params.reader_cfg.filenames.size(),
+                  std::logic_error,
+                  "Cannot mix RTD and columnar store input files!");
+      DT_THROW_IF(app_params.max_rtd > 0 or app_params.reader_cfg.first_record > 0,
+                  std::logic_error,
+                  "RTD record range is not supported with columnar store input files!");
+      // Blocks are always distributed to the worker threads:
+      app_params.parallel_parts = false;
+      DT_THROW_IF(app_params.reader_cfg.follow,
+                  std::logic_error,
+                  "Follow mode is not supported with columnar store input files!");
+    }
+
+    if (app_params.parallel_parts and app_params.number_of_threads <= 1) {
+      // One worker per hardware thread by default, at most one per input file part:
+      app_params.number_of_threads = std::min<std::size_t>(std::max(std::thread::hardware_concurrency(), 1u),
+                                                           app_params.reader_cfg.filenames.size());
+    }
+    if (app_params.number_of_threads <= 1) {
+      app_params.parallel_parts = false;
+    }
+    DT_THROW_IF(app_params.batch_size == 0,
+                std::logic_error,
+                "Invalid batch size!");
+    if (app_params.reader_cfg.capacity > 0 and app_params.reader_cfg.capacity < app_params.batch_size) {
+      // A batch waits for the whole prefetch buffer at most, the buffer must hold a full batch:
+      DT_LOG_NOTICE(app_params.logging, "Prefetch buffer enlarged to the batch size ("
+                    << app_params.batch_size << " RTD objects)");
+      app_params.reader_cfg.capacity = app_params.batch_size;
+    }
+    DT_THROW_IF(app_params.reader_cfg.follow and app_params.parallel_parts,
+                std::logic_error,
+                "Follow mode is not supported with parallel parts!");
+    bool periodic_flush = (app_params.flush_period > 0.0 or app_params.flush_records > 0);
+    DT_THROW_IF(periodic_flush and (columnar_input or app_params.parallel_parts),
+                std::logic_error,
+                "Periodic histogram flushes are only supported with RTD records read in order!");
+    if (!app_params.checkpoint_filename.empty()) {
+      DT_THROW_IF(!app_params.do_histogramming,
+                  std::logic_error,
+                  "Checkpoints are stored with the histograms!");
+      DT_THROW_IF(columnar_input or app_params.parallel_parts,
+                  std::logic_error,
+                  "Checkpoints are only supported with RTD records read in order!");
+    }
+    if (app_params.resume) {
+      DT_THROW_IF(app_params.checkpoint_filename.empty(),
+                  std::logic_error,
+                  "Missing checkpoint file to resume from!");
+      DT_THROW_IF(app_params.do_mean_waveforms or app_params.noise_spectra or !app_params.export_filename.empty(),
+                  std::logic_error,
+                  "Mean waveforms, noise spectra and waveform exports cannot be resumed!");
+    }
+
     // Raw calo hit measurement algorithms :
     std::unique_ptr<snfee::algo::calo_waveform_analysis> calo_analysis;
+    snfee::algo::calo_waveform_analysis::config_type analysis_cfg; // Default configuration
     if (app_params.do_waveform_measurements) {
       DT_LOG_DEBUG(app_params.logging, "Instantiating calo analysis...");
-      snfee::algo::calo_waveform_analysis::config_type analysis_cfg; // Default configuration
       if (!app_params.analysis_config_path.empty()) {
         // Parse analysis parameters:
         analysis_cfg.parse(app_params.analysis_config_path);
@@ -256,10 +523,63 @@ int main(int argc_, char ** argv_)
         app_params.histogramming_cfg.histo_from_firmware = true;
       }
     }
+
+    // SIMD measurement engine (shared, stateless):
+    std::unique_ptr<const snfee::calo::measurement_engine> calo_engine;
+    std::unique_ptr<snfee::calo::measurement_comparison> calo_engine_comparison;
+    if (calo_analysis) {
+      snfee::calo::measurement_engine::config_type engine_cfg;
+      if (!app_params.analysis_config_path.empty()) {
+        engine_cfg.parse(app_params.analysis_config_path);
+      }
+      if (engine_cfg.use_simd()) {
+        DT_LOG_DEBUG(app_params.logging, "Instantiating SIMD measurement engine...");
+        calo_engine.reset(new snfee::calo::measurement_engine(engine_cfg));
+        std::clog << "Calo measurement engine : simd ("
+                  << snfee::calo::simd_level_name(snfee::calo::detect_simd_level()) << ")" << std::endl;
+        if (!app_params.engine_check) {
+          std::clog << "Warning: the simd engine is experimental, its agreement with the snfee measurements "
+                    << "has not been measured on real data (use --calo-engine-check)" << std::endl;
+        }
+        if (app_params.engine_check) {
+          calo_engine_comparison.reset(new snfee::calo::measurement_comparison);
+        }
+      }
+    }
+    DT_THROW_IF(app_params.engine_check and !calo_engine,
+                std::logic_error,
+                "The engine check needs waveform measurements with the 'simd' engine!");
+    // Firmware emulation:
+    std::unique_ptr<const snfee::calo::firmware_emulation> calo_fw_emulation;
+    std::unique_ptr<snfee::calo::firmware_comparison> calo_fw_comparison;
+    if (app_params.firmware_check) {
+      snfee::calo::firmware_emulation::config_type fw_emulation_cfg;
+      if (!app_params.analysis_config_path.empty()) {
+        fw_emulation_cfg.parse(app_params.analysis_config_path);
+      }
+      calo_fw_emulation.reset(new snfee::calo::firmware_emulation(fw_emulation_cfg));
+      calo_fw_comparison.reset(new snfee::calo::firmware_comparison);
+      app_params.histogramming_cfg.histo_firmware_check = true;
+    }
+    // Noise spectral densities:
+    snfee::calo::noise_spectrum::config_type noise_cfg;
+    std::unique_ptr<snfee::calo::noise_spectrum> calo_noise;
+    if (app_params.noise_spectra) {
+      DT_THROW_IF(!app_params.do_histogramming,
+                  std::logic_error,
+                  "Noise spectra are stored with the histograms!");
+      if (!app_params.analysis_config_path.empty()) {
+        noise_cfg.parse(app_params.analysis_config_path);
+      }
+      calo_noise.reset(new snfee::calo::noise_spectrum(noise_cfg));
+    }
+    DT_THROW_IF(app_params.waveform_batch_size > 0 and !calo_engine,
+                std::logic_error,
+                "Waveform batches need waveform measurements with the 'simd' engine!");
   
     std::unique_ptr<snfee::algo::calo_waveform_fft> calo_fft;
+    snfee::algo::calo_waveform_fft::config_type fft_cfg;
     if (app_params.do_waveform_fft) {
-      snfee::algo::calo_waveform_fft::config_type fft_cfg;
       calo_fft.reset(new snfee::algo::calo_waveform_fft(fft_cfg));
       calo_fft->initialize();
     }
@@ -269,19 +589,56 @@ int main(int argc_, char ** argv_)
                 std::logic_error,
                 "Missing input RTD filenames!");
    
-    // Instantiate a reader:
-    snfee::io::multifile_data_reader rtd_source(app_params.reader_cfg);
-
-    // Working RTD object:
-    snfee::data::raw_trigger_data rtd;
- 
     // Histogramming:
     std::unique_ptr<snfee::calo::histogramming> calo_histogramming;
     if (app_params.do_histogramming) {
       calo_histogramming.reset(new snfee::calo::histogramming(app_params.histogramming_cfg));
       calo_histogramming->initialize();
     }
-    
+
+    // Resume from the checkpoint (histograms and reader position):
+    const std::size_t checkpoint_first_record = app_params.reader_cfg.first_record;
+    std::size_t resumed_records = 0;
+    std::size_t resumed_selection = 0;
+    if (app_params.resume) {
+      struct stat st;
+      if (::stat(app_params.checkpoint_filename.c_str(), &st) == 0) {
+        std::map<std::string, uint64_t> counters;
+        calo_histogramming->load_checkpoint(app_params.checkpoint_filename, counters);
+        DT_THROW_IF(counters["first_record"] != checkpoint_first_record,
+                    std::logic_error,
+                    "Checkpoint '" << app_params.checkpoint_filename << "' starts at RTD record "
+                    << counters["first_record"] << "!");
+        resumed_records   = counters["records"];
+        resumed_selection = counters["selected_channels"];
+        app_params.reader_cfg.first_record += resumed_records;
+        std::clog << "Resumed from checkpoint after " << resumed_records << " RTD objects" << std::endl;
+      } else {
+        std::clog << "No checkpoint to resume from, starting from the first RTD object" << std::endl;
+      }
+    }
+
+    // Instantiate a reader (input file parts are opened by the workers in parallel parts mode):
+    std::unique_ptr<snfee::calo::rtd_prefetch_reader> rtd_source;
+    std::vector<std::unique_ptr<snfee::calo::columnar_reader>> columnar_sources;
+    std::vector<const snfee::calo::columnar_store::block_view *> columnar_blocks;
+    std::size_t columnar_records = 0;
+    if (columnar_input) {
+      for (const auto & filename : app_params.reader_cfg.filenames) {
+        columnar_sources.emplace_back(new snfee::calo::columnar_reader(filename));
+        const snfee::calo::columnar_reader & source = *columnar_sources.back();
+        for (std::size_t iblock = 0; iblock < source.get_number_of_blocks(); iblock++) {
+          columnar_blocks.push_back(&source.get_block(iblock));
+        }
+        columnar_records += source.get_number_of_records();
+      }
+    } else if (!app_params.parallel_parts) {
+      rtd_source.reset(new snfee::calo::rtd_prefetch_reader(app_params.reader_cfg, app_params.logging));
+    }
+
+    // Working RTD objects:
+    std::vector<snfee::calo::rtd_prefetch_reader::rtd_ptr_type> rtd_batch;
+ 
     // Mean waveform computing:
     std::unique_ptr<snfee::algo::calo_mean_waveform_processor> calo_mean_waveform;
     if (app_params.do_mean_waveforms) {
@@ -290,244 +647,317 @@ int main(int argc_, char ** argv_)
       calo_mean_waveform->initialize();
     }
     
-    /// Waveform drawer:
-    std::unique_ptr<snfee::data::calo_waveform_drawer> calo_drawer;
+    /// Waveform display (shared by the worker threads):
+    std::unique_ptr<snfee::calo::waveform_display> calo_display;
     if (app_params.display) {
-      bool auto_range_time = true;
-      bool auto_range_voltage = true;
-      double time_min_ns = 0.0;
-      double time_max_ns =
-        snfee::model::feb_constants::SAMLONG_DEFAULT_TDC_LSB_NS
-        * snfee::model::feb_constants::SAMLONG_MAX_NUMBER_OF_SAMPLES;
-      double voltage_upper_mV = snfee::model::feb_constants::SAMLONG_ADC_MAX_VOLTAGE_MV / 5;
-      double voltage_lower_mV = snfee::model::feb_constants::SAMLONG_ADC_MIN_VOLTAGE_MV;
-      calo_drawer.reset(new snfee::data::calo_waveform_drawer(time_min_ns,
-                                                              time_max_ns,
-                                                              voltage_lower_mV,
-                                                              voltage_upper_mV,
-                                                              auto_range_time,
-                                                              auto_range_voltage));
+      calo_display.reset(new snfee::calo::waveform_display(app_params.display_cfg, app_params.logging));
     }
         
-    // Calorimeter hit channel ID selector:
-    snfee::data::channel_id_selection calo_channel_selector(app_params.calo_channel_selector_cfg);
-
-    // Loop on stored RTD objects:
-    std::size_t rtd_counter = 0;
-    std::size_t selection_counter = 0;
-    while (rtd_source.has_record_tag()) {
-
-      // Check the serialization tag of the next record:
-      DT_THROW_IF(!rtd_source.record_tag_is(snfee::data::raw_trigger_data::SERIAL_TAG),
+    // Calo hit processing:
+    snfee::calo::hit_processing::config_type processing_cfg;
+    processing_cfg.selection.process_lt = app_params.process_lt;
+    processing_cfg.selection.process_ht = app_params.process_ht;
+    processing_cfg.selection.calo_channel_selector_cfg = app_params.calo_channel_selector_cfg;
+    processing_cfg.waveform_batch_size = app_params.waveform_batch_size;
+    processing_cfg.export_max_peak_mV  = app_params.export_max_peak_mV;
+
+    // Compressed waveform export:
+    std::unique_ptr<snfee::calo::waveform_export_writer> calo_exporter;
+    std::mutex calo_exporter_mutex;
+    if (!app_params.export_filename.empty()) {
+      DT_THROW_IF(!(app_params.export_max_peak_mV >= 0.0),
                   std::logic_error,
-                  "Unexpected record tag '" << rtd_source.get_record_tag() << "'!");
+                  "Invalid maximum peak amplitude of the exported waveforms (the limit is a positive magnitude)!");
+      calo_exporter.reset(new snfee::calo::waveform_export_writer(app_params.export_filename));
+    }
 
-      // Load the next RTD object:
-      rtd_source.load(rtd);
+    // Stage timing:
+    if (!app_params.timing_output_filename.empty()) {
+      app_params.timing = true;
+    }
+    std::unique_ptr<snfee::calo::stage_timing> timing;
+    if (app_params.timing) {
+      timing.reset(new snfee::calo::stage_timing);
+      for (const auto & filename : app_params.reader_cfg.filenames) {
+        std::string path = filename;
+        struct stat st;
+        if (datatools::fetch_path_with_env(path) and ::stat(path.c_str(), &st) == 0) {
+          timing->number_of_bytes += st.st_size;
+        }
+      }
+      timing->start();
+    }
 
-      // Debug print:
-      if (datatools::logger::is_debug(app_params.logging)) {
-        boost::property_tree::ptree options;
-        options.put("title", "Raw trigger data: ");
-        options.put("indent", "[debug] ");
-        rtd.print_tree(std::cerr, options);
+    // Loop on stored RTD objects:
+    std::size_t rtd_counter = resumed_records;
+    std::size_t selection_counter = resumed_selection;
+    auto store_checkpoint = [&](const std::size_t records_, const std::size_t selected_channels_)
+    {
+      std::map<std::string, uint64_t> counters;
+      counters["first_record"]      = checkpoint_first_record;
+      counters["records"]           = records_;
+      counters["selected_channels"] = selected_channels_;
+      calo_histogramming->store_checkpoint(app_params.checkpoint_filename, counters);
+    };
+    if (app_params.number_of_threads <= 1) {
+
+      snfee::calo::hit_processing calo_processing(processing_cfg, app_params.logging);
+      calo_processing.analysis      = calo_analysis.get();
+      calo_processing.fft           = calo_fft.get();
+      calo_processing.mean_waveform = calo_mean_waveform.get();
+      calo_processing.histos        = calo_histogramming.get();
+      calo_processing.display       = calo_display.get();
+      calo_processing.timing        = timing.get();
+      calo_processing.engine        = calo_engine.get();
+      calo_processing.comparison    = calo_engine_comparison.get();
+      calo_processing.fw_emulation  = calo_fw_emulation.get();
+      calo_processing.fw_comparison = calo_fw_comparison.get();
+      calo_processing.exporter      = calo_exporter.get();
+      calo_processing.noise         = calo_noise.get();
+      calo_processing.prepare();
+      calo_processing.get_plan().print(std::clog);
+
+      // Process the blocks of the columnar stores:
+      for (const auto * block : columnar_blocks) {
+        selection_counter += calo_processing.process(*block);
       }
+      rtd_counter += columnar_records;
+
+      // Periodic flushes of the histograms:
+      auto last_flush_time = std::chrono::steady_clock::now();
+      std::size_t last_flush_counter = rtd_counter;
+
+      // Load the next batch of RTD objects:
+      while (rtd_source) {
+        std::size_t batch_size = app_params.batch_size;
+        if (app_params.max_rtd > 0) {
+          // A resumed checkpoint may already be beyond the maximum number of records:
+          if (rtd_counter >= app_params.max_rtd) break;
+          batch_size = std::min<std::size_t>(batch_size, app_params.max_rtd - rtd_counter);
+        }
+        std::size_t loaded = 0;
+        {
+          snfee::calo::stage_timing::scope timed(timing.get(), snfee::calo::stage_timing::STAGE_LOAD);
+          loaded = rtd_source->load_batch(rtd_batch, batch_size);
+        }
+        if (loaded == 0) break;
 
-      // General informations:
-      int32_t trigger_id = rtd.get_trigger_id();
-      int32_t run_id     = rtd.get_run_id();
+        for (const auto & p_rtd : rtd_batch) {
+          const snfee::data::raw_trigger_data & rtd = *p_rtd;
 
-      // Loop on calo hit records in the RTD data object:
-      for (const auto & p_calo_hit : rtd.get_calo_hits()) {
-        
-        // Dereference the stored shared pointer oin the calo hit record:
-        const snfee::data::calo_hit_record & calo_hit = *p_calo_hit;
-        
-        if (datatools::logger::is_debug(app_params.logging)) {
-          boost::property_tree::ptree options;
-          options.put("title", "Loaded calorimeter raw hit data record: ");
-          options.put("with_waveform_samples", true);
-          calo_hit.print_tree(std::clog, options);
-        }
-       
-        // General calo hit's data:
-        int32_t  calo_trigger_id = calo_hit.get_trigger_id(); // Trigger unique ID associated to the calo hit
-        uint64_t tdc             = calo_hit.get_tdc();        // TDC timestamp (48 bits)
-        int32_t  crate_num       = calo_hit.get_crate_num();  // Crate number (0,1,2)
-        int32_t  board_num       = calo_hit.get_board_num();  // Board number (0-19)
-        int32_t  chip_num        = calo_hit.get_chip_num();   // Chip number (0-7)
-        uint16_t fcr             = calo_hit.get_fcr();        // First cell read (TDC: 0-1023)
-        
-        // Waveform recording:
-        bool     has_waveforms              = calo_hit.has_waveforms();                  // Default: true
-        uint16_t waveform_start_sample      = calo_hit.get_waveform_start_sample();      // Default: 0 (TDC)
-        uint16_t waveform_number_of_samples = calo_hit.get_waveform_number_of_samples(); // Default: 1024 (TDC)
-        
-        // Extract SAMLONG channels' data:
-        for (int ichannel = 0; ichannel < snfee::model::feb_constants::SAMLONG_NUMBER_OF_CHANNELS; ichannel++) {
-          
-          const snfee::data::calo_hit_record::channel_data_record & ch_data = calo_hit.get_channel_data(ichannel);
-          bool    ch_lt           = ch_data.is_lt();            // Low threshold flag
-          bool    ch_ht           = ch_data.is_ht();            // High threshold flag
-          bool    ch_underflow    = ch_data.is_underflow();     // Underflow flag
-          bool    ch_overflow     = ch_data.is_overflow();      // Charge overflow flag
-          int32_t ch_baseline     = ch_data.get_baseline();     // Computed baseline       (LSB: ADC unit/16)
-          int32_t ch_peak         = ch_data.get_peak();         // Computed peak amplitude (LSB: ADC unit/8)
-          int32_t ch_peak_cell    = ch_data.get_peak_cell();    // Computed peak position  (TDC: 0-1023)
-          int32_t ch_charge       = ch_data.get_charge();       // Computed charge
-          int32_t ch_rising_cell  = ch_data.get_rising_cell();  // Computed rising edge crossing (LSB: TDC unit/256)
-          int32_t ch_falling_cell = ch_data.get_falling_cell(); // Computed falling edge crossing (LSB: TDC unit/256)
-
-          // Compute a comprehensive readout Wavecatcher channel ID object (crate number+board number+channel number):
-          snfee::data::channel_id ch_id(crate_num, // [0-2]
-                                        board_num, // [0-9,11-20]
-                                        snfee::model::feb_constants::SAMLONG_NUMBER_OF_CHANNELS * chip_num + ichannel); // [0-15]
-
-          // Declare the waveform for this SAMLONG channel:
-          std::vector<uint16_t> ch_waveform;
-
-          // Check if the histograms should be filled for this calo hit:
-          bool selected_channel = true;
-          
-          // Select hit to be histogrammed:
-          if (app_params.process_lt and !ch_lt) {
-            // Hit with LT flag:
-            selected_channel = false;
-          }
-          if (app_params.process_ht and !ch_ht) {
-            // Hit with HT flag:
-            selected_channel = false;
-          }
-          if (!calo_channel_selector(ch_id)) {
-            // Hit with allowed channel ID:
-            selected_channel = false;
+          // Debug print:
+          if (datatools::logger::is_debug(app_params.logging)) {
+            boost::property_tree::ptree options;
+            options.put("title", "Raw trigger data: ");
+            options.put("indent", "[debug] ");
+            rtd.print_tree(std::cerr, options);
           }
 
-          // Process selected channels:
-          if (selected_channel) {
-
-            // Constants:
-            double tdc_to_ns = snfee::model::feb_constants::SAMLONG_DEFAULT_TDC_LSB_NS;
-            double adc_to_mV = snfee::model::feb_constants::SAMLONG_ADC_VOLTAGE_LSB_MV;
-
-            // Firmware metadata:
-            double charge_nVs  = ch_charge * 1e-3 * adc_to_mV * tdc_to_ns;
-            double peak_mV     = ch_peak * adc_to_mV / 8;
-            double baseline_mV = ch_baseline * adc_to_mV / 16;
-            
-            // Waveform processing:
-            if (has_waveforms) {
-              
-              // Extract ADC samples for the SAMLONG channel from the interleaved SAMLONG data:
-              // Fill the waveform for this SAMLONG channel:
-              ch_waveform.reserve(waveform_number_of_samples);
-              for (int isample = 0; isample < waveform_number_of_samples; isample++) {
-                int16_t adc = calo_hit.get_waveforms().get_adc(isample, ichannel); // 0-4095 (ADC)
-                ch_waveform.push_back(adc); 
-              }
-              
-              // Working waveform data structure (for dedicated measurements):
-              snfee::data::calo_waveform_info waveform_info;
-
-              // Waveform analysis and measurements:
-              if (calo_analysis) {
-                DT_LOG_DEBUG(app_params.logging, "Do calo waveform analysis...");
-                // Processing waveforms:
-                calo_analysis->init_from_raw_data(ch_id, ch_data, ch_waveform, waveform_info);
-                calo_analysis->do_measurements(ch_id, waveform_info);
-                if (datatools::logger::is_debug(app_params.logging)) {
-                  waveform_info.print(std::cerr, "Waveform info : ", "[debug] ");
-                }
-              }
+          // Process the calo hit records in the RTD data object:
+          selection_counter += calo_processing.process(rtd);
 
-              if (calo_fft) {
-                DT_LOG_DEBUG(app_params.logging, "Do calo waveform FFT...");
-                std::vector<double> ft;
-                std::vector<double> fwf;
-                double frequency_step;
-                calo_fft->transform(waveform_info.waveform, ft, fwf, frequency_step);
-                if (app_params.display) {
-                  std::string title = "Waveform FFT for calo channel [" + ch_id.to_string() + "]";
-                  snfee::algo::calo_waveform_fft::display_waveform_fft(ft,
-                                                                       frequency_step,
-                                                                       title);
-                }
-              }
- 
-              // Mean waveform processing:
-              if (calo_mean_waveform) {
-                calo_mean_waveform->process_waveform(ch_id, waveform_info);
-                if (app_params.histogramming_cfg.histo_from_firmware) {
-                  // Using measurements from waveform analysis:
-                  baseline_mV = waveform_info.baseline.baseline_mV;
-                  peak_mV     = waveform_info.peak.amplitude_mV;
-                  charge_nVs  = waveform_info.charge.charge_nVs;
-                }
+          rtd_counter++;
+          if (rtd_counter % 500 == 0) {
+            std::clog << "Number of read RTD objects: " << rtd_counter << std::endl;
+          }
+          if (calo_histogramming and periodic_flush) {
+            auto now = std::chrono::steady_clock::now();
+            std::chrono::duration<double> elapsed = now - last_flush_time;
+            if ((app_params.flush_records > 0 and rtd_counter - last_flush_counter >= app_params.flush_records)
+                or (app_params.flush_period > 0.0 and elapsed.count() >= app_params.flush_period)) {
+              calo_processing.flush();
+              calo_histogramming->flush();
+              if (!app_params.checkpoint_filename.empty()) {
+                store_checkpoint(rtd_counter, selection_counter);
               }
+              last_flush_time = now;
+              last_flush_counter = rtd_counter;
+            }
+          }
 
-              // Visualization of waveforms:
-              if (calo_drawer) {
-                if (waveform_info.waveform.size() == 0) {
-                  // At least, draw the waveform shape:
-                  int16_t adc_zero  = snfee::model::feb_constants::SAMLONG_ADC_ZERO;
-                  snfee::algo::calo_waveform_analysis::populate_waveform(ch_waveform,
-                                                                         waveform_info.waveform,
-                                                                         tdc_to_ns,
-                                                                         adc_zero,
-                                                                         adc_to_mV);
-                }
-                bool display_this_one = true;
-                if (display_this_one) {
-                  calo_drawer->draw(waveform_info, "", ch_id.to_string());
-                }
-              }
+        } // end of loop on the RTD objects of the batch
 
-            } // has_waveforms
+      } // end of loop on stored RTD objects:
 
-            // Histogramming:
-            if (calo_histogramming) {
-              
-              if (calo_histogramming->config.histo_charge) {
-                calo_histogramming->fill(ch_id.to_string(), run_id, "charge", charge_nVs);
-              }
-              
-              if (calo_histogramming->config.histo_peak) {
-                calo_histogramming->fill(ch_id.to_string(), run_id, "peak", peak_mV);
-              }
-              
-              if (calo_histogramming->config.histo_baseline) {
-                calo_histogramming->fill(ch_id.to_string(), run_id, "baseline", baseline_mV);
-              }
-              
-              if (calo_histogramming->config.histo_peak_charge) {
-                calo_histogramming->fill(ch_id.to_string(), run_id, "peak_charge", peak_mV, charge_nVs);
-              }
-              
-            }
-            
-            selection_counter++;
+      // Process the last batched waveforms:
+      calo_processing.flush();
+      if (!app_params.checkpoint_filename.empty()) {
+        store_checkpoint(rtd_counter, selection_counter);
+      }
 
-          } // end of selected channel
+    } else {
 
-        } // end of channel loop in the current RTD record
-        
-      } // end of loop on calo hit records in the RTD data object
+      // Pipelined mode: each worker owns its analysis and FFT objects and
+      // fills its own histogram shard (merged at termination), the mean
+      // waveform processor is shared. Workers are fed with RTD records or
+      // with whole input file parts:
+      std::mutex calo_mean_waveform_mutex;
+      std::vector<worker_type> workers(app_params.number_of_threads);
+      for (auto & w : workers) {
+        if (calo_analysis) {
+          w.calo_analysis.reset(new snfee::algo::calo_waveform_analysis(analysis_cfg));
+          w.calo_analysis->initialize();
+        }
+        if (calo_fft) {
+          w.calo_fft.reset(new snfee::algo::calo_waveform_fft(fft_cfg));
+          w.calo_fft->initialize();
+        }
+        if (calo_histogramming) {
+          w.calo_histograms = &calo_histogramming->add_shard();
+        }
+        w.calo_processing.reset(new snfee::calo::hit_processing(processing_cfg, app_params.logging));
+        w.calo_processing->analysis            = w.calo_analysis.get();
+        w.calo_processing->fft                 = w.calo_fft.get();
+        w.calo_processing->mean_waveform       = calo_mean_waveform.get();
+        w.calo_processing->mean_waveform_mutex = &calo_mean_waveform_mutex;
+        w.calo_processing->histos              = w.calo_histograms;
+        w.calo_processing->display             = calo_display.get();
+        w.calo_processing->timing              = timing ? &w.timing : nullptr;
+        w.calo_processing->engine              = calo_engine.get();
+        w.calo_processing->comparison          = calo_engine_comparison ? &w.engine_comparison : nullptr;
+        w.calo_processing->fw_emulation        = calo_fw_emulation.get();
+        w.calo_processing->fw_comparison       = calo_fw_comparison ? &w.fw_comparison : nullptr;
+        w.calo_processing->exporter            = calo_exporter.get();
+        w.calo_processing->exporter_mutex      = &calo_exporter_mutex;
+        if (calo_noise) {
+          w.noise.reset(new snfee::calo::noise_spectrum(noise_cfg));
+        }
+        w.calo_processing->noise               = w.noise.get();
+        w.calo_processing->prepare();
+      }
+      workers.front().calo_processing->get_plan().print(std::clog);
+
+      snfee::calo::rtd_pipeline::config_type pipeline_cfg;
+      pipeline_cfg.number_of_workers = app_params.number_of_threads;
+      pipeline_cfg.max_rtd           = app_params.max_rtd;
+      bool max_rtd_reached = false;
+      if (app_params.max_rtd > 0) {
+        // The pipeline counts the records read after the resumed ones:
+        max_rtd_reached = (rtd_counter >= app_params.max_rtd);
+        if (!max_rtd_reached) {
+          pipeline_cfg.max_rtd = app_params.max_rtd - rtd_counter;
+        }
+      }
+      pipeline_cfg.batch_size        = app_params.batch_size;
+      snfee::calo::rtd_pipeline pipeline(pipeline_cfg, app_params.logging);
+      pipeline.timing = timing.get();
+      auto work = [&workers](const std::size_t worker_index_,
+                             const snfee::data::raw_trigger_data & rtd_)
+      {
+        worker_type & w = workers[worker_index_];
+        w.selection_counter += w.calo_processing->process(rtd_);
+      };
+      // Records without selected channels are dropped before reaching the workers:
+      snfee::calo::hit_selection calo_selection(processing_cfg.selection);
+      auto filter = [&calo_selection](const snfee::data::raw_trigger_data & rtd_)
+      {
+        return calo_selection.select_record(rtd_);
+      };
+      // Periodic flushes of the histograms, with the workers synchronized:
+      auto last_flush_time = std::chrono::steady_clock::now();
+      std::size_t last_flush_counter = 0;
+      auto flush_request = [&](const std::size_t count_)
+      {
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - last_flush_time;
+        return (app_params.flush_records > 0 and count_ - last_flush_counter >= app_params.flush_records)
+          or (app_params.flush_period > 0.0 and elapsed.count() >= app_params.flush_period);
+      };
+      auto flush_workers = [&](const std::size_t count_)
+      {
+        // All the records read so far are processed, the workers are idle:
+        std::size_t selected_channels = resumed_selection;
+        for (auto & w : workers) {
+          w.calo_processing->flush();
+          selected_channels += w.selection_counter;
+        }
+        calo_histogramming->flush();
+        if (!app_params.checkpoint_filename.empty()) {
+          store_checkpoint(resumed_records + count_, selected_channels);
+        }
+        last_flush_time = std::chrono::steady_clock::now();
+        last_flush_counter = count_;
+      };
+      if (max_rtd_reached) {
+        // Nothing left to process
+      } else if (columnar_input) {
+        pipeline.run_tasks(columnar_blocks.size(),
+                           [&workers, &columnar_blocks](const std::size_t worker_index_,
+                                                        const std::size_t block_index_)
+                           {
+                             worker_type & w = workers[worker_index_];
+                             w.selection_counter += w.calo_processing->process(*columnar_blocks[block_index_]);
+                           });
+        rtd_counter += columnar_records;
+      } else if (app_params.parallel_parts) {
+        rtd_counter += pipeline.run_parts(app_params.reader_cfg, work, filter);
+      } else if (calo_histogramming and periodic_flush) {
+        rtd_counter += pipeline.run(*rtd_source, work, filter, flush_request, flush_workers);
+      } else {
+        rtd_counter += pipeline.run(*rtd_source, work, filter);
+      }
 
-      rtd_counter++;
-      if (rtd_counter % 500 == 0) {
-        std::clog << "Number of read RTD objects: " << rtd_counter << std::endl;
+      // Merge the workers' results in a fixed order:
+      for (auto & w : workers) {
+        w.calo_processing->flush();
+        selection_counter += w.selection_counter;
+        if (timing) {
+          timing->merge(w.timing);
+        }
+        if (calo_engine_comparison) {
+          calo_engine_comparison->merge(w.engine_comparison);
+        }
+        if (calo_fw_comparison) {
+          calo_fw_comparison->merge(w.fw_comparison);
+        }
+        if (calo_noise) {
+          calo_noise->merge(*w.noise);
+        }
+        if (w.calo_fft) {
+          w.calo_fft->terminate();
+        }
+        if (w.calo_analysis) {
+          w.calo_analysis->terminate();
+        }
       }
-      if (app_params.max_rtd > 0 and rtd_counter == app_params.max_rtd) {
-        break;
+      if (!app_params.checkpoint_filename.empty()) {
+        store_checkpoint(rtd_counter, selection_counter);
       }
-      
-    } // end of loop on stored RTD objects:
+
+    }
     
     // Report:
     std::clog << "Total number of RTD objects       : " << rtd_counter << std::endl;
     std::clog << "Total number of selected channels : " << selection_counter << std::endl;
+    if (timing) {
+      timing->stop();
+      timing->number_of_records = rtd_counter;
+      timing->print_report(std::clog);
+      if (!app_params.timing_output_filename.empty()) {
+        timing->store(app_params.timing_output_filename);
+      }
+    }
+    if (calo_engine_comparison) {
+      calo_engine_comparison->print_report(std::clog);
+    }
+    if (calo_fw_comparison) {
+      calo_fw_comparison->print_report(std::clog);
+    }
+    if (calo_display) {
+      std::clog << "Total number of displayed waveforms: " << calo_display->get_number_of_displayed()
+                << " (dropped: " << calo_display->get_number_of_dropped() << ")" << std::endl;
+    }
+    if (calo_exporter) {
+      std::clog << "Total number of exported waveforms: " << calo_exporter->get_number_of_waveforms() << std::endl;
+      calo_exporter->close();
+      calo_exporter.reset();
+    }
 
     // Clean:
+    if (calo_noise) {
+      calo_noise->store(*calo_histogramming);
+      calo_noise.reset();
+    }
+
     if (calo_histogramming) {
       calo_histogramming->terminate();
       calo_histogramming.reset();
@@ -548,8 +978,8 @@ int main(int argc_, char ** argv_)
       calo_analysis.reset();
     }
  
-    if (calo_drawer) {
-      calo_drawer.reset();
+    if (calo_display) {
+      calo_display.reset();
     }
     
   } catch (std::exception & x) {
@@ -0,0 +1,130 @@
+// Standard library:
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Third party:
+// - Boost:
+#include <boost/program_options.hpp>
+// - Bayeux:
+#include <bayeux/datatools/logger.h>
+#include <bayeux/datatools/exception.h>
+
+// This project:
+#include <snfee/snfee.h>
+
+// This example:
+#include "rtd_index.h"
+
+/// \brief Application configuration parameters
+struct app_params_type
+{
+  /// Logging priority
+  datatools::logger::priority logging = datatools::logger::PRIO_FATAL;
+
+  /// Input RTD filenames
+  std::vector<std::string> filenames;
+
+  /// Rebuild up-to-date index files
+  bool force = false;
+};
+
+// Main program:
+int main(int argc_, char ** argv_)
+{
+  snfee::initialize();
+  int error_code = EXIT_SUCCESS;
+  try {
+
+    // Configuration:
+    app_params_type app_params;
+
+    // Parse options:
+    namespace po = boost::program_options;
+    po::options_description opts("Allowed options");
+    opts.add_options()
+      ("help", "produce help message")
+
+      ("logging,L",
+       po::value<std::string>()->value_name("level"),
+       "logging priority")
+
+      ("input-file,i",
+       po::value<std::vector<std::string>>(&app_params.filenames)
+       ->multitoken()
+       ->value_name("path"),
+       "add a RTD input filename")
+
+      ("force,f",
+       po::value<bool>(&app_params.force)
+       ->zero_tokens()
+       ->default_value(false),
+       "rebuild the index even if it is up to date")
+
+    ; // end of options description
+
+    // Describe command line arguments :
+    po::variables_map vm;
+    po::store(po::command_line_parser(argc_, argv_)
+              .options(opts)
+              .run(), vm);
+    po::notify(vm);
+
+    // Use command line arguments :
+    if (vm.count("help")) {
+      std::cout << "snfee-rtd-build-index : "
+                << "Build the record index sidecar file of raw trigger data files (RTD)"
+                << std::endl << std::endl;
+      std::cout << "Usage : " << std::endl << std::endl;
+      std::cout << "  snfee-rtd-build-index [OPTIONS]" << std::endl << std::endl;
+      std::cout << opts << std::endl;
+      std::cout << "Example : " << std::endl << std::endl;
+      std::cout << " snfee-rtd-build-index \\\n";
+      std::cout << "    --input-file \"snemo_run-8_rtd_part-0.data.gz\" \\\n";
+      std::cout << "    --input-file \"snemo_run-8_rtd_part-1.data.gz\" \n";
+      std::cout << std::endl << std::endl;
+      return (-1);
+    }
+
+    // Use command line arguments :
+    if (vm.count("logging")) {
+      std::string logging_repr = vm["logging"].as<std::string>();
+      app_params.logging = datatools::logger::get_priority(logging_repr);
+      DT_THROW_IF(app_params.logging == datatools::logger::PRIO_UNDEFINED,
+                  std::logic_error,
+                  "Invalid logging priority '" << vm["logging"].as<std::string>() << "'!");
+    }
+
+    // Checks:
+    DT_THROW_IF(app_params.filenames.size() == 0,
+                std::logic_error,
+                "Missing input RTD filenames!");
+
+    std::size_t total_records = 0;
+    for (const auto & filename : app_params.filenames) {
+      snfee::calo::rtd_index index;
+      if (!app_params.force and snfee::calo::rtd_index::load_for(filename, index, app_params.logging)) {
+        DT_LOG_NOTICE(app_params.logging, "Index of '" << filename << "' is up to date.");
+      } else {
+        index.build(filename);
+        index.store(snfee::calo::rtd_index::sidecar_path(filename));
+      }
+      std::clog << "RTD file '" << filename << "' : " << index.size() << " records" << std::endl;
+      total_records += index.size();
+    }
+
+    // Report:
+    std::clog << "Total number of RTD objects       : " << total_records << std::endl;
+
+  } catch (std::exception & x) {
+    std::cerr << "error: " << x.what() << std::endl;
+    error_code = EXIT_FAILURE;
+  } catch (...) {
+    std::cerr << "error: " << "unexpected error!" << std::endl;
+    error_code = EXIT_FAILURE;
+  }
+  snfee::terminate();
+  return (error_code);
+}
@@ -0,0 +1,169 @@
+// Ourselves:
+#include "rtd_follow_pipe.h"
+
+// Standard library:
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Third party:
+// - Bayeux:
+#include <bayeux/datatools/exception.h>
+#include <bayeux/datatools/utils.h>
+
+namespace snfee {
+  namespace calo {
+
+    rtd_follow_pipe::rtd_follow_pipe(const std::string & filename_,
+                                     const double poll_period_,
+                                     const double timeout_,
+                                     const datatools::logger::priority logging_)
+    {
+      logging = logging_;
+      _filename_ = filename_;
+      DT_THROW_IF(!datatools::fetch_path_with_env(_filename_), std::logic_error,
+                  "Invalid RTD filename '" << filename_ << "'!");
+      _poll_period_ = poll_period_;
+      _timeout_ = timeout_;
+      std::string dir_template = "/tmp/snfee-rtd-follow.XXXXXX";
+      const char * tmpdir = std::getenv("TMPDIR");
+      if (tmpdir != nullptr and tmpdir[0] != '\0') {
+        dir_template = std::string(tmpdir) + "/snfee-rtd-follow.XXXXXX";
+      }
+      std::vector<char> dir(dir_template.begin(), dir_template.end());
+      dir.push_back('\0');
+      DT_THROW_IF(::mkdtemp(dir.data()) == nullptr, std::runtime_error,
+                  "Cannot create a temporary directory for the followed RTD file: " << std::strerror(errno));
+      _dir_ = dir.data();
+      std::size_t slash = _filename_.rfind('/');
+      _path_ = _dir_ + "/" + (slash == std::string::npos ? _filename_ : _filename_.substr(slash + 1));
+      if (::mkfifo(_path_.c_str(), 0600) != 0) {
+        int error = errno;
+        ::rmdir(_dir_.c_str());
+        DT_THROW(std::runtime_error, "Cannot create the named pipe '" << _path_ << "': " << std::strerror(error));
+      }
+      _thread_ = std::thread(&rtd_follow_pipe::_run_, this);
+      return;
+    }
+
+    rtd_follow_pipe::~rtd_follow_pipe()
+    {
+      stop();
+      _thread_.join();
+      ::unlink(_path_.c_str());
+      ::rmdir(_dir_.c_str());
+      return;
+    }
+
+    const std::string & rtd_follow_pipe::get_path() const
+    {
+      return _path_;
+    }
+
+    void rtd_follow_pipe::stop()
+    {
+      {
+        std::lock_guard<std::mutex> lock(_mutex_);
+        _stop_ = true;
+      }
+      _stop_requested_.notify_all();
+      return;
+    }
+
+    bool rtd_follow_pipe::_wait_(const double period_)
+    {
+      std::unique_lock<std::mutex> lock(_mutex_);
+      auto period = std::chrono::milliseconds(static_cast<long>(period_ * 1000));
+      return !_stop_requested_.wait_for(lock, period, [this] { return _stop_; });
+    }
+
+    void rtd_follow_pipe::_run_()
+    {
+      // A reader closing the pipe must not kill the process: SIGPIPE is
+      // blocked in this thread, so that write() fails with EPIPE instead.
+      sigset_t sigpipe_set;
+      sigemptyset(&sigpipe_set);
+      sigaddset(&sigpipe_set, SIGPIPE);
+      pthread_sigmask(SIG_BLOCK, &sigpipe_set, nullptr);
+
+      // Open the write end once the reader has opened the pipe:
+      int out = -1;
+      while (out < 0) {
+        out = ::open(_path_.c_str(), O_WRONLY | O_NONBLOCK);
+        if (out < 0 and (errno != ENXIO or !_wait_(0.01))) {
+          // Release a reader blocked in its opening of the pipe:
+          out = ::open(_path_.c_str(), O_WRONLY | O_NONBLOCK);
+          if (out >= 0) ::close(out);
+          return;
+        }
+      }
+
+      int in = -1;
+      long long offset = 0;
+      std::vector<char> buffer(1 << 16);
+      auto last_data = std::chrono::steady_clock::now();
+      bool done = false;
+      while (!done) {
+        ssize_t nread = 0;
+        if (in < 0) {
+          in = ::open(_filename_.c_str(), O_RDONLY);
+        }
+        if (in >= 0) {
+          nread = ::read(in, buffer.data(), buffer.size());
+        }
+        if (nread > 0) {
+          offset += nread;
+          last_data = std::chrono::steady_clock::now();
+          // Copy the new bytes, the reader may be busy:
+          for (ssize_t nwritten = 0; nwritten < nread and !done; ) {
+            ssize_t n = ::write(out, buffer.data() + nwritten, nread - nwritten);
+            if (n >= 0) {
+              nwritten += n;
+            } else if (errno == EAGAIN) {
+              struct pollfd pfd = { out, POLLOUT, 0 };
+              ::poll(&pfd, 1, 100);
+              std::lock_guard<std::mutex> lock(_mutex_);
+              done = _stop_;
+            } else if (errno != EINTR) {
+              // The reader is gone (EPIPE):
+              done = true;
+            }
+          }
+          continue;
+        }
+        // End of the file for now:
+        struct stat st;
+        if (in >= 0 and ::fstat(in, &st) == 0 and st.st_size < offset) {
+          DT_LOG_ERROR(logging, "Followed RTD file '" << _filename_ << "' has been truncated!");
+          break;
+        }
+        if (_timeout_ > 0.0) {
+          std::chrono::duration<double> waited = std::chrono::steady_clock::now() - last_data;
+          if (waited.count() > _timeout_) {
+            DT_LOG_NOTICE(logging, "No new data in RTD file '" << _filename_ << "' since "
+                          << _timeout_ << " s, stop following.");
+            break;
+          }
+        }
+        if (!_wait_(_poll_period_)) break;
+      }
+      if (in >= 0) ::close(in);
+      ::close(out);
+      // Discard a SIGPIPE raised by the last write, if any:
+      struct timespec no_wait = { 0, 0 };
+      while (sigtimedwait(&sigpipe_set, nullptr, &no_wait) == SIGPIPE) {}
+      DT_LOG_DEBUG(logging, "Stopped following RTD file '" << _filename_ << "' after " << offset << " bytes.");
+      return;
+    }
+
+  } // namespace calo
+} // namespace snfee
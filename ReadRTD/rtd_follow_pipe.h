@@ -0,0 +1,77 @@
+#ifndef RTD_FOLLOW_PIPE_H
+#define RTD_FOLLOW_PIPE_H
+
+// Standard library:
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Third party:
+// - Bayeux:
+#include <bayeux/datatools/logger.h>
+
+namespace snfee {
+  namespace calo {
+
+    /// \brief Tail of a RTD file being written, exposed as a named pipe
+    ///
+    /// The Boost archive of a RTD file cannot be resumed once its stream
+    /// has reached the end of the file, nor restarted in the middle of the
+    /// compressed stream. A background thread thus copies the raw bytes of
+    /// the file to a named pipe as they are written, and waits for the file
+    /// to grow at its end instead of closing the pipe. The RTD reader opens
+    /// the pipe (same basename, so the format and compression are deduced
+    /// as for the file) and simply blocks on a record which is not complete
+    /// yet: each byte is read and inflated once. The pipe is closed, which
+    /// ends the input, after a given duration without new data or on stop.
+    struct rtd_follow_pipe
+    {
+      /// Constructor (creates the pipe and starts the copy thread)
+      rtd_follow_pipe(const std::string & filename_,
+                      const double poll_period_,
+                      const double timeout_,
+                      const datatools::logger::priority logging_ = datatools::logger::PRIO_FATAL);
+
+      /// Destructor (stops the copy thread and removes the pipe)
+      ~rtd_follow_pipe();
+
+      /// Return the path of the named pipe
+      const std::string & get_path() const;
+
+      /// Close the pipe, the reader gets the end of the input
+      void stop();
+
+      datatools::logger::priority logging = datatools::logger::PRIO_FATAL; ///< Logging priority threshold
+
+    private:
+
+      /// Main loop of the copy thread
+      void _run_();
+
+      /// Wait for a period, returns false on stop request
+      bool _wait_(const double period_);
+
+      std::string _filename_;     ///< Followed RTD file
+      double      _poll_period_;  ///< Polling period of the file size (second)
+      double      _timeout_;      ///< Maximum duration without new data (second, 0: never)
+      std::string _dir_;          ///< Temporary directory of the pipe
+      std::string _path_;         ///< Path of the named pipe
+
+      std::thread             _thread_;
+      std::mutex              _mutex_;
+      std::condition_variable _stop_requested_;
+      bool                    _stop_ = false;
+
+    };
+
+  } // namespace calo
+} // namespace snfee
+
+#endif // RTD_FOLLOW_PIPE_H
+
+// Local Variables: --
+// mode: c++ --
+// c-file-style: "gnu" --
+// tab-width: 2 --
+// End: --
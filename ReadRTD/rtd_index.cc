@@ -0,0 +1,187 @@
+// Ourselves:
+#include "rtd_index.h"
+
+// Standard library:
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+
+// Third party:
+// - Bayeux:
+#include <bayeux/datatools/exception.h>
+#include <bayeux/datatools/utils.h>
+
+// This project:
+#include <snfee/io/multifile_data_reader.h>
+#include <snfee/data/raw_trigger_data.h>
+
+namespace snfee {
+  namespace calo {
+
+    namespace {
+
+      const std::string INDEX_MAGIC = "#@snfee.rtd_index";
+
+      // Fetch the size and last modification time of a file:
+      bool stat_file(const std::string & filename_, uint64_t & size_, int64_t & mtime_)
+      {
+        std::string path = filename_;
+        if (!datatools::fetch_path_with_env(path)) return false;
+        struct stat st;
+        if (::stat(path.c_str(), &st) != 0) return false;
+        size_  = st.st_size;
+        mtime_ = st.st_mtime;
+        return true;
+      }
+
+    } // namespace
+
+    // static
+    std::string rtd_index::sidecar_path(const std::string & rtd_filename_)
+    {
+      return rtd_filename_ + ".index";
+    }
+
+    // static
+    bool rtd_index::load_for(const std::string & rtd_filename_,
+                             rtd_index & index_,
+                             const datatools::logger::priority logging_)
+    {
+      std::string path = sidecar_path(rtd_filename_);
+      if (!datatools::fetch_path_with_env(path)) return false;
+      std::ifstream fcheck(path.c_str());
+      if (!fcheck) {
+        DT_LOG_DEBUG(logging_, "No index file '" << path << "'.");
+        return false;
+      }
+      fcheck.close();
+      rtd_index index;
+      try {
+        index.load(path);
+      } catch (std::exception & x) {
+        // A truncated or corrupted sidecar falls back to replaying the records:
+        DT_LOG_WARNING(logging_, "Index file '" << path << "' cannot be loaded, ignored: " << x.what());
+        return false;
+      }
+      // The sidecar may have been built from another working directory, check the file actually read:
+      if (!index.is_up_to_date(rtd_filename_)) {
+        DT_LOG_WARNING(logging_, "Index file '" << path << "' is out of date, ignored!");
+        return false;
+      }
+      index_ = index;
+      return true;
+    }
+
+    void rtd_index::build(const std::string & rtd_filename_)
+    {
+      filename = rtd_filename_;
+      entries.clear();
+      DT_THROW_IF(!stat_file(filename, file_size, file_mtime),
+                  std::runtime_error,
+                  "Cannot access RTD file '" << filename << "'!");
+      snfee::io::multifile_data_reader::config_type reader_cfg;
+      reader_cfg.filenames.push_back(filename);
+      snfee::io::multifile_data_reader rtd_source(reader_cfg);
+      snfee::data::raw_trigger_data rtd;
+      while (rtd_source.has_record_tag()) {
+        DT_THROW_IF(!rtd_source.record_tag_is(snfee::data::raw_trigger_data::SERIAL_TAG),
+                    std::logic_error,
+                    "Unexpected record tag '" << rtd_source.get_record_tag() << "'!");
+        rtd_source.load(rtd);
+        entry_type entry;
+        entry.ordinal             = entries.size();
+        entry.run_id              = rtd.get_run_id();
+        entry.trigger_id          = rtd.get_trigger_id();
+        entry.number_of_calo_hits = rtd.get_calo_hits().size();
+        entries.push_back(entry);
+      }
+      return;
+    }
+
+    void rtd_index::store(const std::string & path_) const
+    {
+      std::string path = path_;
+      DT_THROW_IF(!datatools::fetch_path_with_env(path), std::logic_error,
+                  "Invalid index path '" << path_ << "'!");
+      // Written to a temporary file then renamed, so that an interrupted build never leaves a truncated index:
+      const std::string tmp_path = path + ".tmp";
+      std::ofstream fout(tmp_path.c_str());
+      DT_THROW_IF(!fout, std::runtime_error, "Cannot open index file '" << tmp_path << "'!");
+      fout << INDEX_MAGIC << '\n';
+      fout << "#filename=" << filename << '\n';
+      fout << "#file_size=" << file_size << '\n';
+      fout << "#file_mtime=" << file_mtime << '\n';
+      fout << "#number_of_records=" << entries.size() << '\n';
+      fout << "#ordinal run_id trigger_id number_of_calo_hits" << '\n';
+      for (const auto & entry : entries) {
+        fout << entry.ordinal << ' ' << entry.run_id << ' ' << entry.trigger_id
+             << ' ' << entry.number_of_calo_hits << '\n';
+      }
+      fout.close();
+      DT_THROW_IF(!fout, std::runtime_error, "Cannot write index file '" << tmp_path << "'!");
+      DT_THROW_IF(std::rename(tmp_path.c_str(), path.c_str()) != 0,
+                  std::runtime_error,
+                  "Cannot rename index file '" << tmp_path << "' to '" << path << "'!");
+      return;
+    }
+
+    void rtd_index::load(const std::string & path_)
+    {
+      std::string path = path_;
+      DT_THROW_IF(!datatools::fetch_path_with_env(path), std::logic_error,
+                  "Invalid index path '" << path_ << "'!");
+      std::ifstream fin(path.c_str());
+      DT_THROW_IF(!fin, std::runtime_error, "Cannot open index file '" << path << "'!");
+      std::string line;
+      std::getline(fin, line);
+      DT_THROW_IF(line != INDEX_MAGIC, std::logic_error, "Invalid index file '" << path << "'!");
+      filename.clear();
+      file_size  = 0;
+      file_mtime = 0;
+      entries.clear();
+      std::size_t number_of_records = 0;
+      while (std::getline(fin, line)) {
+        if (line.empty()) continue;
+        if (line[0] == '#') {
+          std::size_t pos = line.find('=');
+          if (pos == std::string::npos) continue;
+          std::string key   = line.substr(1, pos - 1);
+          std::string value = line.substr(pos + 1);
+          std::istringstream value_iss(value);
+          if (key == "filename") filename = value;
+          else if (key == "file_size") value_iss >> file_size;
+          else if (key == "file_mtime") value_iss >> file_mtime;
+          else if (key == "number_of_records") {
+            value_iss >> number_of_records;
+            entries.reserve(number_of_records);
+          }
+          continue;
+        }
+        std::istringstream line_iss(line);
+        entry_type entry;
+        line_iss >> entry.ordinal >> entry.run_id >> entry.trigger_id >> entry.number_of_calo_hits;
+        DT_THROW_IF(!line_iss, std::logic_error,
+                    "Invalid entry '" << line << "' in index file '" << path << "'!");
+        entries.push_back(entry);
+      }
+      DT_THROW_IF(entries.size() != number_of_records, std::logic_error,
+                  "Truncated index file '" << path << "'!");
+      return;
+    }
+
+    bool rtd_index::is_up_to_date(const std::string & rtd_filename_) const
+    {
+      uint64_t size = 0;
+      int64_t mtime = 0;
+      if (!stat_file(rtd_filename_, size, mtime)) return false;
+      return size == file_size and mtime == file_mtime;
+    }
+
+    std::size_t rtd_index::size() const
+    {
+      return entries.size();
+    }
+
+  } // namespace calo
+} // namespace snfee
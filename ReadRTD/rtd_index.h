@@ -0,0 +1,79 @@
+#ifndef RTD_INDEX_H
+#define RTD_INDEX_H
+
+// Standard library:
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Third party:
+// - Bayeux:
+#include <bayeux/datatools/logger.h>
+
+namespace snfee {
+  namespace calo {
+
+    /// \brief Record index of a RTD file part
+    ///
+    /// The index is stored in a sidecar text file next to the RTD file
+    /// ('snemo_run-104_rtd_part-0.data.gz.index'). It maps the ordinal of
+    /// each record in the part to its run and trigger IDs. Boost archives
+    /// cannot be restarted in the middle of the compressed stream, so the
+    /// restart point of a record is its ordinal: readers skip whole parts
+    /// without opening them and only replay the records of the part which
+    /// contains the first requested record.
+    struct rtd_index
+    {
+
+      /// \brief Index entry for a RTD record
+      struct entry_type
+      {
+        uint32_t ordinal             = 0;  ///< Rank of the record in the file part
+        int32_t  run_id              = -1; ///< Run ID
+        int32_t  trigger_id          = -1; ///< Trigger ID
+        uint32_t number_of_calo_hits = 0;  ///< Number of calo hit records
+      };
+
+      /// Return the path of the index sidecar file associated to a RTD file
+      static std::string sidecar_path(const std::string & rtd_filename_);
+
+      /// Load the index of a RTD file from its sidecar file, if it exists and is up to date
+      ///
+      /// A sidecar which cannot be loaded (truncated, corrupted) is ignored
+      /// with a warning, as an out of date one.
+      static bool load_for(const std::string & rtd_filename_,
+                           rtd_index & index_,
+                           const datatools::logger::priority logging_ = datatools::logger::PRIO_FATAL);
+
+      /// Build the index by reading all records of a RTD file
+      void build(const std::string & rtd_filename_);
+
+      /// Store the index in a sidecar file (written to '<path>.tmp' then renamed)
+      void store(const std::string & path_) const;
+
+      /// Load the index from a sidecar file
+      void load(const std::string & path_);
+
+      /// Check if a RTD file has the size and modification time of the indexed one
+      bool is_up_to_date(const std::string & rtd_filename_) const;
+
+      /// Return the number of indexed records
+      std::size_t size() const;
+
+      std::string             filename;       ///< Indexed RTD file
+      uint64_t                file_size  = 0; ///< Size of the indexed RTD file (bytes)
+      int64_t                 file_mtime = 0; ///< Last modification time of the indexed RTD file
+      std::vector<entry_type> entries;        ///< Index entries
+
+    };
+
+  } // namespace calo
+} // namespace snfee
+
+#endif // RTD_INDEX_H
+
+// Local Variables: --
+// mode: c++ --
+// c-file-style: "gnu" --
+// tab-width: 2 --
+// End: --
@@ -0,0 +1,249 @@
+// Ourselves:
+#include "rtd_prefetch_reader.h"
+
+// Standard library:
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Third party:
+// - Bayeux:
+#include <bayeux/datatools/exception.h>
+#include <bayeux/datatools/utils.h>
+
+// This example:
+#include "rtd_index.h"
+
+namespace snfee {
+  namespace calo {
+
+    namespace {
+
+      // Ask the kernel to read a file in the page cache:
+      void warm_file(const std::string & filename_)
+      {
+        std::string path = filename_;
+        if (!datatools::fetch_path_with_env(path)) return;
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return;
+        ::posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+        ::close(fd);
+        return;
+      }
+
+    } // namespace
+
+    rtd_prefetch_reader::rtd_prefetch_reader(const config_type & cfg_,
+                                             const datatools::logger::priority logging_)
+    {
+      logging = logging_;
+      _config_ = cfg_;
+      DT_THROW_IF(_config_.filenames.size() == 0,
+                  std::logic_error,
+                  "Missing input RTD filenames!");
+      _to_skip_ = _config_.first_record;
+      if (_config_.capacity > 0) {
+        // Preallocate the ring of RTD objects filled by the background thread:
+        for (std::size_t i = 0; i < _config_.capacity; i++) {
+          _recycled_.push_back(std::make_shared<snfee::data::raw_trigger_data>());
+        }
+        _thread_ = std::thread(&rtd_prefetch_reader::_run_, this);
+      }
+      return;
+    }
+
+    rtd_prefetch_reader::~rtd_prefetch_reader()
+    {
+      if (_thread_.joinable()) {
+        {
+          std::lock_guard<std::mutex> lock(_mutex_);
+          _stop_ = true;
+          if (_follow_pipe_) {
+            // Unblock a load waiting for the DAQ:
+            _follow_pipe_->stop();
+          }
+        }
+        _not_full_.notify_all();
+        _thread_.join();
+      }
+      return;
+    }
+
+    bool rtd_prefetch_reader::load(rtd_ptr_type & rtd_)
+    {
+      if (_config_.capacity == 0) {
+        // No prefetch, the caller's record is reused:
+        return _load_next_(rtd_);
+      }
+      {
+        std::unique_lock<std::mutex> lock(_mutex_);
+        if (rtd_) {
+          _recycled_.push_back(rtd_);
+          rtd_.reset();
+        }
+        _not_empty_.wait(lock, [this] { return !_queue_.empty() or _end_; });
+        if (_queue_.empty()) {
+          if (_error_) {
+            std::rethrow_exception(_error_);
+          }
+          return false;
+        }
+        rtd_ = _queue_.front();
+        _queue_.pop_front();
+      }
+      _not_full_.notify_one();
+      return true;
+    }
+
+    std::size_t rtd_prefetch_reader::load_batch(std::vector<rtd_ptr_type> & batch_, const std::size_t max_size_)
+    {
+      DT_THROW_IF(max_size_ == 0, std::logic_error, "Invalid batch size!");
+      if (_config_.capacity == 0) {
+        // No prefetch, the batch's records are reused:
+        if (batch_.size() < max_size_) {
+          batch_.resize(max_size_);
+        }
+        std::size_t count = 0;
+        while (count < max_size_ and _load_next_(batch_[count])) {
+          count++;
+        }
+        batch_.resize(count);
+        return count;
+      }
+      {
+        std::unique_lock<std::mutex> lock(_mutex_);
+        for (auto & p_rtd : batch_) {
+          if (p_rtd) {
+            _recycled_.push_back(p_rtd);
+          }
+        }
+        batch_.clear();
+        std::size_t min_size = _config_.follow ? 1 : std::min(max_size_, _config_.capacity);
+        _not_empty_.wait(lock, [&] { return _queue_.size() >= min_size or _end_; });
+        if (_queue_.empty()) {
+          if (_error_) {
+            std::rethrow_exception(_error_);
+          }
+          return 0;
+        }
+        while (!_queue_.empty() and batch_.size() < max_size_) {
+          batch_.push_back(_queue_.front());
+          _queue_.pop_front();
+        }
+      }
+      _not_full_.notify_one();
+      return batch_.size();
+    }
+
+    bool rtd_prefetch_reader::_load_next_(rtd_ptr_type & rtd_)
+    {
+      if (!rtd_) {
+        rtd_ = std::make_shared<snfee::data::raw_trigger_data>();
+      }
+      while (true) {
+        if (_reader_ and _reader_->has_record_tag()) {
+          try {
+            // Check the serialization tag of the next record:
+            DT_THROW_IF(!_reader_->record_tag_is(snfee::data::raw_trigger_data::SERIAL_TAG),
+                        std::logic_error,
+                        "Unexpected record tag '" << _reader_->get_record_tag() << "'!");
+
+            // Load the next RTD object:
+            _reader_->load(*rtd_);
+          } catch (std::exception & x) {
+            // The followed file may end with an incomplete record when it is no longer followed:
+            if (!_is_following_()) throw;
+            DT_LOG_NOTICE(logging, "Incomplete last record in the followed RTD file: " << x.what());
+            _reader_.reset();
+            return false;
+          }
+          if (_to_skip_ == 0) break;
+          // Boost archives can only be replayed up to the first requested record:
+          _to_skip_--;
+          continue;
+        }
+
+        if (_is_following_()) {
+          // The followed file is no longer followed (timeout or stop request):
+          _reader_.reset();
+          return false;
+        }
+
+        // Open the next file:
+        _reader_.reset();
+        if (_file_index_ == _config_.filenames.size()) {
+          return false;
+        }
+        const std::string & filename = _config_.filenames[_file_index_];
+        _file_index_++;
+        if (_to_skip_ > 0 and _config_.use_index and !_is_following_()) {
+          rtd_index index;
+          if (rtd_index::load_for(filename, index, logging) and index.size() <= _to_skip_) {
+            DT_LOG_DEBUG(logging, "Skipping RTD file '" << filename << "' (" << index.size() << " records)...");
+            _to_skip_ -= index.size();
+            continue;
+          }
+        }
+        snfee::io::multifile_data_reader::config_type reader_cfg;
+        if (_is_following_()) {
+          // Read the file through its tail, the loads wait for the DAQ:
+          std::lock_guard<std::mutex> lock(_mutex_);
+          if (_stop_) return false;
+          _follow_pipe_.reset(new rtd_follow_pipe(filename,
+                                                  _config_.follow_poll_period,
+                                                  _config_.follow_timeout,
+                                                  logging));
+          DT_LOG_DEBUG(logging, "Following RTD file '" << filename << "'...");
+          reader_cfg.filenames.push_back(_follow_pipe_->get_path());
+        } else {
+          DT_LOG_DEBUG(logging, "Opening RTD file '" << filename << "'...");
+          reader_cfg.filenames.push_back(filename);
+        }
+        _reader_.reset(new snfee::io::multifile_data_reader(reader_cfg));
+        if (_config_.warm_next_file and _file_index_ < _config_.filenames.size()) {
+          warm_file(_config_.filenames[_file_index_]);
+        }
+      }
+      return true;
+    }
+
+    bool rtd_prefetch_reader::_is_following_() const
+    {
+      return _config_.follow and _file_index_ == _config_.filenames.size();
+    }
+
+    void rtd_prefetch_reader::_run_()
+    {
+      try {
+        while (true) {
+          rtd_ptr_type p_rtd;
+          {
+            std::unique_lock<std::mutex> lock(_mutex_);
+            _not_full_.wait(lock, [this] { return _queue_.size() < _config_.capacity or _stop_; });
+            if (_stop_) break;
+            if (!_recycled_.empty()) {
+              p_rtd = _recycled_.back();
+              _recycled_.pop_back();
+            }
+          }
+          if (!_load_next_(p_rtd)) break;
+          {
+            std::lock_guard<std::mutex> lock(_mutex_);
+            _queue_.push_back(p_rtd);
+          }
+          _not_empty_.notify_one();
+        }
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(_mutex_);
+        _error_ = std::current_exception();
+      }
+      {
+        std::lock_guard<std::mutex> lock(_mutex_);
+        _end_ = true;
+      }
+      _not_empty_.notify_all();
+      return;
+    }
+
+  } // namespace calo
+} // namespace snfee
@@ -0,0 +1,141 @@
+#ifndef RTD_PREFETCH_READER_H
+#define RTD_PREFETCH_READER_H
+
+// Standard library:
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Third party:
+// - Bayeux:
+#include <bayeux/datatools/logger.h>
+
+// This project:
+#include <snfee/io/multifile_data_reader.h>
+#include <snfee/data/raw_trigger_data.h>
+
+// This example:
+#include "rtd_follow_pipe.h"
+
+namespace snfee {
+  namespace calo {
+
+    /// \brief RTD reader with background decompression and deserialization
+    ///
+    /// The input files are opened one after the other. A background thread
+    /// inflates and deserializes the next RTD records into a bounded buffer,
+    /// so that load() only waits when the buffer is empty. The RTD objects
+    /// are recycled, but the deserialization still rebuilds their calo hits
+    /// and waveform buffers at each load. When a file is opened, the kernel
+    /// is asked to read ahead the next one.
+    ///
+    /// Records can be skipped up to a given rank. File parts with an up to
+    /// date index (see rtd_index) are skipped without being opened, the
+    /// remaining records are loaded and dropped.
+    ///
+    /// In follow mode, the last file is assumed to be still written by the
+    /// DAQ: it is read through a rtd_follow_pipe, so that loading a record
+    /// which is not complete yet waits for the DAQ to write it. Each record
+    /// is inflated and deserialized once.
+    struct rtd_prefetch_reader
+    {
+      typedef std::shared_ptr<snfee::data::raw_trigger_data> rtd_ptr_type;
+
+      /// \brief Configuration parameters
+      struct config_type
+      {
+        /// List of input RTD filenames
+        std::vector<std::string> filenames;
+
+        /// Number of records loaded in advance (0: load in the calling thread)
+        std::size_t capacity = 2;
+
+        /// Ask the kernel to read ahead the next file while the current one is processed
+        bool warm_next_file = true;
+
+        /// Rank of the first record to be loaded (records before are skipped)
+        std::size_t first_record = 0;
+
+        /// Use the index sidecar files to skip whole file parts
+        bool use_index = true;
+
+        /// Wait for new records at the end of the last file
+        bool follow = false;
+
+        /// Polling period of the followed file (second)
+        double follow_poll_period = 1.0;
+
+        /// Stop following after this duration without new data (second, 0: never)
+        double follow_timeout = 600.0;
+      };
+
+      /// Constructor
+      rtd_prefetch_reader(const config_type & cfg_,
+                          const datatools::logger::priority logging_ = datatools::logger::PRIO_FATAL);
+
+      /// Destructor
+      ~rtd_prefetch_reader();
+
+      /// Load the next RTD record, returns false at end of input
+      ///
+      /// A non null record passed by the caller is recycled for later loads,
+      /// so the caller must not hold other references on it.
+      bool load(rtd_ptr_type & rtd_);
+
+      /// Load up to max_size_ next RTD records, returns the number of loaded records (0 at end of input)
+      ///
+      /// The non null records held by the batch are recycled for later
+      /// loads. The RTD objects thus circulate in a ring between the caller
+      /// and the loading thread. The call waits for a full batch, or for the
+      /// whole prefetch buffer if smaller (the capacity should thus be at
+      /// least the batch size), except in follow mode where it returns as
+      /// soon as a record is ready.
+      std::size_t load_batch(std::vector<rtd_ptr_type> & batch_, const std::size_t max_size_);
+
+      datatools::logger::priority logging = datatools::logger::PRIO_FATAL; ///< Logging priority threshold
+
+    private:
+
+      /// Load the next record from the input files in the calling thread
+      bool _load_next_(rtd_ptr_type & rtd_);
+
+      /// Main loop of the background thread
+      void _run_();
+
+      /// Check if the current file is the followed one
+      bool _is_following_() const;
+
+      config_type _config_;
+      std::size_t _file_index_ = 0; ///< Index of the next file to be opened
+      std::size_t _to_skip_    = 0; ///< Number of records still to be skipped
+      std::unique_ptr<rtd_follow_pipe> _follow_pipe_; ///< Tail of the followed file
+      std::unique_ptr<snfee::io::multifile_data_reader> _reader_; ///< Reader for the current file
+
+      // Background loading:
+      std::thread              _thread_;
+      std::mutex               _mutex_;
+      std::condition_variable  _not_empty_;
+      std::condition_variable  _not_full_;
+      std::deque<rtd_ptr_type> _queue_;    ///< Loaded records
+      std::vector<rtd_ptr_type> _recycled_; ///< Records released by the caller
+      bool                     _end_  = false;
+      bool                     _stop_ = false;
+      std::exception_ptr       _error_;
+
+    };
+
+  } // namespace calo
+} // namespace snfee
+
+#endif // RTD_PREFETCH_READER_H
+
+// Local Variables: --
+// mode: c++ --
+// c-file-style: "gnu" --
+// tab-width: 2 --
+// End: --
@@ -26,7 +26,6 @@
 
 // This project:
 #include <snfee/snfee.h>
-#include <snfee/io/multifile_data_reader.h>
 #include <snfee/data/raw_trigger_data.h>
 #include <snfee/data/calo_hit_record.h>
 #include <snfee/data/channel_id.h>
@@ -36,6 +35,11 @@
 #include <snfee/data/calo_waveform_data.h>
 #include <snfee/algo/calo_waveform_analysis.h>
 
+// This example:
+#include "rtd_prefetch_reader.h"
+#include "calo_hit_selection.h"
+#include "calo_waveform_view.h"
+
 /// \brief Application configuration parameters
 struct app_params_type
 {
@@ -43,7 +47,7 @@ struct app_params_type
   datatools::logger::priority logging = datatools::logger::PRIO_FATAL;
   
   /// Configuration for raw data reader
-  snfee::io::multifile_data_reader::config_type reader_cfg;
+  snfee::calo::rtd_prefetch_reader::config_type reader_cfg;
   
   /// Maximum number of RTD records to be read
   uint32_t max_rtd    = 0;
@@ -101,6 +105,16 @@ int main(int argc_, char ** argv_)
        po::value<uint32_t>(&app_params.max_rtd)
        ->value_name("number"),
        "set the maximum number of processed RTD objects")
+
+      ("first-rtd",
+       po::value<std::size_t>(&app_params.reader_cfg.first_record)
+       ->value_name("number"),
+       "set the rank of the first processed RTD object (previous ones are skipped)")
+
+      ("prefetch",
+       po::value<std::size_t>(&app_params.reader_cfg.capacity)
+       ->value_name("number"),
+       "set the number of RTD objects loaded in advance by a background thread (0: no prefetch)")
  
       ("low-threshold,l",
        po::value<bool>(&app_params.process_lt)->zero_tokens()->default_value(false),
@@ -209,13 +223,17 @@ int main(int argc_, char ** argv_)
     cabling_service.initialize_simple();
     
     // Instantiate a reader:
-    snfee::io::multifile_data_reader rtd_source(app_params.reader_cfg);
+    snfee::calo::rtd_prefetch_reader rtd_source(app_params.reader_cfg, app_params.logging);
 
     // Working RTD object:
-    snfee::data::raw_trigger_data rtd;
+    snfee::calo::rtd_prefetch_reader::rtd_ptr_type p_rtd;
    
-    // Calorimeter hit channel ID selector:
-    snfee::data::channel_id_selection calo_channel_selector(app_params.calo_channel_selector_cfg);
+    // Calorimeter hit selection (flags and channel ID):
+    snfee::calo::hit_selection::config_type calo_selection_cfg;
+    calo_selection_cfg.process_lt = app_params.process_lt;
+    calo_selection_cfg.process_ht = app_params.process_ht;
+    calo_selection_cfg.calo_channel_selector_cfg = app_params.calo_channel_selector_cfg;
+    snfee::calo::hit_selection calo_selection(calo_selection_cfg);
     
     /// Waveform drawer:
     std::unique_ptr<snfee::data::calo_waveform_drawer> calo_drawer;
@@ -239,15 +257,9 @@ int main(int argc_, char ** argv_)
     // Loop on stored RTD objects:
     std::size_t rtd_counter = 0;
     std::size_t selection_counter = 0;
-    while (rtd_source.has_record_tag()) {
-
-      // Check the serialization tag of the next record:
-      DT_THROW_IF(!rtd_source.record_tag_is(snfee::data::raw_trigger_data::SERIAL_TAG),
-                  std::logic_error,
-                  "Unexpected record tag '" << rtd_source.get_record_tag() << "'!");
-
-      // Load the next RTD object:
-      rtd_source.load(rtd);
+    // Load the next RTD object:
+    while (rtd_source.load(p_rtd)) {
+      const snfee::data::raw_trigger_data & rtd = *p_rtd;
 
       /**********************
        * Read raw calo data *
@@ -269,6 +281,10 @@ int main(int argc_, char ** argv_)
           options.put("with_waveform_samples", true);
           calo_hit.print_tree(std::clog, options);
         }
+
+        // Selected SAMLONG channels, from the hit header and channel flags only:
+        uint32_t selected_channels = calo_selection.select_hit(calo_hit);
+        if (selected_channels == 0) continue;
        
         // General calo hit's data:
         int32_t  calo_trigger_id = calo_hit.get_trigger_id(); // Trigger unique ID associated to the calo hit
@@ -285,6 +301,9 @@ int main(int argc_, char ** argv_)
         
         // Extract SAMLONG channels' data:
         for (int ichannel = 0; ichannel < snfee::model::feb_constants::SAMLONG_NUMBER_OF_CHANNELS; ichannel++) {
+
+          // Process selected channels (print/display...):
+          if ((selected_channels & (0x1 << ichannel)) == 0) continue;
           
           const snfee::data::calo_hit_record::channel_data_record & ch_data = calo_hit.get_channel_data(ichannel);
           bool    ch_lt           = ch_data.is_lt();            // Low threshold flag
@@ -335,91 +354,67 @@ int main(int argc_, char ** argv_)
           
           // Declare the waveform array for this SAMLONG channel:
           std::vector<uint16_t> ch_waveform;
-
-          // Check if this calo hit should be processed (print/display...):
-          bool selected_channel = true;
           
-          // Select hit:
-          if (app_params.process_lt and !ch_lt) {
-            // Hit with LT flag:
-            selected_channel = false;
-          }
-          if (app_params.process_ht and !ch_ht) {
-            // Hit with HT flag:
-            selected_channel = false;
+          // Print:
+          if (app_params.print) {
+            boost::property_tree::ptree options;
+            options.put("title", "Raw trigger data (RTD): ");
+            std::cout << std::endl;
+            rtd.print_tree(std::cout, options);
           }
-          if (!calo_channel_selector(ch_id)) {
-            // Hit with allowed channel ID:
-            selected_channel = false;
-          }
-
-          // Process selected channels:
-          if (selected_channel) {
-            
-            // Print:
-            if (app_params.print) {
-              boost::property_tree::ptree options;
-              options.put("title", "Raw trigger data (RTD): ");
-              std::cout << std::endl;
-              rtd.print_tree(std::cout, options);
-            }
 
-            // Constants:
-            double tdc_to_ns = snfee::model::feb_constants::SAMLONG_DEFAULT_TDC_LSB_NS;
-            double adc_to_mV = snfee::model::feb_constants::SAMLONG_ADC_VOLTAGE_LSB_MV;
+          // Constants:
+          double tdc_to_ns = snfee::model::feb_constants::SAMLONG_DEFAULT_TDC_LSB_NS;
+          double adc_to_mV = snfee::model::feb_constants::SAMLONG_ADC_VOLTAGE_LSB_MV;
 
-            // Firmware metadata:
-            double charge_nVs  = ch_charge * 1e-3 * adc_to_mV * tdc_to_ns;
-            double peak_mV     = ch_peak * adc_to_mV / 8;
-            double baseline_mV = ch_baseline * adc_to_mV / 16;
+          // Firmware metadata:
+          double charge_nVs  = ch_charge * 1e-3 * adc_to_mV * tdc_to_ns;
+          double peak_mV     = ch_peak * adc_to_mV / 8;
+          double baseline_mV = ch_baseline * adc_to_mV / 16;
+          
+          // Waveform processing:
+          if (has_waveforms) {
             
-            // Waveform processing:
-            if (has_waveforms) {
-              
-              // Extract ADC samples for the SAMLONG channel from the interleaved SAMLONG data:
-              // Fill the waveform array for this SAMLONG channel:
-              ch_waveform.reserve(waveform_number_of_samples);
-              for (int isample = 0; isample < waveform_number_of_samples; isample++) {
-                int16_t adc = calo_hit.get_waveforms().get_adc(isample, ichannel); // 0-4095 (ADC)
-                ch_waveform.push_back(adc); 
+            // Extract ADC samples for the SAMLONG channel from the interleaved SAMLONG data:
+            // Fill the waveform array for this SAMLONG channel:
+            snfee::calo::waveform_view ch_samples = snfee::calo::make_waveform_view(calo_hit, ichannel);
+            ch_samples.copy_to(ch_waveform); // 0-4095 (ADC)
+           
+            // Working waveform data structure:
+            snfee::data::calo_waveform_info waveform_info;
+
+            // Visualization of waveforms:
+            if (calo_drawer) {
+              if (waveform_info.waveform.size() == 0) {
+                // If waveform samples are not set yet, fetch them from the RTD
+                // and draw the waveform shape:
+                int16_t adc_zero  = snfee::model::feb_constants::SAMLONG_ADC_ZERO;
+                snfee::algo::calo_waveform_analysis::populate_waveform(ch_waveform,
+                                                                       waveform_info.waveform,
+                                                                       tdc_to_ns,
+                                                                       adc_zero,
+                                                                       adc_to_mV);
               }
-             
-              // Working waveform data structure:
-              snfee::data::calo_waveform_info waveform_info;
-
-              // Visualization of waveforms:
-              if (calo_drawer) {
-                if (waveform_info.waveform.size() == 0) {
-                  // If waveform samples are not set yet, fetch them from the RTD
-                  // and draw the waveform shape:
-                  int16_t adc_zero  = snfee::model::feb_constants::SAMLONG_ADC_ZERO;
-                  snfee::algo::calo_waveform_analysis::populate_waveform(ch_waveform,
-                                                                         waveform_info.waveform,
-                                                                         tdc_to_ns,
-                                                                         adc_zero,
-                                                                         adc_to_mV);
-                }
-                bool display_this_one = true;
-                if (display_this_one) {
-                  calo_drawer->draw(waveform_info, "", ch_id.to_string());
-                }
+              bool display_this_one = true;
+              if (display_this_one) {
+                calo_drawer->draw(waveform_info, "", ch_id.to_string());
               }
+            }
 
-            } // has_waveforms
-
-            selection_counter++;
-           
-            // Interactive:
-            if (!calo_drawer and app_params.is_interactive()) {
-              DT_LOG_NOTICE(datatools::logger::PRIO_ALWAYS, "Hit [Enter] to continue,[q] to quit...");
-              std::string answer;
-              std::getline(std::cin, answer);
-              if (answer == "q") {
-                break;
-              }
+          } // has_waveforms
+
+          selection_counter++;
+         
+          // Interactive:
+          if (!calo_drawer and app_params.is_interactive()) {
+            DT_LOG_NOTICE(datatools::logger::PRIO_ALWAYS, "Hit [Enter] to continue,[q] to quit...");
+            std::string answer;
+            std::getline(std::cin, answer);
+            if (answer == "q") {
+              break;
             }
+          }
 
-          } // end of selected channel
 
         } // end of channel loop in the current RTD record
         
@@ -0,0 +1,169 @@
+// Standard library:
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Third party:
+// - Boost:
+#include <boost/program_options.hpp>
+// - Bayeux:
+#include <bayeux/datatools/logger.h>
+#include <bayeux/datatools/exception.h>
+
+// This project:
+#include <snfee/snfee.h>
+
+// This example:
+#include "rtd_prefetch_reader.h"
+#include "calo_columnar_store.h"
+
+/// \brief Application configuration parameters
+struct app_params_type
+{
+  /// Logging priority
+  datatools::logger::priority logging = datatools::logger::PRIO_FATAL;
+
+  /// RTD reader configuration
+  snfee::calo::rtd_prefetch_reader::config_type reader_cfg;
+
+  /// Output columnar store filename
+  std::string output_filename;
+
+  /// Number of rows per block
+  uint32_t rows_per_block = 4096;
+
+  /// Maximum number of RTD records to convert (0: no limit)
+  std::size_t max_total_records = 0;
+};
+
+// Main program:
+int main(int argc_, char ** argv_)
+{
+  snfee::initialize();
+  int error_code = EXIT_SUCCESS;
+  try {
+
+    // Configuration:
+    app_params_type app_params;
+
+    // Parse options:
+    namespace po = boost::program_options;
+    po::options_description opts("Allowed options");
+    opts.add_options()
+      ("help", "produce help message")
+
+      ("logging,L",
+       po::value<std::string>()->value_name("level"),
+       "logging priority")
+
+      ("input-file,i",
+       po::value<std::vector<std::string>>(&app_params.reader_cfg.filenames)
+       ->multitoken()
+       ->value_name("path"),
+       "add a RTD input filename")
+
+      ("output-file,o",
+       po::value<std::string>(&app_params.output_filename)
+       ->value_name("path"),
+       "set the output columnar store filename")
+
+      ("rows-per-block",
+       po::value<uint32_t>(&app_params.rows_per_block)
+       ->default_value(4096)
+       ->value_name("number"),
+       "set the number of rows per block")
+
+      ("max-rtd,M",
+       po::value<std::size_t>(&app_params.max_total_records)
+       ->default_value(0)
+       ->value_name("number"),
+       "set the maximum number of RTD records to convert")
+
+    ; // end of options description
+
+    // Describe command line arguments :
+    po::variables_map vm;
+    po::store(po::command_line_parser(argc_, argv_)
+              .options(opts)
+              .run(), vm);
+    po::notify(vm);
+
+    // Use command line arguments :
+    if (vm.count("help")) {
+      std::cout << "snfee-rtd-to-columnar : "
+                << "Convert raw trigger data files (RTD) to a columnar store of calo hit channels"
+                << std::endl << std::endl;
+      std::cout << "Usage : " << std::endl << std::endl;
+      std::cout << "  snfee-rtd-to-columnar [OPTIONS]" << std::endl << std::endl;
+      std::cout << opts << std::endl;
+      std::cout << "Example : " << std::endl << std::endl;
+      std::cout << " snfee-rtd-to-columnar \\\n";
+      std::cout << "    --input-file \"snemo_run-8_rtd_part-0.data.gz\" \\\n";
+      std::cout << "    --input-file \"snemo_run-8_rtd_part-1.data.gz\" \\\n";
+      std::cout << "    --output-file \"snemo_run-8_calo.cols\" \n";
+      std::cout << std::endl << std::endl;
+      return (-1);
+    }
+
+    // Use command line arguments :
+    if (vm.count("logging")) {
+      std::string logging_repr = vm["logging"].as<std::string>();
+      app_params.logging = datatools::logger::get_priority(logging_repr);
+      DT_THROW_IF(app_params.logging == datatools::logger::PRIO_UNDEFINED,
+                  std::logic_error,
+                  "Invalid logging priority '" << vm["logging"].as<std::string>() << "'!");
+    }
+
+    // Checks:
+    DT_THROW_IF(app_params.reader_cfg.filenames.size() == 0,
+                std::logic_error,
+                "Missing input RTD filenames!");
+    DT_THROW_IF(app_params.output_filename.empty(),
+                std::logic_error,
+                "Missing output columnar store filename!");
+    DT_THROW_IF(app_params.rows_per_block == 0,
+                std::logic_error,
+                "Invalid number of rows per block!");
+
+    // Reader and writer:
+    snfee::calo::rtd_prefetch_reader rtd_source(app_params.reader_cfg, app_params.logging);
+    snfee::calo::columnar_writer writer(app_params.output_filename, app_params.rows_per_block);
+
+    std::size_t rtd_counter = 0;
+    std::size_t hit_counter = 0;
+    snfee::calo::rtd_prefetch_reader::rtd_ptr_type p_rtd;
+    while (rtd_source.load(p_rtd)) {
+      const snfee::data::raw_trigger_data & rtd = *p_rtd;
+      int32_t run_id     = rtd.get_run_id();
+      int32_t trigger_id = rtd.get_trigger_id();
+      for (const auto & p_calo_hit : rtd.get_calo_hits()) {
+        writer.add_hit(run_id, trigger_id, *p_calo_hit);
+        hit_counter++;
+      }
+      writer.add_record();
+      rtd_counter++;
+      if ((rtd_counter % 1000) == 0) {
+        std::clog << "Converted RTD records : " << rtd_counter << std::endl;
+      }
+      if (app_params.max_total_records > 0 and rtd_counter >= app_params.max_total_records) {
+        break;
+      }
+    }
+    writer.close();
+
+    // Report:
+    std::clog << "Total number of RTD objects       : " << rtd_counter << std::endl;
+    std::clog << "Total number of calo hits         : " << hit_counter << std::endl;
+
+  } catch (std::exception & x) {
+    std::cerr << "error: " << x.what() << std::endl;
+    error_code = EXIT_FAILURE;
+  } catch (...) {
+    std::cerr << "error: " << "unexpected error!" << std::endl;
+    error_code = EXIT_FAILURE;
+  }
+  snfee::terminate();
+  return (error_code);
+}